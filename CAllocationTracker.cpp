@@ -0,0 +1,67 @@
+#include "CAllocationTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace game
+{
+    namespace
+    {
+        thread_local uint64_t threadAllocations = 0;
+        std::atomic<uint64_t> totalAllocations(0);
+        std::atomic<uint64_t> totalBytes(0);
+
+        #ifdef TETRIS_TRACK_ALLOCATIONS
+        void* countAllocation(size_t size)
+        {
+            ++threadAllocations;
+            totalAllocations.fetch_add(1, std::memory_order_relaxed);
+            totalBytes.fetch_add(size, std::memory_order_relaxed);
+            void* result = std::malloc(size ? size : 1);
+            if (!result)
+            {
+                throw std::bad_alloc();
+            }
+            return result;
+        }
+        #endif
+    }
+
+    bool CAllocationTracker::isEnabled()
+    {
+        #ifdef TETRIS_TRACK_ALLOCATIONS
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    uint64_t CAllocationTracker::getThreadAllocations()
+    {
+        return threadAllocations;
+    }
+
+    uint64_t CAllocationTracker::getTotalAllocations()
+    {
+        return totalAllocations.load(std::memory_order_relaxed);
+    }
+
+    uint64_t CAllocationTracker::getTotalBytes()
+    {
+        return totalBytes.load(std::memory_order_relaxed);
+    }
+
+}
+
+#ifdef TETRIS_TRACK_ALLOCATIONS
+//The array and nothrow forms of the standard library forward to these two
+void* operator new(size_t size)
+{
+    return game::countAllocation(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+#endif
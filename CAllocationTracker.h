@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace game
+{
+
+//Counts heap allocations made through the global operator new. The counting operators
+//are compiled in only with the TRACK_ALLOCATIONS build option, otherwise all counters stay zero.
+class CAllocationTracker
+{
+public:
+    static bool isEnabled();
+    static uint64_t getThreadAllocations();
+    static uint64_t getTotalAllocations();
+    static uint64_t getTotalBytes();
+};
+
+//Allocations made by the current thread since the scope was created
+class CAllocationScope
+{
+public:
+    CAllocationScope()
+    : mStart(CAllocationTracker::getThreadAllocations())
+    {
+    }
+
+    uint64_t getCount() const
+    {
+        return CAllocationTracker::getThreadAllocations() - mStart;
+    }
+
+private:
+    uint64_t mStart;
+};
+
+}
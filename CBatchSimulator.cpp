@@ -0,0 +1,88 @@
+#include "CBatchSimulator.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace game
+{
+    CBatchSimulator::CBatchSimulator(unsigned threadsCount)
+    {
+        if (threadsCount == 0)
+        {
+            threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        mGames.resize(threadsCount);
+    }
+
+    void CBatchSimulator::run(size_t jobsCount, const TJob& job)
+    {
+        std::atomic<size_t> nextJob(0);
+        auto worker = [&nextJob, jobsCount, &job](CTetris& game) {
+            for (size_t i = nextJob++; i < jobsCount; i = nextJob++)
+            {
+                job(i, game);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(mGames.size() - 1);
+        for (size_t i = 1; i < mGames.size(); ++i)
+        {
+            threads.emplace_back(worker, std::ref(mGames[i]));
+        }
+        worker(mGames[0]);
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    std::vector<GameResult> CBatchSimulator::play(const std::vector<unsigned>& seeds, const TPlayer& player, int maxPieces)
+    {
+        std::vector<GameResult> results(seeds.size());
+        run(seeds.size(), [this, &seeds, &player, maxPieces, &results](size_t job, CTetris& game) {
+            CDatasetStream* stream = mStreams.empty() ? nullptr : mStreams[&game - mGames.data()];
+            results[job] = playGame(game, seeds[job], player, maxPieces, stream);
+        });
+        return results;
+    }
+
+    unsigned CBatchSimulator::getThreadsCount() const
+    {
+        return static_cast<unsigned>(mGames.size());
+    }
+
+    void CBatchSimulator::setDatasetWriter(CDatasetWriter* writer)
+    {
+        mStreams.clear();
+        if (writer)
+        {
+            for (size_t i = 0; i < mGames.size(); ++i)
+            {
+                mStreams.push_back(&writer->createStream());
+            }
+        }
+    }
+
+    GameResult CBatchSimulator::playGame(CTetris& game, unsigned seed, const TPlayer& player, int maxPieces, CDatasetStream* stream)
+    {
+        game.resetGame(seed);
+        int pieces = 0;
+        while (game.getGameState() == EGameState::STATE_INGAME && pieces < maxPieces)
+        {
+            const Placement placement = player(game);
+            if (stream)
+            {
+                stream->addDecision(game, placement);
+            }
+            game.place(placement);
+            ++pieces;
+        }
+        if (stream)
+        {
+            stream->endGame(game);
+        }
+        return GameResult{seed, game.getScores(), game.getLines(), pieces};
+    }
+}
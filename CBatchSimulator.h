@@ -0,0 +1,45 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "CDatasetWriter.h"
+#include "CTetris.h"
+
+namespace game
+{
+
+struct GameResult
+{
+    unsigned seed;
+    int scores;
+    int lines;
+    int pieces;
+};
+
+using TPlayer = std::function<Placement(const CTetris&)>;
+using TJob = std::function<void(size_t job, CTetris& game)>;
+
+//Runs headless games on every core. Each worker owns one preallocated game
+//which is reseeded for every job, so repeated runs don't allocate fields again.
+class CBatchSimulator
+{
+public:
+    explicit CBatchSimulator(unsigned threadsCount = 0);
+
+    void run(size_t jobsCount, const TJob& job);
+    std::vector<GameResult> play(const std::vector<unsigned>& seeds, const TPlayer& player, int maxPieces);
+    unsigned getThreadsCount() const;
+    //Records every decision of the games played from now on, one stream per worker
+    void setDatasetWriter(CDatasetWriter* writer);
+
+    static GameResult playGame(CTetris& game, unsigned seed, const TPlayer& player, int maxPieces,
+                               CDatasetStream* stream = nullptr);
+
+    CBatchSimulator(const CBatchSimulator& other) = delete;
+    CBatchSimulator& operator=(const CBatchSimulator& other) = delete;
+
+private:
+    std::vector<CTetris> mGames;
+    std::vector<CDatasetStream*> mStreams;
+};
+
+}
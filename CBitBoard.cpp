@@ -0,0 +1,245 @@
+#include "CBitBoard.h"
+
+namespace game
+{
+    namespace
+    {
+        using TShapes = std::array<std::array<FigureShape, CBitBoard::mRotationsCount>, CBitBoard::mFiguresCount>;
+
+        TShapes makeShapes()
+        {
+            TShapes shapes;
+            for (int f = 0; f < CBitBoard::mFiguresCount; ++f)
+            {
+                const Point* cells = CTetris::getFigureShape(f);
+                for (int i = 0; i < 4; ++i)
+                {
+                    shapes[f][0].cells[i].x = cells[i].x - cells[1].x;
+                    shapes[f][0].cells[i].y = cells[i].y - cells[1].y;
+                }
+
+                for (int r = 1; r < CBitBoard::mRotationsCount; ++r)
+                {
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        const Point& p = shapes[f][r - 1].cells[i];
+                        shapes[f][r].cells[i].x = -p.y;
+                        shapes[f][r].cells[i].y = p.x;
+                    }
+                }
+            }
+            return shapes;
+        }
+    }
+
+    CBitBoard::CBitBoard()
+    : mRows()
+    , mWidth(0)
+    , mHeight(0)
+    , mFullRow(0)
+    , mToppedOut(false)
+    {
+    }
+
+    CBitBoard::CBitBoard(const TFieldType& field)
+    : CBitBoard()
+    {
+        load(field);
+    }
+
+    bool CBitBoard::load(const TFieldType& field)
+    {
+        const int height = static_cast<int>(field.size());
+        const int width = height > 0 ? static_cast<int>(field[0].size()) : 0;
+        mToppedOut = false;
+        mRows.fill(0);
+        if (width > mMaxWidth || height > mMaxHeight)
+        {
+            mWidth = 0;
+            mHeight = 0;
+            mFullRow = 0;
+            return false;
+        }
+        mHeight = height;
+        mWidth = width;
+        mFullRow = static_cast<TRow>((1u << mWidth) - 1);
+        for (int i = 0; i < mHeight; ++i)
+        {
+            TRow row = 0;
+            for (int j = 0; j < mWidth; ++j)
+            {
+                if (field[i][j])
+                {
+                    row |= static_cast<TRow>(1u << j);
+                }
+            }
+            mRows[i] = row;
+        }
+        return true;
+    }
+
+    const FigureShape& CBitBoard::getShape(int figure, int rotation)
+    {
+        static const TShapes shapes = makeShapes();
+        return shapes[figure][rotation];
+    }
+
+    int CBitBoard::getRotationsCount(int figure)
+    {
+        return figure == 6 ? 1 : mRotationsCount; //'O' figure doesn't rotate in CTetris::rotate
+    }
+
+    Point CBitBoard::getSpawnPivot(int figure, int fieldWidth)
+    {
+        const Point& pivot = CTetris::getFigureShape(figure)[1];
+        return Point{pivot.x + fieldWidth / 2, pivot.y - 3};
+    }
+
+    bool CBitBoard::isCollided(const FigureShape& shape, int x, int y) const
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            int cx = x + shape.cells[i].x;
+            int cy = y + shape.cells[i].y;
+            if (cx < 0 || cx >= mWidth || cy >= mHeight)
+            {
+                return true;
+            }
+            if (cy >= 0 && (mRows[cy] >> cx) & 1)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int CBitBoard::getPlacements(int figure, Placement* placements) const
+    {
+        int count = 0;
+        int spawnY = getSpawnPivot(figure, mWidth).y;
+        for (int r = 0; r < getRotationsCount(figure); ++r)
+        {
+            const FigureShape& shape = getShape(figure, r);
+            for (int x = 0; x < mWidth; ++x)
+            {
+                if (!isCollided(shape, x, spawnY))
+                {
+                    placements[count++] = Placement{r, x};
+                }
+            }
+        }
+        return count;
+    }
+
+    int CBitBoard::place(int figure, const Placement& placement)
+    {
+        const FigureShape& shape = getShape(figure, placement.rotation);
+        int y = getSpawnPivot(figure, mWidth).y;
+        if (isCollided(shape, placement.column, y))
+        {
+            return -1;
+        }
+
+        while (!isCollided(shape, placement.column, y + 1))
+        {
+            ++y;
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int cy = y + shape.cells[i].y;
+            if (cy <= 0)
+            {
+                mToppedOut = true;
+            }
+            if (cy >= 0)
+            {
+                mRows[cy] |= static_cast<TRow>(1u << (placement.column + shape.cells[i].x));
+            }
+        }
+        return clearLines();
+    }
+
+    int CBitBoard::clearLines()
+    {
+        int lines = 0;
+        int to = mHeight - 1;
+        for (int from = mHeight - 1; from >= 0; --from)
+        {
+            if (mRows[from] == mFullRow)
+            {
+                ++lines;
+                continue;
+            }
+            mRows[to--] = mRows[from];
+        }
+        for (; to >= 0; --to)
+        {
+            mRows[to] = 0;
+        }
+        return lines;
+    }
+
+    bool CBitBoard::isToppedOut() const
+    {
+        return mToppedOut;
+    }
+
+    bool CBitBoard::operator==(const CBitBoard& other) const
+    {
+        return mWidth == other.mWidth && mHeight == other.mHeight && mRows == other.mRows;
+    }
+
+    CBitBoard::TRow CBitBoard::getRow(int y) const
+    {
+        return mRows[y];
+    }
+
+    int CBitBoard::getWidth() const
+    {
+        return mWidth;
+    }
+
+    int CBitBoard::getHeight() const
+    {
+        return mHeight;
+    }
+
+    void CBitBoard::getColumnHeights(int* heights) const
+    {
+        TRow seen = 0;
+        for (int j = 0; j < mWidth; ++j)
+        {
+            heights[j] = 0;
+        }
+        for (int i = 0; i < mHeight && seen != mFullRow; ++i)
+        {
+            TRow fresh = mRows[i] & ~seen;
+            for (int j = 0; fresh; ++j, fresh >>= 1)
+            {
+                if (fresh & 1)
+                {
+                    heights[j] = mHeight - i;
+                }
+            }
+            seen |= mRows[i];
+        }
+    }
+
+    int CBitBoard::getHolesCount() const
+    {
+        int holes = 0;
+        TRow covered = 0;
+        for (int i = 0; i < mHeight; ++i)
+        {
+            TRow empty = covered & ~mRows[i];
+            while (empty)
+            {
+                empty &= empty - 1;
+                ++holes;
+            }
+            covered |= mRows[i];
+        }
+        return holes;
+    }
+}
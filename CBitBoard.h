@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "CTetris.h"
+
+namespace game
+{
+
+//Figure cells as offsets from the rotation pivot (the second cell of a figure, like CTetris::rotate uses)
+struct FigureShape
+{
+    Point cells[4];
+};
+
+//Compact copy of the field for bots: one bit per cell, one row per word.
+//It is a plain value type, so search code can keep copies on the stack.
+class CBitBoard
+{
+public:
+    using TRow = uint16_t;
+
+    static const int mMaxWidth = 16;
+    static const int mMaxHeight = 32;
+    static const int mFiguresCount = CTetris::mFiguresCount;
+    static const int mRotationsCount = 4;
+    static const int mMaxPlacements = mRotationsCount * mMaxWidth;
+
+    CBitBoard();
+    //A field which doesn't fit gives an empty board, use load() to find out
+    explicit CBitBoard(const TFieldType& field);
+    //False for a field wider than mMaxWidth or higher than mMaxHeight, the board is left empty
+    bool load(const TFieldType& field);
+
+    static const FigureShape& getShape(int figure, int rotation);
+    static int getRotationsCount(int figure);
+    static Point getSpawnPivot(int figure, int fieldWidth);
+
+    bool isCollided(const FigureShape& shape, int x, int y) const;
+    int getPlacements(int figure, Placement* placements) const;
+    int place(int figure, const Placement& placement);
+    bool isToppedOut() const;
+    bool operator==(const CBitBoard& other) const;
+
+    TRow getRow(int y) const;
+    int getWidth() const;
+    int getHeight() const;
+    void getColumnHeights(int* heights) const;
+    int getHolesCount() const;
+
+private:
+    int clearLines();
+
+private:
+    std::array<TRow, mMaxHeight> mRows;
+    int mWidth;
+    int mHeight;
+    TRow mFullRow;
+    bool mToppedOut;
+};
+
+}
@@ -0,0 +1,168 @@
+#include "CBlocksRenderer.h"
+#include "CTracer.h"
+
+namespace
+{
+    const int figureCells = 4;
+    const int previewSpacing = 5;
+    //A figure gets its colour only when it spawns, so previews are drawn with the first tile
+    const int previewTile = 0;
+    const sf::Color ghostColor(255, 255, 255, 90);
+}
+
+CBlocksRenderer::CBlocksRenderer(const sf::Texture& texture, const sf::Sprite& backGround, sf::Vector2u size,
+                                 int blockSize, float scaleFactor)
+: mTexture(texture)
+, mBackGround(backGround)
+, mFieldVertices(sf::Quads)
+, mFigureVertices(sf::Quads, 4 * figureCells * (2 + game::CTetris::mMaxPreviewSize))
+, mFieldVersion(0)
+, mBoardLayerValid(false)
+, mBlockSize(blockSize)
+, mQuadSize(blockSize * scaleFactor)
+{
+    mBoardLayer.create(size.x, size.y);
+    mBoardSprite.setTexture(mBoardLayer.getTexture());
+}
+
+void CBlocksRenderer::setQuad(sf::VertexArray& vertices, size_t quad, float x, float y, int tileX, sf::Color color)
+{
+    sf::Vertex* v = &vertices[quad * 4];
+    const float tx = static_cast<float>(tileX);
+    const float size = static_cast<float>(mBlockSize);
+
+    v[0].position = sf::Vector2f(x, y);
+    v[1].position = sf::Vector2f(x + mQuadSize, y);
+    v[2].position = sf::Vector2f(x + mQuadSize, y + mQuadSize);
+    v[3].position = sf::Vector2f(x, y + mQuadSize);
+
+    v[0].texCoords = sf::Vector2f(tx, 0.0f);
+    v[1].texCoords = sf::Vector2f(tx + size, 0.0f);
+    v[2].texCoords = sf::Vector2f(tx + size, size);
+    v[3].texCoords = sf::Vector2f(tx, size);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        v[i].color = color;
+    }
+}
+
+void CBlocksRenderer::hideQuad(sf::VertexArray& vertices, size_t quad)
+{
+    sf::Vertex* v = &vertices[quad * 4];
+    for (int i = 0; i < 4; ++i)
+    {
+        v[i].position = sf::Vector2f(0.0f, 0.0f);
+    }
+}
+
+void CBlocksRenderer::updateBoardLayer(const game::CTetris& game)
+{
+    TETRIS_TRACE_SCOPE("render board layer");
+    const int fieldWidth = game.getFieldWidth();
+    const int fieldHeight = game.getFieldHeight();
+    mFieldVertices.resize(static_cast<size_t>(fieldWidth * fieldHeight) * 4);
+
+    const game::TFieldType& field = game.getField();
+    for (int i = 0; i < fieldHeight; ++i)
+    {
+        for (int j = 0; j < fieldWidth; ++j)
+        {
+            const size_t quad = static_cast<size_t>(i * fieldWidth + j);
+            if (field[i][j] == 0)
+            {
+                hideQuad(mFieldVertices, quad);
+                continue;
+            }
+            setQuad(mFieldVertices, quad, static_cast<float>(j * mBlockSize), static_cast<float>(i * mBlockSize),
+                    field[i][j] * mBlockSize, sf::Color::White);
+        }
+    }
+
+    mBoardLayer.clear(sf::Color(0, 0, 30));
+    mBoardLayer.draw(mBackGround);
+    mBoardLayer.draw(mFieldVertices, &mTexture);
+    mBoardLayer.display();
+}
+
+void CBlocksRenderer::update(const game::CTetris& game)
+{
+    TETRIS_TRACE_SCOPE("render blocks update");
+    //Settled blocks change only when a figure locks, lines clear or the game restarts
+    if (!mBoardLayerValid || mFieldVersion != game.getFieldVersion())
+    {
+        updateBoardLayer(game);
+        mFieldVersion = game.getFieldVersion();
+        mBoardLayerValid = true;
+    }
+
+    const int fieldWidth = game.getFieldWidth();
+    const int fieldHeight = game.getFieldHeight();
+    const game::TFieldType& field = game.getField();
+    const size_t ghostQuad = 0;
+    const size_t figureQuad = ghostQuad + figureCells;
+    const size_t previewQuad = figureQuad + figureCells;
+    const size_t quadsCount = mFigureVertices.getVertexCount() / 4;
+
+    const bool figureVisible = game.getGameState() == game::EGameState::STATE_INGAME ||
+                               game.getGameState() == game::EGameState::STATE_PAUSE;
+    for (size_t quad = ghostQuad; quad < quadsCount; ++quad)
+    {
+        hideQuad(mFigureVertices, quad);
+    }
+    if (!figureVisible)
+    {
+        return;
+    }
+
+    const game::Point* figure = game.getCurrentFigure();
+    const int color = game.getFigureColor();
+
+    //The ghost shows where the figure lands: shift it down while it still fits
+    auto fits = [&field, fieldWidth, fieldHeight, figure](int dy) {
+        for (int i = 0; i < figureCells; ++i)
+        {
+            const int x = figure[i].x;
+            const int y = figure[i].y + dy;
+            if (x < 0 || x >= fieldWidth || y >= fieldHeight || (y >= 0 && field[y][x]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    int ghostShift = 0;
+    while (fits(ghostShift + 1))
+    {
+        ++ghostShift;
+    }
+
+    for (int i = 0; i < figureCells; ++i)
+    {
+        setQuad(mFigureVertices, ghostQuad + i, static_cast<float>(figure[i].x * mBlockSize),
+                static_cast<float>((figure[i].y + ghostShift) * mBlockSize), color * mBlockSize, ghostColor);
+        setQuad(mFigureVertices, figureQuad + i, static_cast<float>(figure[i].x * mBlockSize),
+                static_cast<float>(figure[i].y * mBlockSize), color * mBlockSize, sf::Color::White);
+    }
+
+    //Previews are stacked under each other, a figure is at most 4 blocks high
+    for (int p = 0; p < game.getPreviewSize(); ++p)
+    {
+        const game::Point* nextFigure = game.getPreviewFigure(p);
+        for (int i = 0; i < figureCells; ++i)
+        {
+            setQuad(mFigureVertices, previewQuad + p * figureCells + i,
+                    static_cast<float>(nextFigure[i].x * mBlockSize + fieldWidth * mBlockSize + 40),
+                    static_cast<float>((nextFigure[i].y + p * previewSpacing) * mBlockSize + 100),
+                    previewTile * mBlockSize, sf::Color::White);
+        }
+    }
+}
+
+void CBlocksRenderer::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    TETRIS_TRACE_SCOPE("render blocks draw");
+    target.draw(mBoardSprite, states);
+    states.texture = &mTexture;
+    target.draw(mFigureVertices, states);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include "CTetris.h"
+
+//Draws the game in two layers. The background and settled blocks are pre-rendered into
+//a texture which is redrawn only when the field version changes. The ghost, current
+//figure and previews are one quad array over the blocks texture, drawn with one call.
+class CBlocksRenderer : public sf::Drawable
+{
+public:
+    CBlocksRenderer(const sf::Texture& texture, const sf::Sprite& backGround, sf::Vector2u size,
+                    int blockSize, float scaleFactor);
+    void update(const game::CTetris& game);
+
+private:
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+    void updateBoardLayer(const game::CTetris& game);
+    void setQuad(sf::VertexArray& vertices, size_t quad, float x, float y, int tileX, sf::Color color);
+    void hideQuad(sf::VertexArray& vertices, size_t quad);
+
+private:
+    const sf::Texture& mTexture;
+    const sf::Sprite& mBackGround;
+    sf::RenderTexture mBoardLayer;
+    sf::Sprite mBoardSprite;
+    sf::VertexArray mFieldVertices;
+    sf::VertexArray mFigureVertices;
+    unsigned mFieldVersion;
+    bool mBoardLayerValid;
+    int mBlockSize;
+    float mQuadSize;
+};
@@ -0,0 +1,253 @@
+#include "CDatasetReader.h"
+#include <cstring>
+
+#ifdef TETRIS_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace game
+{
+    namespace
+    {
+        const char datasetMagic[4] = {'T', 'D', 'S', '1'};
+        const uint32_t datasetVersion = 1;
+        const size_t headerSize = 16;
+        const size_t chunkAlignment = 8;
+
+        uint32_t getUint32(const uint8_t* data)
+        {
+            return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+        }
+
+        size_t getPayloadSize(const DatasetChunkHeader& header, int queueSize)
+        {
+            const size_t samples = header.samplesCount;
+            return samples * (sizeof(int32_t) + 3 + static_cast<size_t>(queueSize)) + header.rowsCount * sizeof(uint16_t);
+        }
+    }
+
+    CDatasetReader::CDatasetReader()
+    : mData(nullptr)
+    , mDataSize(0)
+    , mFileHandle(nullptr)
+    , mMappingHandle(nullptr)
+    , mSamplesCount(0)
+    , mFieldWidth(0)
+    , mFieldHeight(0)
+    , mQueueSize(0)
+    {
+    }
+
+    CDatasetReader::~CDatasetReader()
+    {
+        close();
+    }
+
+    bool CDatasetReader::open(const std::string& path)
+    {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size;
+        HANDLE mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        mFileHandle = file;
+        mMappingHandle = mapping;
+        if (view == nullptr)
+        {
+            close();
+            return false;
+        }
+        mData = static_cast<const uint8_t*>(view);
+        mDataSize = static_cast<size_t>(size.QuadPart);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        void* view = MAP_FAILED;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+        }
+        ::close(file);
+        if (view == MAP_FAILED)
+        {
+            return false;
+        }
+        mData = static_cast<const uint8_t*>(view);
+        mDataSize = static_cast<size_t>(info.st_size);
+#endif
+
+        if (mDataSize < headerSize || std::memcmp(mData, datasetMagic, sizeof(datasetMagic)) != 0 ||
+            getUint32(mData + 4) != datasetVersion)
+        {
+            close();
+            return false;
+        }
+        mFieldWidth = mData[8];
+        mFieldHeight = mData[9];
+        mQueueSize = mData[10];
+        if (mFieldWidth > CBitBoard::mMaxWidth || mFieldHeight > CBitBoard::mMaxHeight || mQueueSize > CTetris::mMaxPreviewSize)
+        {
+            close();
+            return false;
+        }
+
+        //A chunk cut off by a crash of the writer ends the index, the chunks before it stay readable
+        size_t offset = headerSize;
+        while (offset + sizeof(DatasetChunkHeader) <= mDataSize)
+        {
+            DatasetChunkHeader header;
+            std::memcpy(&header, mData + offset, sizeof(header));
+            const size_t stored = (static_cast<size_t>(header.storedSize) + chunkAlignment - 1) / chunkAlignment * chunkAlignment;
+            if (header.magic != DatasetChunkHeader::mMagic || offset + sizeof(header) + stored > mDataSize ||
+                header.payloadSize != getPayloadSize(header, mQueueSize))
+            {
+                break;
+            }
+            mChunkOffsets.push_back(offset);
+            mSamplesCount += header.samplesCount;
+            offset += sizeof(header) + stored;
+        }
+        return true;
+    }
+
+    void CDatasetReader::close()
+    {
+#ifdef _WIN32
+        if (mData)
+        {
+            UnmapViewOfFile(mData);
+        }
+        if (mMappingHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mMappingHandle));
+        }
+        if (mFileHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mFileHandle));
+        }
+#else
+        if (mData)
+        {
+            munmap(const_cast<uint8_t*>(mData), mDataSize);
+        }
+#endif
+        mData = nullptr;
+        mDataSize = 0;
+        mFileHandle = nullptr;
+        mMappingHandle = nullptr;
+        mChunkOffsets.clear();
+        mSamplesCount = 0;
+    }
+
+    size_t CDatasetReader::getChunksCount() const
+    {
+        return mChunkOffsets.size();
+    }
+
+    uint64_t CDatasetReader::getSamplesCount() const
+    {
+        return mSamplesCount;
+    }
+
+    int CDatasetReader::getFieldWidth() const
+    {
+        return mFieldWidth;
+    }
+
+    int CDatasetReader::getFieldHeight() const
+    {
+        return mFieldHeight;
+    }
+
+    int CDatasetReader::getQueueSize() const
+    {
+        return mQueueSize;
+    }
+
+    bool CDatasetReader::loadChunk(size_t index, DatasetChunkView& chunk) const
+    {
+        if (index >= mChunkOffsets.size())
+        {
+            return false;
+        }
+        DatasetChunkHeader header;
+        std::memcpy(&header, mData + mChunkOffsets[index], sizeof(header));
+        const uint8_t* payload = mData + mChunkOffsets[index] + sizeof(header);
+        if (header.compressed)
+        {
+#ifdef TETRIS_ZLIB
+            chunk.inflated.resize(header.payloadSize);
+            uLongf size = header.payloadSize;
+            if (uncompress(chunk.inflated.data(), &size, payload, header.storedSize) != Z_OK || size != header.payloadSize)
+            {
+                return false;
+            }
+            payload = chunk.inflated.data();
+#else
+            return false;
+#endif
+        }
+        else if (header.storedSize != header.payloadSize)
+        {
+            return false;
+        }
+
+        //The columns are aligned in the file, see CDatasetWriter.h
+        const size_t samples = header.samplesCount;
+        chunk.samplesCount = samples;
+        chunk.outcomes = reinterpret_cast<const int32_t*>(payload);
+        chunk.rows = reinterpret_cast<const uint16_t*>(payload + samples * sizeof(int32_t));
+        chunk.heights = payload + samples * sizeof(int32_t) + header.rowsCount * sizeof(uint16_t);
+        chunk.figures = chunk.heights + samples;
+        chunk.queues = chunk.figures + samples;
+        chunk.placements = chunk.queues + samples * static_cast<size_t>(mQueueSize);
+
+        chunk.rowOffsets.resize(samples);
+        uint32_t rows = 0;
+        for (size_t i = 0; i < samples; ++i)
+        {
+            if (chunk.heights[i] > mFieldHeight)
+            {
+                return false;
+            }
+            chunk.rowOffsets[i] = rows;
+            rows += chunk.heights[i];
+        }
+        return rows == header.rowsCount;
+    }
+
+    void CDatasetReader::getSample(const DatasetChunkView& chunk, size_t index, DatasetSample& sample) const
+    {
+        const int height = chunk.heights[index];
+        const int top = mFieldHeight - height;
+        for (int i = 0; i < CBitBoard::mMaxHeight; ++i)
+        {
+            sample.rows[i] = i >= top && i < mFieldHeight ? chunk.rows[chunk.rowOffsets[index] + (i - top)] : 0;
+        }
+        sample.figure = chunk.figures[index];
+        std::memcpy(sample.queue, chunk.queues + index * static_cast<size_t>(mQueueSize), static_cast<size_t>(mQueueSize));
+        sample.placement = Placement{chunk.placements[index] & 3, chunk.placements[index] >> 2};
+        sample.outcome = chunk.outcomes[index];
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CBitBoard.h"
+#include "CDatasetWriter.h"
+
+namespace game
+{
+
+//The columns of one chunk. They point into the mapped file, or into the chunk's own
+//buffer when the chunk was compressed.
+struct DatasetChunkView
+{
+    size_t samplesCount;
+    const int32_t* outcomes;
+    const uint16_t* rows;
+    const uint8_t* heights;
+    const uint8_t* figures;
+    const uint8_t* queues;
+    const uint8_t* placements;
+    std::vector<uint32_t> rowOffsets; //First row of every sample in rows
+    std::vector<uint8_t> inflated;
+};
+
+struct DatasetSample
+{
+    CBitBoard::TRow rows[CBitBoard::mMaxHeight]; //Top to bottom, one bit per cell like CBitBoard
+    int figure;
+    uint8_t queue[CTetris::mMaxPreviewSize];
+    Placement placement;
+    int outcome;
+};
+
+//Maps a dataset file written by CDatasetWriter and indexes its chunks. Uncompressed
+//chunks are read in place, a compressed one is inflated when it is loaded.
+class CDatasetReader
+{
+public:
+    CDatasetReader();
+    ~CDatasetReader();
+
+    bool open(const std::string& path);
+    void close();
+    size_t getChunksCount() const;
+    uint64_t getSamplesCount() const;
+    int getFieldWidth() const;
+    int getFieldHeight() const;
+    int getQueueSize() const;
+    //False for a broken chunk or a compressed one without zlib in the build
+    bool loadChunk(size_t index, DatasetChunkView& chunk) const;
+    void getSample(const DatasetChunkView& chunk, size_t index, DatasetSample& sample) const;
+
+    CDatasetReader(const CDatasetReader& other) = delete;
+    CDatasetReader& operator=(const CDatasetReader& other) = delete;
+
+private:
+    const uint8_t* mData;
+    size_t mDataSize;
+    void* mFileHandle;
+    void* mMappingHandle;
+    std::vector<size_t> mChunkOffsets;
+    uint64_t mSamplesCount;
+    int mFieldWidth;
+    int mFieldHeight;
+    int mQueueSize;
+};
+
+}
@@ -0,0 +1,351 @@
+#include "CDatasetWriter.h"
+#include <algorithm>
+#include "CBitBoard.h"
+#include <cstring>
+
+#ifdef TETRIS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace game
+{
+    namespace
+    {
+        const char datasetMagic[4] = {'T', 'D', 'S', '1'};
+        const uint32_t datasetVersion = 1;
+        const size_t chunkAlignment = 8;
+
+        //Little endian whatever the host, like the file layout says
+        void putUint32(uint8_t* data, uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                data[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        template <typename T>
+        void appendColumn(std::vector<uint8_t>& payload, const std::vector<T>& column)
+        {
+            const size_t offset = payload.size();
+            payload.resize(offset + column.size() * sizeof(T));
+            if (!column.empty())
+            {
+                std::memcpy(payload.data() + offset, column.data(), column.size() * sizeof(T));
+            }
+        }
+    }
+
+    void DatasetChunk::clear()
+    {
+        outcomes.clear();
+        rows.clear();
+        heights.clear();
+        figures.clear();
+        queues.clear();
+        placements.clear();
+    }
+
+    size_t DatasetChunk::getSamplesCount() const
+    {
+        return outcomes.size();
+    }
+
+    CDatasetStream::CDatasetStream(CDatasetWriter& writer)
+    : mWriter(writer)
+    , mChunk(writer.takeFreeChunk())
+    , mGameStart(0)
+    {
+    }
+
+    bool CDatasetStream::addDecision(const CTetris& game, const Placement& placement)
+    {
+        const DatasetConfig& config = mWriter.getConfig();
+        if (game.getFieldWidth() != config.fieldWidth || game.getFieldHeight() != config.fieldHeight)
+        {
+            return false;
+        }
+
+        //Rows above the highest filled one are empty and not stored
+        const TFieldType& field = game.getField();
+        int top = config.fieldHeight;
+        for (int i = 0; i < config.fieldHeight; ++i)
+        {
+            uint16_t row = 0;
+            for (int j = 0; j < config.fieldWidth; ++j)
+            {
+                if (field[i][j])
+                {
+                    row |= static_cast<uint16_t>(1u << j);
+                }
+            }
+            if (row != 0 && top == config.fieldHeight)
+            {
+                top = i;
+            }
+            if (top != config.fieldHeight)
+            {
+                mChunk->rows.push_back(row);
+            }
+        }
+
+        //The lines so far, replaced by the lines still to come when the game ends
+        mChunk->outcomes.push_back(game.getLines());
+        mChunk->heights.push_back(static_cast<uint8_t>(config.fieldHeight - top));
+        mChunk->figures.push_back(static_cast<uint8_t>(game.getCurrentFigureId()));
+        for (int i = 0; i < config.queueSize; ++i)
+        {
+            mChunk->queues.push_back(static_cast<uint8_t>(game.getPreviewFigureId(i)));
+        }
+        mChunk->placements.push_back(static_cast<uint8_t>(placement.rotation | placement.column << 2));
+        return true;
+    }
+
+    void CDatasetStream::endGame(const CTetris& game)
+    {
+        const int lines = game.getLines();
+        for (size_t i = mGameStart; i < mChunk->outcomes.size(); ++i)
+        {
+            mChunk->outcomes[i] = lines - mChunk->outcomes[i];
+        }
+        mGameStart = mChunk->outcomes.size();
+        if (mGameStart >= mWriter.getConfig().chunkSamples)
+        {
+            flush();
+        }
+    }
+
+    void CDatasetStream::flush()
+    {
+        //A game which is still running stays for the next chunk
+        if (mGameStart == 0)
+        {
+            return;
+        }
+        std::unique_ptr<DatasetChunk> next = mWriter.takeFreeChunk();
+        if (mGameStart < mChunk->getSamplesCount())
+        {
+            DatasetChunk& chunk = *mChunk;
+            size_t rowsStart = 0;
+            for (size_t i = 0; i < mGameStart; ++i)
+            {
+                rowsStart += chunk.heights[i];
+            }
+            const size_t queueSize = static_cast<size_t>(mWriter.getConfig().queueSize);
+            next->outcomes.assign(chunk.outcomes.begin() + mGameStart, chunk.outcomes.end());
+            next->rows.assign(chunk.rows.begin() + rowsStart, chunk.rows.end());
+            next->heights.assign(chunk.heights.begin() + mGameStart, chunk.heights.end());
+            next->figures.assign(chunk.figures.begin() + mGameStart, chunk.figures.end());
+            next->queues.assign(chunk.queues.begin() + mGameStart * queueSize, chunk.queues.end());
+            next->placements.assign(chunk.placements.begin() + mGameStart, chunk.placements.end());
+            chunk.outcomes.resize(mGameStart);
+            chunk.rows.resize(rowsStart);
+            chunk.heights.resize(mGameStart);
+            chunk.figures.resize(mGameStart);
+            chunk.queues.resize(mGameStart * queueSize);
+            chunk.placements.resize(mGameStart);
+        }
+
+        mWriter.submit(std::move(mChunk));
+        mChunk = std::move(next);
+        mGameStart = 0;
+    }
+
+    CDatasetWriter::CDatasetWriter(const DatasetConfig& config)
+    : mConfig(config)
+    , mFile(nullptr)
+    , mStopping(false)
+    , mStats()
+    {
+        mConfig.queueSize = std::max(0, std::min(mConfig.queueSize, CTetris::mMaxPreviewSize));
+        mConfig.chunkSamples = std::max<size_t>(1, mConfig.chunkSamples);
+    }
+
+    CDatasetWriter::~CDatasetWriter()
+    {
+        close();
+    }
+
+    bool CDatasetWriter::open()
+    {
+        if (mConfig.fieldWidth < 1 || mConfig.fieldWidth > CBitBoard::mMaxWidth || mConfig.fieldHeight < 1 ||
+            mConfig.fieldHeight > CBitBoard::mMaxHeight)
+        {
+            return false;
+        }
+        mFile = std::fopen(mConfig.path.c_str(), "wb");
+        if (!mFile)
+        {
+            return false;
+        }
+        uint8_t header[12];
+        std::memcpy(header, datasetMagic, sizeof(datasetMagic));
+        putUint32(header + 4, datasetVersion);
+        header[8] = static_cast<uint8_t>(mConfig.fieldWidth);
+        header[9] = static_cast<uint8_t>(mConfig.fieldHeight);
+        header[10] = static_cast<uint8_t>(mConfig.queueSize);
+        header[11] = 0;
+        //Padded like the chunks, so the columns of a mapped file are aligned
+        const uint8_t padding[chunkAlignment] = {};
+        if (std::fwrite(header, sizeof(header), 1, mFile) != 1 ||
+            std::fwrite(padding, chunkAlignment - sizeof(header) % chunkAlignment, 1, mFile) != 1)
+        {
+            std::fclose(mFile);
+            mFile = nullptr;
+            return false;
+        }
+        mStats.bytesWritten = sizeof(header) + chunkAlignment - sizeof(header) % chunkAlignment;
+        mStopping = false;
+        mThread = std::thread(&CDatasetWriter::run, this);
+        return true;
+    }
+
+    void CDatasetWriter::close()
+    {
+        if (!mFile)
+        {
+            return;
+        }
+        for (auto& stream : mStreams)
+        {
+            stream->flush();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mQueueChanged.notify_all();
+        mThread.join();
+        std::fclose(mFile);
+        mFile = nullptr;
+    }
+
+    CDatasetStream& CDatasetWriter::createStream()
+    {
+        mStreams.push_back(std::make_unique<CDatasetStream>(*this));
+        return *mStreams.back();
+    }
+
+    const DatasetConfig& CDatasetWriter::getConfig() const
+    {
+        return mConfig;
+    }
+
+    DatasetStats CDatasetWriter::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    bool CDatasetWriter::isCompressionAvailable()
+    {
+#ifdef TETRIS_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //Never waits for the writer thread: when it is that far behind the chunk is dropped instead
+    void CDatasetWriter::submit(std::unique_ptr<DatasetChunk> chunk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mQueue.size() >= mConfig.maxQueuedChunks || !mFile)
+            {
+                ++mStats.droppedChunks;
+                mStats.droppedSamples += chunk->getSamplesCount();
+                chunk->clear();
+                mFreeChunks.push_back(std::move(chunk));
+                return;
+            }
+            mQueue.push_back(std::move(chunk));
+        }
+        mQueueChanged.notify_one();
+    }
+
+    std::unique_ptr<DatasetChunk> CDatasetWriter::takeFreeChunk()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mFreeChunks.empty())
+            {
+                std::unique_ptr<DatasetChunk> chunk = std::move(mFreeChunks.back());
+                mFreeChunks.pop_back();
+                return chunk;
+            }
+        }
+        return std::make_unique<DatasetChunk>();
+    }
+
+    void CDatasetWriter::run()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mQueueChanged.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+            if (mQueue.empty())
+            {
+                return;
+            }
+            std::unique_ptr<DatasetChunk> chunk = std::move(mQueue.front());
+            mQueue.pop_front();
+            lock.unlock();
+
+            const size_t written = writeChunk(*chunk);
+            const uint64_t samples = chunk->getSamplesCount();
+            chunk->clear();
+
+            lock.lock();
+            if (written > 0)
+            {
+                ++mStats.chunks;
+                mStats.samples += samples;
+                mStats.bytesWritten += written;
+            }
+            else
+            {
+                ++mStats.droppedChunks;
+                mStats.droppedSamples += samples;
+            }
+            mFreeChunks.push_back(std::move(chunk));
+        }
+    }
+
+    //Returns the bytes written, 0 when writing failed
+    size_t CDatasetWriter::writeChunk(const DatasetChunk& chunk)
+    {
+        mPayload.clear();
+        appendColumn(mPayload, chunk.outcomes);
+        appendColumn(mPayload, chunk.rows);
+        appendColumn(mPayload, chunk.heights);
+        appendColumn(mPayload, chunk.figures);
+        appendColumn(mPayload, chunk.queues);
+        appendColumn(mPayload, chunk.placements);
+
+        DatasetChunkHeader header{DatasetChunkHeader::mMagic, static_cast<uint32_t>(chunk.getSamplesCount()),
+                                  static_cast<uint32_t>(chunk.rows.size()), 0, static_cast<uint32_t>(mPayload.size()), 0};
+        bool compressed = false;
+#ifdef TETRIS_ZLIB
+        if (mConfig.compress)
+        {
+            uLongf size = compressBound(static_cast<uLong>(mPayload.size()));
+            mCompressed.resize(size);
+            compressed = compress2(mCompressed.data(), &size, mPayload.data(), static_cast<uLong>(mPayload.size()),
+                                   mConfig.compressionLevel) == Z_OK && size < mPayload.size();
+            mCompressed.resize(compressed ? size : 0);
+        }
+#endif
+        const std::vector<uint8_t>& stored = compressed ? mCompressed : mPayload;
+        header.compressed = compressed ? 1 : 0;
+        header.storedSize = static_cast<uint32_t>(stored.size());
+        const uint8_t padding[chunkAlignment] = {};
+        const size_t paddingSize = (chunkAlignment - stored.size() % chunkAlignment) % chunkAlignment;
+        if (std::fwrite(&header, sizeof(header), 1, mFile) != 1 || std::fwrite(stored.data(), 1, stored.size(), mFile) != stored.size() ||
+            std::fwrite(padding, 1, paddingSize, mFile) != paddingSize)
+        {
+            return 0;
+        }
+        return sizeof(header) + stored.size() + paddingSize;
+    }
+}
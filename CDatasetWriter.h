@@ -0,0 +1,146 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CTetris.h"
+
+namespace game
+{
+
+//Training samples, one per bot decision: the field, the figure, the upcoming figures, the chosen
+//placement and the outcome, the lines cleared from that decision until the end of the game.
+//
+//File layout (little endian): "TDS1", uint32 version, uint8 field width, field height, queue size,
+//one reserved byte, then chunks. A chunk is a DatasetChunkHeader and the payload, padded to 8 bytes.
+//The payload holds the columns one after another, the wider types first so each stays aligned:
+//int32 outcomes[samples], uint16 rows[rows count] (the field rows of every sample from its highest
+//filled row to the bottom, one bit per cell), uint8 heights[samples] (rows stored per sample),
+//uint8 figures[samples], uint8 queues[samples * queue size], uint8 placements[samples]
+//(rotation | column << 2). A compressed payload is one zlib stream of the same bytes.
+struct DatasetChunkHeader
+{
+    static const uint32_t mMagic = 0x4b484354; //"TCHK"
+
+    uint32_t magic;
+    uint32_t samplesCount;
+    uint32_t rowsCount;
+    uint32_t compressed;
+    uint32_t payloadSize;
+    uint32_t storedSize;
+};
+
+struct DatasetConfig
+{
+    std::string path;
+    int fieldWidth = 10;
+    int fieldHeight = 20;
+    int queueSize = 5; //Upcoming figures stored per sample, whether or not the game showed them
+    size_t chunkSamples = 1 << 16; //A stream hands its chunk over after the game which fills it
+    size_t maxQueuedChunks = 64; //Chunks waiting for the writer thread, more are dropped
+    bool compress = false; //Only with a build which has zlib (-DUSE_ZLIB=ON)
+    int compressionLevel = 1;
+};
+
+struct DatasetStats
+{
+    uint64_t samples;
+    uint64_t chunks;
+    uint64_t bytesWritten;
+    uint64_t droppedChunks;
+    uint64_t droppedSamples;
+};
+
+class CDatasetWriter;
+
+//Columns of samples being collected by one stream
+struct DatasetChunk
+{
+    std::vector<int32_t> outcomes;
+    std::vector<uint16_t> rows;
+    std::vector<uint8_t> heights;
+    std::vector<uint8_t> figures;
+    std::vector<uint8_t> queues;
+    std::vector<uint8_t> placements;
+
+    void clear();
+    size_t getSamplesCount() const;
+};
+
+//Collects the samples of one thread. The games are kept whole in a chunk, the outcomes
+//of a game are known when it ends. A full chunk is handed to the writer thread.
+class CDatasetStream
+{
+public:
+    explicit CDatasetStream(CDatasetWriter& writer);
+
+    //Before the placement is made. False for a game of other field size than the dataset's.
+    bool addDecision(const CTetris& game, const Placement& placement);
+    void endGame(const CTetris& game);
+    //Hands over the finished games, the caller must not use the stream concurrently
+    void flush();
+
+    CDatasetStream(const CDatasetStream& other) = delete;
+    CDatasetStream& operator=(const CDatasetStream& other) = delete;
+
+private:
+    CDatasetWriter& mWriter;
+    std::unique_ptr<DatasetChunk> mChunk;
+    size_t mGameStart;
+};
+
+//Writes the chunks of all streams to one file from a background thread, which also
+//compresses them. Chunk buffers go back to a pool, so the streams reuse their capacity
+//and a simulation thread only takes a mutex for a pointer swap when its chunk is full.
+class CDatasetWriter
+{
+public:
+    explicit CDatasetWriter(const DatasetConfig& config);
+    ~CDatasetWriter();
+
+    bool open();
+    //Flushes the streams, writes everything queued and closes the file.
+    //The streams must not be in use anymore.
+    void close();
+    //Owned by the writer, one per simulation thread
+    CDatasetStream& createStream();
+    const DatasetConfig& getConfig() const;
+    DatasetStats getStats() const;
+
+    static bool isCompressionAvailable();
+
+    CDatasetWriter(const CDatasetWriter& other) = delete;
+    CDatasetWriter& operator=(const CDatasetWriter& other) = delete;
+
+private:
+    friend class CDatasetStream;
+
+    void submit(std::unique_ptr<DatasetChunk> chunk);
+    std::unique_ptr<DatasetChunk> takeFreeChunk();
+    void run();
+    size_t writeChunk(const DatasetChunk& chunk);
+
+private:
+    DatasetConfig mConfig;
+    std::FILE* mFile;
+    std::thread mThread;
+    std::vector<std::unique_ptr<CDatasetStream>> mStreams;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<std::unique_ptr<DatasetChunk>> mQueue;
+    std::vector<std::unique_ptr<DatasetChunk>> mFreeChunks;
+    bool mStopping;
+    DatasetStats mStats;
+
+    //Used by the writer thread only
+    std::vector<uint8_t> mPayload;
+    std::vector<uint8_t> mCompressed;
+};
+
+}
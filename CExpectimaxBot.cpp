@@ -0,0 +1,251 @@
+#include "CExpectimaxBot.h"
+#include "CTracer.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace game
+{
+    namespace
+    {
+        const float topOutValue = -1.0e9f;
+        const int memoShardsCount = 16;
+        const int clockCheckInterval = 1024;
+
+        struct MemoShard
+        {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, float> values;
+        };
+
+        uint64_t hashBoard(const CBitBoard& board, int depth, unsigned bag)
+        {
+            //FNV-1a over the rows, mixed with the rest of the chance node state
+            uint64_t hash = 14695981039346656037ull;
+            for (int i = 0; i < board.getHeight(); ++i)
+            {
+                hash = (hash ^ board.getRow(i)) * 1099511628211ull;
+            }
+            hash = (hash ^ static_cast<uint64_t>(depth)) * 1099511628211ull;
+            hash = (hash ^ static_cast<uint64_t>(bag)) * 1099511628211ull;
+            return hash;
+        }
+    }
+
+    struct CExpectimaxBot::Search
+    {
+        int figures[CTetris::mMaxPreviewSize + 1];
+        int knownCount;
+        bool bagGenerator;
+        bool timed;
+        std::chrono::steady_clock::time_point deadline;
+        std::atomic<bool> aborted{false};
+        std::atomic<int> nodes{0};
+        std::atomic<int> freeThreads{0};
+        std::array<MemoShard, memoShardsCount> memo;
+
+        bool isAborted()
+        {
+            if (timed && nodes.fetch_add(1, std::memory_order_relaxed) % clockCheckInterval == 0 &&
+                std::chrono::steady_clock::now() > deadline)
+            {
+                aborted = true;
+            }
+            return aborted.load(std::memory_order_relaxed);
+        }
+    };
+
+    CExpectimaxBot::CExpectimaxBot()
+    : CExpectimaxBot(ExpectimaxConfig(), CHeuristicBot::getDefaultWeights())
+    {
+    }
+
+    CExpectimaxBot::CExpectimaxBot(const ExpectimaxConfig& config, const THeuristicWeights& weights)
+    : mConfig(config)
+    , mEvaluator(weights)
+    , mLastDepth(0)
+    {
+    }
+
+    Placement CExpectimaxBot::findPlacement(const CTetris& game) const
+    {
+        TETRIS_TRACE_SCOPE("expectimax search");
+        Search search;
+        search.figures[0] = game.getCurrentFigureId();
+        search.knownCount = 1 + game.getPreviewSize();
+        for (int i = 1; i < search.knownCount; ++i)
+        {
+            search.figures[i] = game.getPreviewFigureId(i - 1);
+        }
+        search.bagGenerator = game.getFigureGenerator() == EFigureGenerator::GENERATOR_BAG;
+        search.timed = mConfig.timeBudgetMs > 0;
+        search.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mConfig.timeBudgetMs);
+        const unsigned bag = game.getRemainingFigures();
+        const float linesWeight = mEvaluator.getWeights()[1];
+
+        Placement best{0, game.getCurrentFigure()[1].x};
+        CBitBoard board;
+        if (!board.load(game.getField()))
+        {
+            return best;
+        }
+        Placement placements[CBitBoard::mMaxPlacements];
+        const int count = board.getPlacements(search.figures[0], placements);
+
+        mLastDepth = 0;
+        for (int depth = 1; depth <= mConfig.maxDepth; ++depth)
+        {
+            TETRIS_TRACE_SCOPE("expectimax depth");
+            search.freeThreads = mConfig.parallelThreads;
+            Placement iterationBest = best;
+            float bestValue = -std::numeric_limits<float>::infinity();
+            for (int i = 0; i < count && !search.aborted; ++i)
+            {
+                CBitBoard child = board;
+                int lines = child.place(search.figures[0], placements[i]);
+                float value = topOutValue;
+                if (!child.isToppedOut())
+                {
+                    value = linesWeight * lines + (depth == 1
+                        ? mEvaluator.evaluate(child, 0)
+                        : searchNext(search, child, 1, depth - 1, bag));
+                }
+                if (value > bestValue)
+                {
+                    bestValue = value;
+                    iterationBest = placements[i];
+                }
+            }
+
+            //The result of an interrupted iteration is incomplete, the previous depth is used then
+            if (search.aborted && depth > 1)
+            {
+                break;
+            }
+            best = iterationBest;
+            mLastDepth = depth;
+        }
+        return best;
+    }
+
+    int CExpectimaxBot::getLastDepth() const
+    {
+        return mLastDepth;
+    }
+
+    float CExpectimaxBot::searchNext(Search& search, const CBitBoard& board, int index, int depth, unsigned bag) const
+    {
+        if (index < search.knownCount)
+        {
+            return searchFigure(search, board, search.figures[index], index + 1, depth, bag);
+        }
+        return searchChance(search, board, index, depth, bag);
+    }
+
+    float CExpectimaxBot::searchFigure(Search& search, const CBitBoard& board, int figure, int next, int depth, unsigned bag) const
+    {
+        if (search.isAborted())
+        {
+            return 0.0f;
+        }
+
+        const float linesWeight = mEvaluator.getWeights()[1];
+        Placement placements[CBitBoard::mMaxPlacements];
+        const int count = board.getPlacements(figure, placements);
+
+        float best = topOutValue;
+        for (int i = 0; i < count; ++i)
+        {
+            CBitBoard child = board;
+            int lines = child.place(figure, placements[i]);
+            if (child.isToppedOut())
+            {
+                continue;
+            }
+
+            float value = linesWeight * lines + (depth == 1
+                ? mEvaluator.evaluate(child, 0)
+                : searchNext(search, child, next, depth - 1, bag));
+            if (value > best)
+            {
+                best = value;
+            }
+        }
+        return best;
+    }
+
+    float CExpectimaxBot::searchChance(Search& search, const CBitBoard& board, int index, int depth, unsigned bag) const
+    {
+        const uint64_t key = hashBoard(board, depth, bag);
+        MemoShard& shard = search.memo[key % memoShardsCount];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.values.find(key);
+            if (it != shard.values.end())
+            {
+                return it->second;
+            }
+        }
+
+        auto branch = [this, &search, &board, index, depth, bag](int figure) {
+            unsigned nextBag = CTetris::mAllFigures;
+            if (search.bagGenerator && (bag & ~(1u << figure)) != 0)
+            {
+                nextBag = bag & ~(1u << figure);
+            }
+            return searchFigure(search, board, figure, index + 1, depth, nextBag);
+        };
+
+        //Only deep branches are worth a thread of their own, shallow ones are computed in place
+        std::vector<std::future<float>> futures;
+        float total = 0.0f;
+        int count = 0;
+        for (int figure = 0; figure < CTetris::mFiguresCount; ++figure)
+        {
+            if (!((bag >> figure) & 1))
+            {
+                continue;
+            }
+            ++count;
+            bool parallel = false;
+            if (depth >= 2)
+            {
+                parallel = search.freeThreads.fetch_sub(1) > 0;
+                if (!parallel)
+                {
+                    ++search.freeThreads;
+                }
+            }
+
+            if (parallel)
+            {
+                futures.push_back(std::async(std::launch::async, [&search, &branch, figure]() {
+                    float value = branch(figure);
+                    ++search.freeThreads;
+                    return value;
+                }));
+            }
+            else
+            {
+                total += branch(figure);
+            }
+        }
+        for (auto& future : futures)
+        {
+            total += future.get();
+        }
+
+        const float value = total / count;
+        if (!search.aborted)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.values.emplace(key, value);
+        }
+        return value;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include "CHeuristicBot.h"
+
+namespace game
+{
+
+struct ExpectimaxConfig
+{
+    int maxDepth = 3;
+    //0 means no time limit, the search always reaches maxDepth
+    int timeBudgetMs = 0;
+    //Chance branches are evaluated on up to this many extra threads
+    int parallelThreads = 0;
+};
+
+//Searches over the current figure, the visible previews and then averages over
+//the figures which can follow them. Deepens iteratively while the time budget lasts.
+class CExpectimaxBot
+{
+public:
+    CExpectimaxBot();
+    CExpectimaxBot(const ExpectimaxConfig& config, const THeuristicWeights& weights);
+
+    Placement findPlacement(const CTetris& game) const;
+    int getLastDepth() const;
+
+private:
+    struct Search;
+
+    float searchFigure(Search& search, const CBitBoard& board, int figure, int next, int depth, unsigned bag) const;
+    float searchNext(Search& search, const CBitBoard& board, int index, int depth, unsigned bag) const;
+    float searchChance(Search& search, const CBitBoard& board, int index, int depth, unsigned bag) const;
+
+private:
+    ExpectimaxConfig mConfig;
+    CHeuristicBot mEvaluator;
+    mutable std::atomic<int> mLastDepth;
+};
+
+}
@@ -0,0 +1,140 @@
+#include "CFrameProfiler.h"
+#include <algorithm>
+
+namespace game
+{
+    CFrameProfiler::CFrameProfiler()
+    : mEnabled(false)
+    {
+        for (auto& ring : mRings)
+        {
+            for (auto& sample : ring.samples)
+            {
+                sample.store(0, std::memory_order_relaxed);
+            }
+            ring.count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void CFrameProfiler::setEnabled(bool enabled)
+    {
+        mEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool CFrameProfiler::isEnabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    void CFrameProfiler::record(EFramePhase phase, std::chrono::steady_clock::duration duration)
+    {
+        Ring& ring = mRings[static_cast<int>(phase)];
+        //Nanoseconds, a tick takes well under a microsecond. Longer than 4 s saturates.
+        const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        const uint32_t sample = nanos < 0 ? 0 : static_cast<uint32_t>(std::min<int64_t>(nanos, UINT32_MAX));
+        const size_t index = ring.count.load(std::memory_order_relaxed);
+        ring.samples[index % mRingSize].store(sample, std::memory_order_relaxed);
+        ring.count.store(index + 1, std::memory_order_release);
+    }
+
+    PhaseSummary CFrameProfiler::getSummary(EFramePhase phase) const
+    {
+        const Ring& ring = mRings[static_cast<int>(phase)];
+        const size_t written = ring.count.load(std::memory_order_acquire);
+        const size_t count = written < mRingSize ? written : mRingSize;
+
+        std::array<uint32_t, mRingSize> samples;
+        for (size_t i = 0; i < count; ++i)
+        {
+            samples[i] = ring.samples[i].load(std::memory_order_relaxed);
+        }
+
+        PhaseSummary summary{0.0f, 0.0f, 0.0f, 0.0f, static_cast<int>(count)};
+        if (count == 0)
+        {
+            return summary;
+        }
+
+        std::sort(samples.begin(), samples.begin() + count);
+        auto percentile = [&samples, count](size_t percent) {
+            return samples[(count - 1) * percent / 100] / 1000.0f;
+        };
+        summary.p50 = percentile(50);
+        summary.p95 = percentile(95);
+        summary.p99 = percentile(99);
+        summary.max = samples[count - 1] / 1000.0f;
+        return summary;
+    }
+
+    bool CFrameProfiler::openCsv(const std::string& path)
+    {
+        std::ifstream existing(path);
+        const bool writeHeader = !existing.good();
+        existing.close();
+
+        mCsvFile.close();
+        mCsvFile.clear();
+        mCsvFile.open(path, std::ios::app);
+        if (writeHeader)
+        {
+            mCsvFile << "time,phase,samples,p50_us,p95_us,p99_us,max_us\n";
+        }
+        return mCsvFile.flush().good();
+    }
+
+    bool CFrameProfiler::appendCsv(double time)
+    {
+        if (!mCsvFile.is_open())
+        {
+            return false;
+        }
+        for (int i = 0; i < mPhasesCount; ++i)
+        {
+            const EFramePhase phase = static_cast<EFramePhase>(i);
+            const PhaseSummary summary = getSummary(phase);
+            mCsvFile << time << ',' << getPhaseName(phase) << ',' << summary.samples << ','
+                     << summary.p50 << ',' << summary.p95 << ',' << summary.p99 << ',' << summary.max << '\n';
+        }
+        //Flushed every time, so the rows are there even when the game is killed
+        return mCsvFile.flush().good();
+    }
+
+    const char* CFrameProfiler::getPhaseName(EFramePhase phase)
+    {
+        switch (phase)
+        {
+            case EFramePhase::PHASE_INPUT:
+                return "input";
+
+            case EFramePhase::PHASE_UPDATE:
+                return "update";
+
+            case EFramePhase::PHASE_RENDER:
+                return "render";
+
+            case EFramePhase::PHASE_DISPLAY:
+                return "display";
+
+            default:
+                return "unknown";
+        }
+    }
+
+    CProfileScope::CProfileScope(CFrameProfiler* profiler, EFramePhase phase)
+    : mProfiler(profiler && profiler->isEnabled() ? profiler : nullptr)
+    , mPhase(phase)
+    {
+        if (mProfiler)
+        {
+            mStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    CProfileScope::~CProfileScope()
+    {
+        if (mProfiler)
+        {
+            mProfiler->record(mPhase, std::chrono::steady_clock::now() - mStart);
+        }
+    }
+}
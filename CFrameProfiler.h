@@ -0,0 +1,82 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace game
+{
+
+enum class EFramePhase
+{
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_RENDER,
+    PHASE_DISPLAY,
+    PHASES_COUNT
+};
+
+//Microseconds, with the fraction
+struct PhaseSummary
+{
+    float p50;
+    float p95;
+    float p99;
+    float max;
+    int samples;
+};
+
+//Keeps the last durations of every frame phase (in nanoseconds) in fixed lock-free rings.
+//Each phase has one writer thread, summaries can be taken from any thread.
+//When disabled, scopes don't even read the clock.
+class CFrameProfiler
+{
+public:
+    static const size_t mRingSize = 1024;
+    static const int mPhasesCount = static_cast<int>(EFramePhase::PHASES_COUNT);
+
+    CFrameProfiler();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void record(EFramePhase phase, std::chrono::steady_clock::duration duration);
+    PhaseSummary getSummary(EFramePhase phase) const;
+    //The csv file stays open, so appending the summaries later doesn't touch the heap
+    bool openCsv(const std::string& path);
+    bool appendCsv(double time);
+
+    static const char* getPhaseName(EFramePhase phase);
+
+    CFrameProfiler(const CFrameProfiler& other) = delete;
+    CFrameProfiler& operator=(const CFrameProfiler& other) = delete;
+
+private:
+    struct Ring
+    {
+        std::array<std::atomic<uint32_t>, mRingSize> samples;
+        std::atomic<size_t> count;
+    };
+
+    std::array<Ring, mPhasesCount> mRings;
+    std::atomic<bool> mEnabled;
+    std::ofstream mCsvFile;
+};
+
+class CProfileScope
+{
+public:
+    CProfileScope(CFrameProfiler* profiler, EFramePhase phase);
+    ~CProfileScope();
+
+    CProfileScope(const CProfileScope& other) = delete;
+    CProfileScope& operator=(const CProfileScope& other) = delete;
+
+private:
+    CFrameProfiler* mProfiler;
+    EFramePhase mPhase;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+}
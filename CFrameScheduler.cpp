@@ -0,0 +1,62 @@
+#include "CFrameScheduler.h"
+#include <thread>
+
+namespace game
+{
+    namespace
+    {
+        //Sleep wakes up late by up to a scheduler quantum, the rest of the wait is spun
+        const auto spinTime = std::chrono::microseconds(2000);
+    }
+
+    CFrameScheduler::CFrameScheduler(int frameRate)
+    : mFramesCount(0)
+    , mMissedFramesCount(0)
+    {
+        setFrameRate(frameRate);
+        reset();
+    }
+
+    void CFrameScheduler::setFrameRate(int frameRate)
+    {
+        mFrameTime = std::chrono::duration_cast<TClock::duration>(std::chrono::duration<double>(1.0 / frameRate));
+    }
+
+    void CFrameScheduler::waitForNextFrame()
+    {
+        ++mFramesCount;
+        const auto now = TClock::now();
+        if (now > mNextFrame)
+        {
+            //The frame took too long, start the next one right away and keep the rate from here
+            ++mMissedFramesCount;
+            mNextFrame = now + mFrameTime;
+            return;
+        }
+
+        if (mNextFrame - now > spinTime)
+        {
+            std::this_thread::sleep_for(mNextFrame - now - spinTime);
+        }
+        while (TClock::now() < mNextFrame)
+        {
+            std::this_thread::yield();
+        }
+        mNextFrame += mFrameTime;
+    }
+
+    void CFrameScheduler::reset()
+    {
+        mNextFrame = TClock::now() + mFrameTime;
+    }
+
+    int CFrameScheduler::getFramesCount() const
+    {
+        return mFramesCount;
+    }
+
+    int CFrameScheduler::getMissedFramesCount() const
+    {
+        return mMissedFramesCount;
+    }
+}
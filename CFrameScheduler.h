@@ -0,0 +1,29 @@
+#pragma once
+#include <chrono>
+
+namespace game
+{
+
+//Paces a loop to a fixed rate: sleeps most of the frame, then spins the last
+//couple of milliseconds to hit the deadline precisely. Late frames are counted.
+class CFrameScheduler
+{
+public:
+    explicit CFrameScheduler(int frameRate);
+
+    void setFrameRate(int frameRate);
+    void waitForNextFrame();
+    void reset();
+    int getFramesCount() const;
+    int getMissedFramesCount() const;
+
+private:
+    using TClock = std::chrono::steady_clock;
+
+    TClock::duration mFrameTime;
+    TClock::time_point mNextFrame;
+    int mFramesCount;
+    int mMissedFramesCount;
+};
+
+}
@@ -0,0 +1,91 @@
+#include "CGameServer.h"
+#include <algorithm>
+
+namespace game
+{
+    CGameServer::CGameServer(const ServerConfig& config)
+    : mConfig(config)
+    , mLeaderboard(LeaderboardConfig{config.leaderboardPath})
+    {
+        if (mConfig.threadsCount == 0)
+        {
+            mConfig.threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    bool CGameServer::start()
+    {
+        if (!mLeaderboard.open())
+        {
+            return false;
+        }
+        //All listeners are bound before any thread starts, so a taken port fails the whole start
+        for (unsigned i = 0; i < mConfig.threadsCount; ++i)
+        {
+            mShards.push_back(std::make_unique<CServerShard>(mConfig, i));
+            if (!mShards.back()->open())
+            {
+                mShards.clear();
+                return false;
+            }
+        }
+        std::vector<CServerShard*> shards;
+        for (auto& shard : mShards)
+        {
+            shards.push_back(shard.get());
+        }
+        for (auto& shard : mShards)
+        {
+            shard->setShards(shards);
+            shard->setLeaderboard(&mLeaderboard);
+            shard->start();
+        }
+        return true;
+    }
+
+    void CGameServer::stop()
+    {
+        for (auto& shard : mShards)
+        {
+            shard->stop();
+        }
+        mLeaderboard.close();
+    }
+
+    bool CGameServer::flushLeaderboard()
+    {
+        return mLeaderboard.flush();
+    }
+
+    ShardStats CGameServer::getStats() const
+    {
+        ShardStats total{};
+        for (const auto& shard : mShards)
+        {
+            const ShardStats stats = shard->getStats();
+            total.sessions += stats.sessions;
+            total.ticks += stats.ticks;
+            total.lateTicks += stats.lateTicks;
+            total.maxTickMicros = std::max(total.maxTickMicros, stats.maxTickMicros);
+            total.inputs += stats.inputs;
+            total.states += stats.states;
+            total.bytesSent += stats.bytesSent;
+            total.errors += stats.errors;
+            total.spectators += stats.spectators;
+            total.broadcasts += stats.broadcasts;
+            total.skippedFrames += stats.skippedFrames;
+            total.sessionUpdates += stats.sessionUpdates;
+        }
+        return total;
+    }
+
+    unsigned CGameServer::getThreadsCount() const
+    {
+        return mConfig.threadsCount;
+    }
+
+    const CLeaderboard& CGameServer::getLeaderboard() const
+    {
+        return mLeaderboard;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "CServerShard.h"
+
+namespace game
+{
+
+//Authoritative game server: sessions are spread over shards, one thread each.
+//The leaderboard is shared by the shards, it is read from its log on start
+//and written by flushLeaderboard() on the owner's thread, never by a shard.
+class CGameServer
+{
+public:
+    explicit CGameServer(const ServerConfig& config);
+
+    bool start();
+    void stop();
+    //Call it every 100 ms or so, the writes are batched by the leaderboard config
+    bool flushLeaderboard();
+    ShardStats getStats() const;
+    unsigned getThreadsCount() const;
+    const CLeaderboard& getLeaderboard() const;
+
+private:
+    ServerConfig mConfig;
+    CLeaderboard mLeaderboard;
+    std::vector<std::unique_ptr<CServerShard>> mShards;
+};
+
+}
@@ -0,0 +1,86 @@
+#include "CHeuristicBot.h"
+#include <cstdlib>
+#include <limits>
+
+namespace game
+{
+    CHeuristicBot::CHeuristicBot()
+    : CHeuristicBot(getDefaultWeights())
+    {
+    }
+
+    CHeuristicBot::CHeuristicBot(const THeuristicWeights& weights)
+    : mWeights(weights)
+    {
+    }
+
+    Placement CHeuristicBot::findPlacement(const CTetris& game) const
+    {
+        //A field too large for the bit board keeps the figure where it is
+        CBitBoard board;
+        if (!board.load(game.getField()))
+        {
+            return Placement{0, game.getCurrentFigure()[1].x};
+        }
+        return findPlacement(board, game.getCurrentFigureId());
+    }
+
+    Placement CHeuristicBot::findPlacement(const CBitBoard& board, int figure) const
+    {
+        Placement placements[CBitBoard::mMaxPlacements];
+        int count = board.getPlacements(figure, placements);
+
+        Placement best{0, CBitBoard::getSpawnPivot(figure, board.getWidth()).x};
+        float bestScore = -std::numeric_limits<float>::infinity();
+        for (int i = 0; i < count; ++i)
+        {
+            CBitBoard next = board;
+            int lines = next.place(figure, placements[i]);
+            float score = next.isToppedOut() ? -std::numeric_limits<float>::max() : evaluate(next, lines);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = placements[i];
+            }
+        }
+        return best;
+    }
+
+    float CHeuristicBot::evaluate(const CBitBoard& board, int lines) const
+    {
+        int heights[CBitBoard::mMaxWidth];
+        board.getColumnHeights(heights);
+
+        int aggregateHeight = 0;
+        int bumpiness = 0;
+        for (int j = 0; j < board.getWidth(); ++j)
+        {
+            aggregateHeight += heights[j];
+            if (j > 0)
+            {
+                bumpiness += std::abs(heights[j] - heights[j - 1]);
+            }
+        }
+
+        return mWeights[0] * aggregateHeight
+             + mWeights[1] * lines
+             + mWeights[2] * board.getHolesCount()
+             + mWeights[3] * bumpiness;
+    }
+
+    void CHeuristicBot::setWeights(const THeuristicWeights& weights)
+    {
+        mWeights = weights;
+    }
+
+    const THeuristicWeights& CHeuristicBot::getWeights() const
+    {
+        return mWeights;
+    }
+
+    const THeuristicWeights& CHeuristicBot::getDefaultWeights()
+    {
+        static const THeuristicWeights weights = {-0.510066f, 0.760666f, -0.35663f, -0.184483f};
+        return weights;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include "CBitBoard.h"
+
+namespace game
+{
+
+//Weights of the board features, in the order: aggregate height, cleared lines, holes, bumpiness
+using THeuristicWeights = std::array<float, 4>;
+
+class CHeuristicBot
+{
+public:
+    static const int mFeaturesCount = 4;
+
+    CHeuristicBot();
+    explicit CHeuristicBot(const THeuristicWeights& weights);
+
+    Placement findPlacement(const CTetris& game) const;
+    Placement findPlacement(const CBitBoard& board, int figure) const;
+    float evaluate(const CBitBoard& board, int lines) const;
+    void setWeights(const THeuristicWeights& weights);
+    const THeuristicWeights& getWeights() const;
+
+    static const THeuristicWeights& getDefaultWeights();
+
+private:
+    THeuristicWeights mWeights;
+};
+
+}
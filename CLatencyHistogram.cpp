@@ -0,0 +1,100 @@
+#include "CLatencyHistogram.h"
+
+namespace game
+{
+    CLatencyHistogram::CLatencyHistogram()
+    {
+        clear();
+    }
+
+    int CLatencyHistogram::getBucket(uint64_t micros)
+    {
+        if (micros < mSubCount)
+        {
+            return static_cast<int>(micros);
+        }
+        //The highest bit selects the power of two, the next bits the linear step inside it
+        int exponent = 63;
+        while (!((micros >> exponent) & 1))
+        {
+            --exponent;
+        }
+        const int sub = static_cast<int>((micros >> (exponent - mSubBits)) & (mSubCount - 1));
+        return mSubCount + (exponent - mSubBits) * mSubCount + sub;
+    }
+
+    uint64_t CLatencyHistogram::getBucketEnd(int bucket)
+    {
+        if (bucket < mSubCount)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        const int exponent = (bucket - mSubCount) / mSubCount + mSubBits;
+        const uint64_t sub = static_cast<uint64_t>((bucket - mSubCount) % mSubCount);
+        const uint64_t step = uint64_t(1) << (exponent - mSubBits);
+        return (uint64_t(1) << exponent) + (sub + 1) * step - 1;
+    }
+
+    void CLatencyHistogram::record(uint64_t micros)
+    {
+        ++mBuckets[getBucket(micros)];
+        ++mCount;
+        mSum += micros;
+        mMax = micros > mMax ? micros : mMax;
+    }
+
+    void CLatencyHistogram::add(const CLatencyHistogram& other)
+    {
+        for (int i = 0; i < mBucketsCount; ++i)
+        {
+            mBuckets[i] += other.mBuckets[i];
+        }
+        mCount += other.mCount;
+        mSum += other.mSum;
+        mMax = other.mMax > mMax ? other.mMax : mMax;
+    }
+
+    void CLatencyHistogram::clear()
+    {
+        mBuckets.fill(0);
+        mCount = 0;
+        mMax = 0;
+        mSum = 0;
+    }
+
+    uint64_t CLatencyHistogram::getCount() const
+    {
+        return mCount;
+    }
+
+    uint64_t CLatencyHistogram::getMax() const
+    {
+        return mMax;
+    }
+
+    double CLatencyHistogram::getMean() const
+    {
+        return mCount > 0 ? static_cast<double>(mSum) / mCount : 0.0;
+    }
+
+    uint64_t CLatencyHistogram::getPercentile(double percentile) const
+    {
+        if (mCount == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * mCount + 0.5);
+        rank = rank < 1 ? 1 : (rank > mCount ? mCount : rank);
+        uint64_t seen = 0;
+        for (int i = 0; i < mBucketsCount; ++i)
+        {
+            seen += mBuckets[i];
+            if (seen >= rank)
+            {
+                const uint64_t end = getBucketEnd(i);
+                return end < mMax ? end : mMax;
+            }
+        }
+        return mMax;
+    }
+}
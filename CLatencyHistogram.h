@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+namespace game
+{
+
+//Log-linear histogram of durations in microseconds: 16 buckets per power of two, so every
+//percentile is within about 6% of the real value. Recording is a few integer operations.
+class CLatencyHistogram
+{
+public:
+    static const int mSubBits = 4;
+    static const int mSubCount = 1 << mSubBits;
+    static const int mBucketsCount = mSubCount * (64 - mSubBits + 1);
+
+    CLatencyHistogram();
+
+    void record(uint64_t micros);
+    void add(const CLatencyHistogram& other);
+    void clear();
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    double getMean() const;
+    //Upper bound of the bucket holding the percentile, 0 when there are no values
+    uint64_t getPercentile(double percentile) const;
+
+private:
+    static int getBucket(uint64_t micros);
+    static uint64_t getBucketEnd(int bucket);
+
+private:
+    std::array<uint64_t, mBucketsCount> mBuckets;
+    uint64_t mCount;
+    uint64_t mMax;
+    uint64_t mSum;
+};
+
+}
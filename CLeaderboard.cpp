@@ -0,0 +1,479 @@
+#include "CLeaderboard.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace game
+{
+    namespace
+    {
+        const char logMagic[4] = {'T', 'L', 'B', '1'};
+        const uint32_t logVersion = 1;
+        const size_t headerSize = 8;
+        const size_t readChunkSize = 1 << 20;
+
+        int64_t getMillis()
+        {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        void putUint32(uint8_t* data, uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                data[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        uint32_t getUint32(const uint8_t* data)
+        {
+            return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+        }
+
+        //FNV-1a, enough to tell a torn or garbled record
+        uint32_t getChecksum(const uint8_t* data, size_t size)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash = (hash ^ data[i]) * 16777619u;
+            }
+            return hash;
+        }
+
+        bool writeAll(int fd, const uint8_t* data, size_t size)
+        {
+            while (size > 0)
+            {
+                const ssize_t written = write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+        void writeHeader(uint8_t* header)
+        {
+            std::memcpy(header, logMagic, sizeof(logMagic));
+            putUint32(header + 4, logVersion);
+        }
+
+        //Sorted without duplicates and cut to the capacity. A record can be logged twice
+        //when it was accepted while the log was compacted, both copies have the same sequence.
+        template <typename TBetter>
+        void keepTop(std::vector<ScoreEntry>& entries, size_t capacity, TBetter isBetter)
+        {
+            std::sort(entries.begin(), entries.end(), isBetter);
+            auto last = std::unique(entries.begin(), entries.end(), [](const ScoreEntry& first, const ScoreEntry& second) {
+                return first.sequence == second.sequence && first.playerId == second.playerId;
+            });
+            entries.erase(last, entries.end());
+            if (entries.size() > capacity)
+            {
+                entries.resize(capacity);
+            }
+        }
+    }
+
+    CLeaderboard::CLeaderboard(const LeaderboardConfig& config)
+    : mConfig(config)
+    , mNextSequence(0)
+    , mLog(-1)
+    , mBufferedSince(0)
+    , mLogRecords(0)
+    , mCorruptRecords(0)
+    {
+        mConfig.capacity = std::max<size_t>(1, mConfig.capacity);
+        for (Shard& shard : mShards)
+        {
+            shard.minScores.store(INT64_MIN, std::memory_order_relaxed);
+        }
+    }
+
+    CLeaderboard::~CLeaderboard()
+    {
+        close();
+    }
+
+    bool CLeaderboard::open()
+    {
+        if (mConfig.logPath.empty())
+        {
+            return true;
+        }
+        std::lock_guard<std::mutex> writeLock(mWriteMutex);
+        std::lock_guard<std::mutex> lock(mLogMutex);
+        mLog = ::open(mConfig.logPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (mLog < 0)
+        {
+            return false;
+        }
+        if (!load())
+        {
+            ::close(mLog);
+            mLog = -1;
+            return false;
+        }
+        mBuffer.reserve(mConfig.flushBytes + mRecordSize);
+        mWriteBuffer.reserve(mConfig.flushBytes + mRecordSize);
+        return true;
+    }
+
+    void CLeaderboard::close()
+    {
+        std::lock_guard<std::mutex> writeLock(mWriteMutex);
+        std::lock_guard<std::mutex> lock(mLogMutex);
+        if (mLog < 0)
+        {
+            return;
+        }
+        mWriteBuffer.swap(mBuffer);
+        writeBuffer();
+        fsync(mLog);
+        ::close(mLog);
+        mLog = -1;
+    }
+
+    bool CLeaderboard::isBetter(const ScoreEntry& first, const ScoreEntry& second)
+    {
+        if (first.scores != second.scores)
+        {
+            return first.scores > second.scores;
+        }
+        return first.sequence < second.sequence;
+    }
+
+    bool CLeaderboard::submit(uint64_t playerId, int scores, int lines)
+    {
+        Shard& shard = mShards[playerId % mShardsCount];
+        //Later results lose ties, so an equal result can't get into a full shard either
+        if (scores <= shard.minScores.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        ScoreEntry entry{playerId, scores, lines, 0};
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (scores <= shard.minScores.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+            entry.sequence = mNextSequence.fetch_add(1, std::memory_order_relaxed);
+            insert(entry);
+        }
+
+        std::lock_guard<std::mutex> lock(mLogMutex);
+        if (mLog < 0)
+        {
+            return true;
+        }
+        if (mBuffer.empty())
+        {
+            mBufferedSince = getMillis();
+        }
+        mBuffer.resize(mBuffer.size() + mRecordSize);
+        encodeRecord(entry, mBuffer.data() + mBuffer.size() - mRecordSize);
+        return true;
+    }
+
+    //Called with the shard locked
+    void CLeaderboard::insert(const ScoreEntry& entry)
+    {
+        Shard& shard = mShards[entry.playerId % mShardsCount];
+        std::vector<ScoreEntry>& entries = shard.entries;
+        entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, isBetter), entry);
+        if (entries.size() > mConfig.capacity)
+        {
+            entries.pop_back();
+        }
+        if (entries.size() == mConfig.capacity)
+        {
+            shard.minScores.store(entries.back().scores, std::memory_order_relaxed);
+        }
+    }
+
+    //An entry beyond the top of a full shard is beyond the global top too, so counting the better
+    //entries of all shards is exact while the count stays below the capacity
+    size_t CLeaderboard::getRank(int scores) const
+    {
+        size_t better = 0;
+        for (const Shard& shard : mShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            better += static_cast<size_t>(std::partition_point(shard.entries.begin(), shard.entries.end(),
+                [scores](const ScoreEntry& entry) { return entry.scores > scores; }) - shard.entries.begin());
+        }
+        return better < mConfig.capacity ? better + 1 : 0;
+    }
+
+    std::vector<ScoreEntry> CLeaderboard::getTop(size_t count) const
+    {
+        count = std::min(count, mConfig.capacity);
+        std::vector<ScoreEntry> top;
+        for (const Shard& shard : mShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            top.insert(top.end(), shard.entries.begin(), shard.entries.begin() + std::min(count, shard.entries.size()));
+        }
+        const size_t size = std::min(count, top.size());
+        std::partial_sort(top.begin(), top.begin() + size, top.end(), isBetter);
+        top.resize(size);
+        return top;
+    }
+
+    size_t CLeaderboard::getSize() const
+    {
+        size_t size = 0;
+        for (const Shard& shard : mShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.entries.size();
+        }
+        return std::min(size, mConfig.capacity);
+    }
+
+    bool CLeaderboard::flush()
+    {
+        std::lock_guard<std::mutex> writeLock(mWriteMutex);
+        {
+            std::lock_guard<std::mutex> lock(mLogMutex);
+            if (mLog < 0 || mBuffer.empty() ||
+                (mBuffer.size() < mConfig.flushBytes && getMillis() - mBufferedSince < mConfig.flushMillis))
+            {
+                return true;
+            }
+            mWriteBuffer.swap(mBuffer);
+        }
+        if (!writeBuffer())
+        {
+            return false;
+        }
+
+        size_t entriesCount = 0;
+        for (const Shard& shard : mShards)
+        {
+            std::lock_guard<std::mutex> shardLock(shard.mutex);
+            entriesCount += shard.entries.size();
+        }
+        return mLogRecords <= entriesCount + mConfig.compactionRecords || compact();
+    }
+
+    uint64_t CLeaderboard::getLogRecords() const
+    {
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        return mLogRecords;
+    }
+
+    uint64_t CLeaderboard::getCorruptRecords() const
+    {
+        std::lock_guard<std::mutex> lock(mWriteMutex);
+        return mCorruptRecords;
+    }
+
+    void CLeaderboard::encodeRecord(const ScoreEntry& entry, uint8_t* record)
+    {
+        putUint32(record, static_cast<uint32_t>(entry.playerId));
+        putUint32(record + 4, static_cast<uint32_t>(entry.playerId >> 32));
+        putUint32(record + 8, static_cast<uint32_t>(entry.scores));
+        putUint32(record + 12, static_cast<uint32_t>(entry.lines));
+        putUint32(record + 16, entry.sequence);
+        putUint32(record + 20, getChecksum(record, mRecordSize - 4));
+    }
+
+    bool CLeaderboard::decodeRecord(const uint8_t* record, ScoreEntry& entry)
+    {
+        if (getUint32(record + 20) != getChecksum(record, mRecordSize - 4))
+        {
+            return false;
+        }
+        entry.playerId = getUint32(record) | static_cast<uint64_t>(getUint32(record + 4)) << 32;
+        entry.scores = static_cast<int32_t>(getUint32(record + 8));
+        entry.lines = static_cast<int32_t>(getUint32(record + 12));
+        entry.sequence = getUint32(record + 16);
+        return true;
+    }
+
+    //Reads the log in large chunks. Each shard collects its records and is cut down to the
+    //capacity whenever it grows well past it, so millions of records need little memory.
+    bool CLeaderboard::load()
+    {
+        struct stat info;
+        if (fstat(mLog, &info) != 0)
+        {
+            return false;
+        }
+        const off_t fileSize = info.st_size;
+        if (fileSize < static_cast<off_t>(headerSize))
+        {
+            //A new log, or one torn while its header was written
+            uint8_t header[headerSize];
+            writeHeader(header);
+            return ftruncate(mLog, 0) == 0 && writeAll(mLog, header, headerSize);
+        }
+
+        std::vector<uint8_t> chunk(readChunkSize);
+        if (pread(mLog, chunk.data(), headerSize, 0) != static_cast<ssize_t>(headerSize) ||
+            !std::equal(logMagic, logMagic + sizeof(logMagic), chunk.begin()) || getUint32(chunk.data() + 4) != logVersion)
+        {
+            return false;
+        }
+
+        const size_t cutSize = std::max<size_t>(mConfig.capacity * 8, 1 << 16);
+        std::array<std::vector<ScoreEntry>, mShardsCount> loaded;
+        std::array<int64_t, mShardsCount> cutScores;
+        cutScores.fill(INT64_MIN);
+        uint32_t nextSequence = 0;
+        uint64_t records = 0;
+        uint64_t corruptRecords = 0;
+        uint64_t badRecords = 0;
+        off_t offset = headerSize;
+        off_t validEnd = offset;
+        while (offset + static_cast<off_t>(mRecordSize) <= fileSize)
+        {
+            const size_t wanted = std::min<size_t>(readChunkSize, static_cast<size_t>(fileSize - offset)) / mRecordSize * mRecordSize;
+            const ssize_t received = pread(mLog, chunk.data(), wanted, offset);
+            if (received <= 0)
+            {
+                return false;
+            }
+            const size_t size = static_cast<size_t>(received) / mRecordSize * mRecordSize;
+            for (size_t i = 0; i < size; i += mRecordSize)
+            {
+                ScoreEntry entry;
+                offset += mRecordSize;
+                if (!decodeRecord(chunk.data() + i, entry))
+                {
+                    ++badRecords;
+                    continue;
+                }
+                //Bad records followed by a good one aren't a torn tail, they are skipped
+                corruptRecords += badRecords;
+                badRecords = 0;
+                validEnd = offset;
+                nextSequence = std::max(nextSequence, entry.sequence + 1);
+                ++records;
+
+                //Records below the top kept so far can't get in anymore
+                const size_t shard = entry.playerId % mShardsCount;
+                if (entry.scores < cutScores[shard])
+                {
+                    continue;
+                }
+                std::vector<ScoreEntry>& entries = loaded[shard];
+                entries.push_back(entry);
+                if (entries.size() >= cutSize)
+                {
+                    keepTop(entries, mConfig.capacity, isBetter);
+                    if (entries.size() == mConfig.capacity)
+                    {
+                        cutScores[shard] = entries.back().scores;
+                    }
+                }
+            }
+        }
+        //Everything after the last valid record is what a crash left behind
+        if (validEnd != fileSize && ftruncate(mLog, validEnd) != 0)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < mShardsCount; ++i)
+        {
+            keepTop(loaded[i], mConfig.capacity, isBetter);
+            std::lock_guard<std::mutex> lock(mShards[i].mutex);
+            mShards[i].entries.swap(loaded[i]);
+            mShards[i].entries.reserve(mConfig.capacity + 1);
+            mShards[i].minScores.store(mShards[i].entries.size() == mConfig.capacity ?
+                mShards[i].entries.back().scores : INT64_MIN, std::memory_order_relaxed);
+        }
+        mNextSequence.store(nextSequence, std::memory_order_relaxed);
+        mLogRecords = records;
+        mCorruptRecords = corruptRecords;
+        return true;
+    }
+
+    //Called with mWriteMutex locked
+    bool CLeaderboard::writeBuffer()
+    {
+        if (mWriteBuffer.empty())
+        {
+            return true;
+        }
+        const bool written = writeAll(mLog, mWriteBuffer.data(), mWriteBuffer.size());
+        if (written)
+        {
+            mLogRecords += mWriteBuffer.size() / mRecordSize;
+        }
+        mWriteBuffer.clear();
+        return written;
+    }
+
+    //The new log is complete and synced before it replaces the old one, a crash on
+    //the way leaves one of them whole
+    bool CLeaderboard::compact()
+    {
+        const std::string path = mConfig.logPath + ".tmp";
+        const int log = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (log < 0)
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> data(headerSize);
+        writeHeader(data.data());
+        uint64_t records = 0;
+        for (const Shard& shard : mShards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            data.resize(data.size() + shard.entries.size() * mRecordSize);
+            uint8_t* record = data.data() + data.size() - shard.entries.size() * mRecordSize;
+            for (const ScoreEntry& entry : shard.entries)
+            {
+                encodeRecord(entry, record);
+                record += mRecordSize;
+            }
+            records += shard.entries.size();
+        }
+
+        if (!writeAll(log, data.data(), data.size()) || fsync(log) != 0 || rename(path.c_str(), mConfig.logPath.c_str()) != 0)
+        {
+            ::close(log);
+            unlink(path.c_str());
+            return false;
+        }
+
+        //The rename itself is durable once the directory is synced
+        const size_t slash = mConfig.logPath.find_last_of('/');
+        const std::string directory = slash == std::string::npos ? "." : mConfig.logPath.substr(0, slash + 1);
+        const int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directoryFd >= 0)
+        {
+            fsync(directoryFd);
+            ::close(directoryFd);
+        }
+
+        ::close(mLog);
+        {
+            std::lock_guard<std::mutex> lock(mLogMutex);
+            mLog = log;
+        }
+        mLogRecords = records;
+        return true;
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace game
+{
+
+struct ScoreEntry
+{
+    uint64_t playerId;
+    int32_t scores;
+    int32_t lines;
+    uint32_t sequence; //Submission order, an earlier result ranks first among equal scores
+};
+
+struct LeaderboardConfig
+{
+    std::string logPath;
+    size_t capacity = 10000; //Entries kept, the top of all submissions
+    size_t flushBytes = 64 * 1024; //Buffered log bytes written at once
+    int flushMillis = 1000; //A smaller buffer is written once it is that old
+    size_t compactionRecords = 1 << 16; //The log is rewritten when it holds that many more records than entries
+};
+
+//High score table of the best results of all sessions. Entries are spread over shards by
+//player, each shard keeps its own top and a shard's top contains every global top entry from it.
+//A result below the lowest entry of a full shard is dropped by an atomic check without locking,
+//so once the table fills most submissions cost a load and a compare.
+//
+//Accepted entries are appended to a log: "TLB1", uint32 version, then 24 byte little endian
+//records of player id, scores, lines, sequence and a checksum of the record. A torn record at
+//the end of the log after a crash fails its checksum and is cut off on the next open, a bad record
+//followed by good ones is skipped and counted but the log is kept. When the
+//log outgrows the table it is compacted: the entries are written to a new file which replaces it.
+//A submission only buffers its record, the log is written by flush() on the owner's thread.
+class CLeaderboard
+{
+public:
+    static const size_t mShardsCount = 16;
+
+    explicit CLeaderboard(const LeaderboardConfig& config);
+    ~CLeaderboard();
+
+    //Reads the log and keeps it open for appending, without a log path the table lives in memory
+    bool open();
+    void close();
+    //False when the result doesn't get into the table. Thread safe.
+    bool submit(uint64_t playerId, int scores, int lines);
+    //1 + the number of entries with more scores, 0 when that is beyond the table
+    size_t getRank(int scores) const;
+    std::vector<ScoreEntry> getTop(size_t count) const;
+    size_t getSize() const;
+    //Writes the buffered records once there are flushBytes of them or they are flushMillis old,
+    //and compacts the log if it is due. Submissions go on meanwhile, call it off the game threads.
+    bool flush();
+    uint64_t getLogRecords() const;
+    //Records before the end of the log which failed their checksum on open
+    uint64_t getCorruptRecords() const;
+
+    CLeaderboard(const CLeaderboard& other) = delete;
+    CLeaderboard& operator=(const CLeaderboard& other) = delete;
+
+private:
+    static const size_t mRecordSize = 24;
+
+    //Entries in ranking order, at most capacity of them
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::vector<ScoreEntry> entries;
+        std::atomic<int64_t> minScores; //Lowest entry of a full shard, a lower result can't get in
+    };
+
+    static bool isBetter(const ScoreEntry& first, const ScoreEntry& second);
+    static void encodeRecord(const ScoreEntry& entry, uint8_t* record);
+    static bool decodeRecord(const uint8_t* record, ScoreEntry& entry);
+    void insert(const ScoreEntry& entry);
+    bool load();
+    bool writeBuffer();
+    bool compact();
+
+private:
+    LeaderboardConfig mConfig;
+    std::array<Shard, mShardsCount> mShards;
+    std::atomic<uint32_t> mNextSequence;
+
+    //The submissions buffer under mLogMutex. The writer holds mWriteMutex for the file work and
+    //takes mLogMutex only to swap buffers or replace the file, so a slow write never blocks a submit.
+    mutable std::mutex mLogMutex;
+    mutable std::mutex mWriteMutex;
+    int mLog;
+    std::vector<uint8_t> mBuffer;
+    std::vector<uint8_t> mWriteBuffer;
+    int64_t mBufferedSince;
+    uint64_t mLogRecords;
+    uint64_t mCorruptRecords;
+};
+
+}
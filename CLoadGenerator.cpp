@@ -0,0 +1,816 @@
+#include "CLoadGenerator.h"
+#include "CHeuristicBot.h"
+#include "CServerProtocol.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <random>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace game
+{
+    namespace
+    {
+        const size_t inputCapacity = 8192;
+        const uint32_t pendingInputsCount = 64;
+        const int64_t inputScanMicros = 2000;
+        const int64_t publishMicros = 100000;
+        const int eventsCapacity = 256;
+        const uint32_t stateHistorySize = 256;
+
+        int64_t getMicros()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        //The cells of a figure keep their order through rotations, so the offsets from the pivot name it
+        bool identifyFigure(const Point* cells, int& figure, int& rotation)
+        {
+            for (int f = 0; f < CBitBoard::mFiguresCount; ++f)
+            {
+                for (int r = 0; r < CBitBoard::getRotationsCount(f); ++r)
+                {
+                    const FigureShape& shape = CBitBoard::getShape(f, r);
+                    bool same = true;
+                    for (int i = 0; i < 4 && same; ++i)
+                    {
+                        same = cells[i].x - cells[1].x == shape.cells[i].x && cells[i].y - cells[1].y == shape.cells[i].y;
+                    }
+                    if (same)
+                    {
+                        figure = f;
+                        rotation = r;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        uint32_t hashCells(const BoardState& state)
+        {
+            uint32_t hash = 2166136261u;
+            for (int i = 0; i < state.width * state.height; ++i)
+            {
+                hash = (hash ^ state.cells[i]) * 16777619u;
+            }
+            return hash;
+        }
+
+        uint32_t hashState(const BoardState& state)
+        {
+            uint32_t hash = hashCells(state);
+            auto add = [&hash](uint32_t value) {
+                hash = (hash ^ value) * 16777619u;
+            };
+            add(static_cast<uint32_t>(state.state));
+            add(static_cast<uint32_t>(state.scores));
+            add(static_cast<uint32_t>(state.lines));
+            add(static_cast<uint32_t>(state.figureColor));
+            for (const Point& cell : state.figure)
+            {
+                add(static_cast<uint32_t>(cell.x));
+                add(static_cast<uint32_t>(cell.y));
+            }
+            return hash;
+        }
+    }
+
+    class CLoadGenerator::CWorker
+    {
+    public:
+        CWorker(const LoadConfig& config, int connectionsCount, int connectRate, unsigned seed)
+        : mConfig(config)
+        , mConnectionsCount(connectionsCount)
+        , mConnectRate(connectRate > 0 ? connectRate : 1)
+        , mEpoll(-1)
+        , mRunning(false)
+        , mRandom(seed)
+        , mReplayTickMicros(0.0)
+        , mNextSpectatorMicros(0)
+        , mOpenConnections(0)
+        , mInputs(0)
+        , mStates(0)
+        , mBytesReceived(0)
+        , mConnectErrors(0)
+        , mDisconnects(0)
+        , mProtocolErrors(0)
+        , mResyncs(0)
+        , mOpenSpectators(0)
+        , mSpectatorStates(0)
+        , mSpectatorChecks(0)
+        , mSpectatorMismatches(0)
+        {
+            //A replay keeps its own pace unless an input rate is asked for
+            const CReplay* replay = mConfig.replay;
+            if (replay && replay->getTickRate() > 0)
+            {
+                mReplayTickMicros = 1e6 / replay->getTickRate();
+                const double seconds = replay->getTicksCount() / static_cast<double>(replay->getTickRate());
+                if (mConfig.inputRate > 0.0f && seconds > 0.0 && !replay->getEvents().empty())
+                {
+                    mReplayTickMicros *= replay->getEvents().size() / seconds / mConfig.inputRate;
+                }
+            }
+        }
+
+        ~CWorker()
+        {
+            stop();
+            for (auto& connection : mConnections)
+            {
+                if (!connection->closed)
+                {
+                    close(connection->fd);
+                }
+            }
+            if (mEpoll >= 0)
+            {
+                close(mEpoll);
+            }
+        }
+
+        void start()
+        {
+            mEpoll = epoll_create1(EPOLL_CLOEXEC);
+            if (mEpoll >= 0 && !mRunning.exchange(true))
+            {
+                mThread = std::thread(&CWorker::run, this);
+            }
+        }
+
+        void stop()
+        {
+            if (mRunning.exchange(false))
+            {
+                mThread.join();
+            }
+        }
+
+        void addStats(LoadStats& stats) const
+        {
+            stats.connections += mOpenConnections.load(std::memory_order_relaxed);
+            stats.inputs += mInputs.load(std::memory_order_relaxed);
+            stats.states += mStates.load(std::memory_order_relaxed);
+            stats.bytesReceived += mBytesReceived.load(std::memory_order_relaxed);
+            stats.connectErrors += mConnectErrors.load(std::memory_order_relaxed);
+            stats.disconnects += mDisconnects.load(std::memory_order_relaxed);
+            stats.protocolErrors += mProtocolErrors.load(std::memory_order_relaxed);
+            stats.resyncs += mResyncs.load(std::memory_order_relaxed);
+            stats.spectators += mOpenSpectators.load(std::memory_order_relaxed);
+            stats.spectatorStates += mSpectatorStates.load(std::memory_order_relaxed);
+            stats.spectatorChecks += mSpectatorChecks.load(std::memory_order_relaxed);
+            stats.spectatorMismatches += mSpectatorMismatches.load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(mHistogramsMutex);
+            stats.ackLatency.add(mAckLatency);
+            stats.tickDelay.add(mTickDelay);
+        }
+
+        CWorker(const CWorker& other) = delete;
+        CWorker& operator=(const CWorker& other) = delete;
+
+    private:
+        //A state the player got, found by its tick
+        struct StateRecord
+        {
+            uint32_t tick;
+            uint32_t lastInput;
+            uint32_t hash;
+            bool valid;
+        };
+
+        struct Connection
+        {
+            int fd;
+            bool connecting;
+            bool closed;
+            bool spectator;
+            Connection* player; //The watched game of a spectator
+            uint32_t sessionId;
+            uint8_t input[inputCapacity];
+            size_t inputSize;
+            std::vector<uint8_t> output;
+            size_t outputOffset;
+            bool waitingWritable;
+            int64_t tickMicros;
+            bool hasState;
+            BoardState state;
+            uint32_t sequence;
+            uint32_t acked;
+            std::array<int64_t, pendingInputsCount> sentMicros;
+            int64_t nextInputMicros;
+            int64_t minTickOffset;
+            uint32_t fieldHash;
+            int targetFigure;
+            Placement target;
+            size_t replayEvent;
+            int64_t replayStartMicros;
+            std::array<StateRecord, stateHistorySize> history;
+        };
+
+        void run()
+        {
+            epoll_event events[eventsCapacity];
+            const int64_t started = getMicros();
+            int64_t nextInputScan = started;
+            int64_t nextPublish = started + publishMicros;
+            int opened = 0;
+
+            while (mRunning.load(std::memory_order_relaxed))
+            {
+                //Connections are opened at the configured rate, a burst would overflow the accept backlog
+                const int64_t now = getMicros();
+                const int64_t due = (now - started) * mConnectRate / 1000000 + 1;
+                while (opened < mConnectionsCount && opened < due)
+                {
+                    openConnection(now, nullptr);
+                    ++opened;
+                }
+                //Spectators follow the welcomes of their games at the same rate
+                while (!mPendingSpectators.empty() && mNextSpectatorMicros <= now)
+                {
+                    Connection* player = mPendingSpectators.front();
+                    mPendingSpectators.pop_front();
+                    if (!player->closed)
+                    {
+                        openConnection(now, player);
+                        mNextSpectatorMicros = std::max(mNextSpectatorMicros, now - 1000) + 1000000 / mConnectRate;
+                    }
+                }
+
+                const int count = epoll_wait(mEpoll, events, eventsCapacity, 1);
+                for (int i = 0; i < count; ++i)
+                {
+                    Connection& connection = *static_cast<Connection*>(events[i].data.ptr);
+                    if (connection.closed)
+                    {
+                        continue;
+                    }
+                    if (connection.connecting)
+                    {
+                        finishConnect(connection);
+                        continue;
+                    }
+                    if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    {
+                        mDisconnects.fetch_add(1, std::memory_order_relaxed);
+                        closeConnection(connection);
+                        continue;
+                    }
+                    if (events[i].events & EPOLLIN)
+                    {
+                        readConnection(connection);
+                    }
+                    if ((events[i].events & EPOLLOUT) && !connection.closed)
+                    {
+                        flushConnection(connection);
+                    }
+                }
+
+                const int64_t time = getMicros();
+                if (time >= nextInputScan)
+                {
+                    sendInputs(time);
+                    nextInputScan = time + inputScanMicros;
+                }
+                if (time >= nextPublish)
+                {
+                    publishHistograms();
+                    nextPublish = time + publishMicros;
+                }
+            }
+            publishHistograms();
+        }
+
+        void openConnection(int64_t now, Connection* player)
+        {
+            const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            const int spectatorPort = mConfig.spectatorPort > 0 ? mConfig.spectatorPort : mConfig.port + 1;
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(player ? spectatorPort : mConfig.port));
+            if (fd < 0 || inet_pton(AF_INET, mConfig.address.c_str(), &address.sin_addr) != 1 ||
+                (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 && errno != EINPROGRESS))
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+                mConnectErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            const int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connection->connecting = true;
+            connection->closed = false;
+            connection->spectator = player != nullptr;
+            connection->player = player;
+            connection->sessionId = player ? player->sessionId : 0;
+            connection->inputSize = 0;
+            connection->outputOffset = 0;
+            connection->waitingWritable = true;
+            connection->tickMicros = 0;
+            connection->hasState = false;
+            connection->sequence = 0;
+            connection->acked = 0;
+            connection->sentMicros.fill(0);
+            connection->minTickOffset = INT64_MAX;
+            connection->fieldHash = 0;
+            connection->targetFigure = -1;
+            connection->target = Placement{0, 0};
+            connection->replayEvent = 0;
+            connection->replayStartMicros = now;
+            for (StateRecord& record : connection->history)
+            {
+                record.valid = false;
+            }
+            //Clients start at random phases, so their inputs don't arrive in bursts
+            const int64_t interval = getInputInterval();
+            connection->nextInputMicros = now + (interval > 0 ? static_cast<int64_t>(mRandom() % interval) : 0);
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+            event.data.ptr = connection.get();
+            if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                close(fd);
+                mConnectErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            mConnections.push_back(std::move(connection));
+        }
+
+        void finishConnect(Connection& connection)
+        {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            if (getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0 || error != 0)
+            {
+                mConnectErrors.fetch_add(1, std::memory_order_relaxed);
+                closeConnection(connection);
+                return;
+            }
+            connection.connecting = false;
+            (connection.spectator ? mOpenSpectators : mOpenConnections).fetch_add(1, std::memory_order_relaxed);
+            setWritableWatch(connection, false);
+            if (connection.spectator)
+            {
+                CServerProtocol::writeSpectate(connection.output, SpectateMessage{connection.sessionId});
+                flushConnection(connection);
+            }
+        }
+
+        void setWritableWatch(Connection& connection, bool enabled)
+        {
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | (enabled ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.ptr = &connection;
+            epoll_ctl(mEpoll, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.waitingWritable = enabled;
+        }
+
+        void readConnection(Connection& connection)
+        {
+            while (!connection.closed)
+            {
+                const ssize_t received = recv(connection.fd, connection.input + connection.inputSize,
+                                              inputCapacity - connection.inputSize, 0);
+                if (received == 0)
+                {
+                    mDisconnects.fetch_add(1, std::memory_order_relaxed);
+                    closeConnection(connection);
+                    return;
+                }
+                if (received < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        mDisconnects.fetch_add(1, std::memory_order_relaxed);
+                        closeConnection(connection);
+                    }
+                    return;
+                }
+                mBytesReceived.fetch_add(static_cast<uint64_t>(received), std::memory_order_relaxed);
+                connection.inputSize += static_cast<size_t>(received);
+
+                const int64_t now = getMicros();
+                size_t offset = 0;
+                MessageView message;
+                int size = 0;
+                while (!connection.closed &&
+                       (size = CServerProtocol::parseMessage(connection.input + offset, connection.inputSize - offset, message)) > 0)
+                {
+                    offset += static_cast<size_t>(size);
+                    handleMessage(connection, message, now);
+                }
+                if (size < 0)
+                {
+                    mProtocolErrors.fetch_add(1, std::memory_order_relaxed);
+                    closeConnection(connection);
+                }
+                if (connection.closed)
+                {
+                    return;
+                }
+                std::memmove(connection.input, connection.input + offset, connection.inputSize - offset);
+                connection.inputSize -= offset;
+            }
+        }
+
+        void handleMessage(Connection& connection, const MessageView& message, int64_t now)
+        {
+            WelcomeMessage welcome;
+            switch (message.type)
+            {
+                case EMessageType::MESSAGE_WELCOME:
+                    if (!CServerProtocol::readWelcome(message, welcome) || welcome.tickRate <= 0)
+                    {
+                        mProtocolErrors.fetch_add(1, std::memory_order_relaxed);
+                        closeConnection(connection);
+                        return;
+                    }
+                    connection.tickMicros = 1000000 / welcome.tickRate;
+                    connection.sessionId = welcome.sessionId;
+                    for (int i = 0; i < mConfig.spectatorsPerGame && !connection.spectator; ++i)
+                    {
+                        mPendingSpectators.push_back(&connection);
+                    }
+                    return;
+
+                case EMessageType::MESSAGE_KEYFRAME:
+                    connection.hasState = CServerProtocol::readKeyframe(message, connection.state);
+                    break;
+
+                case EMessageType::MESSAGE_DELTA:
+                    connection.hasState = connection.hasState && CServerProtocol::applyDelta(message, connection.state);
+                    break;
+
+                default:
+                    mProtocolErrors.fetch_add(1, std::memory_order_relaxed);
+                    closeConnection(connection);
+                    return;
+            }
+
+            if (!connection.hasState)
+            {
+                //The copy went wrong, the server sends a keyframe next
+                mResyncs.fetch_add(1, std::memory_order_relaxed);
+                CServerProtocol::writeResync(connection.output);
+                flushConnection(connection);
+                return;
+            }
+            if (connection.spectator)
+            {
+                checkSpectatorState(connection);
+                return;
+            }
+            mStates.fetch_add(1, std::memory_order_relaxed);
+            StateRecord& record = connection.history[connection.state.tick % stateHistorySize];
+            record = StateRecord{connection.state.tick, connection.state.lastInput, hashState(connection.state), true};
+
+            //Every input up to the acknowledged one is answered by this state
+            const uint32_t lastInput = connection.state.lastInput;
+            for (uint32_t sequence = connection.acked + 1; sequence <= lastInput && sequence <= connection.sequence; ++sequence)
+            {
+                if (connection.sequence - sequence < pendingInputsCount)
+                {
+                    mLocalAckLatency.record(static_cast<uint64_t>(now - connection.sentMicros[sequence % pendingInputsCount]));
+                }
+            }
+            connection.acked = lastInput > connection.acked ? lastInput : connection.acked;
+
+            //Against the server tick schedule the steadiest state of the connection has the smallest offset
+            if (connection.tickMicros > 0)
+            {
+                const int64_t offset = now - static_cast<int64_t>(connection.state.tick) * connection.tickMicros;
+                connection.minTickOffset = offset < connection.minTickOffset ? offset : connection.minTickOffset;
+                mLocalTickDelay.record(static_cast<uint64_t>(offset - connection.minTickOffset));
+            }
+        }
+
+        //A state is fully determined by its tick and the last applied input, whichever way it was sent
+        void checkSpectatorState(const Connection& spectator)
+        {
+            mSpectatorStates.fetch_add(1, std::memory_order_relaxed);
+            const BoardState& state = spectator.state;
+            const StateRecord& record = spectator.player->history[state.tick % stateHistorySize];
+            if (record.valid && record.tick == state.tick && record.lastInput == state.lastInput)
+            {
+                mSpectatorChecks.fetch_add(1, std::memory_order_relaxed);
+                if (record.hash != hashState(state))
+                {
+                    mSpectatorMismatches.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        int64_t getInputInterval() const
+        {
+            return mConfig.inputRate > 0.0f ? static_cast<int64_t>(1e6 / mConfig.inputRate) : 0;
+        }
+
+        void sendInputs(int64_t now)
+        {
+            const int64_t interval = getInputInterval();
+            for (auto& pointer : mConnections)
+            {
+                Connection& connection = *pointer;
+                if (connection.closed || connection.connecting || !connection.hasState || connection.spectator)
+                {
+                    continue;
+                }
+                if (mConfig.mode == ELoadBotMode::BOT_REPLAY)
+                {
+                    sendReplayInputs(connection, now);
+                    continue;
+                }
+                if (interval <= 0 || now < connection.nextInputMicros)
+                {
+                    continue;
+                }
+                //A client which fell behind, like a bot waiting for its answer, doesn't catch up in a burst
+                connection.nextInputMicros += interval;
+                if (connection.nextInputMicros < now)
+                {
+                    connection.nextInputMicros = now + interval;
+                }
+
+                EGameCommand command;
+                if (chooseCommand(connection, command))
+                {
+                    sendCommand(connection, command, now);
+                }
+            }
+        }
+
+        void sendReplayInputs(Connection& connection, int64_t now)
+        {
+            const std::vector<ReplayEvent>& events = mConfig.replay->getEvents();
+            if (events.empty() || mReplayTickMicros <= 0.0)
+            {
+                return;
+            }
+            while (now >= connection.replayStartMicros +
+                              static_cast<int64_t>(events[connection.replayEvent].tick * mReplayTickMicros))
+            {
+                //Replays are recorded on other seeds, a game which isn't running gets started instead
+                const EGameState state = connection.state.state;
+                const bool running = state == EGameState::STATE_INGAME || state == EGameState::STATE_PAUSE;
+                sendCommand(connection, running ? events[connection.replayEvent].command : EGameCommand::COMMAND_NEW_GAME, now);
+                if (++connection.replayEvent == events.size())
+                {
+                    connection.replayEvent = 0;
+                    connection.replayStartMicros = now;
+                    return;
+                }
+            }
+        }
+
+        bool chooseCommand(Connection& connection, EGameCommand& command)
+        {
+            const BoardState& state = connection.state;
+            if (state.state == EGameState::STATE_PAUSE)
+            {
+                command = EGameCommand::COMMAND_PAUSE;
+                return true;
+            }
+            if (state.state != EGameState::STATE_INGAME)
+            {
+                command = EGameCommand::COMMAND_NEW_GAME;
+                return connection.acked == connection.sequence;
+            }
+            if (mConfig.mode == ELoadBotMode::BOT_RANDOM)
+            {
+                const EGameCommand moves[] = {EGameCommand::COMMAND_ROTATE, EGameCommand::COMMAND_MOVE_LEFT,
+                                              EGameCommand::COMMAND_MOVE_RIGHT, EGameCommand::COMMAND_DROP};
+                command = moves[mRandom() % 4];
+                return true;
+            }
+
+            //The heuristic bot decides on the board it has seen, so it waits for its last input to show
+            if (connection.acked != connection.sequence)
+            {
+                return false;
+            }
+            int figure = 0;
+            int rotation = 0;
+            if (!identifyFigure(state.figure, figure, rotation))
+            {
+                command = EGameCommand::COMMAND_DROP;
+                return true;
+            }
+            const uint32_t fieldHash = hashCells(state);
+            if (fieldHash != connection.fieldHash || figure != connection.targetFigure)
+            {
+                mField.resize(state.height);
+                for (int i = 0; i < state.height; ++i)
+                {
+                    mField[i].assign(state.cells + i * state.width, state.cells + (i + 1) * state.width);
+                }
+                if (!mBoard.load(mField))
+                {
+                    command = EGameCommand::COMMAND_DROP;
+                    return true;
+                }
+                connection.target = mBot.findPlacement(mBoard, figure);
+                connection.fieldHash = fieldHash;
+                connection.targetFigure = figure;
+            }
+
+            const int column = state.figure[1].x;
+            if (rotation != connection.target.rotation)
+            {
+                command = EGameCommand::COMMAND_ROTATE;
+            }
+            else if (column != connection.target.column)
+            {
+                command = column < connection.target.column ? EGameCommand::COMMAND_MOVE_RIGHT : EGameCommand::COMMAND_MOVE_LEFT;
+            }
+            else
+            {
+                command = EGameCommand::COMMAND_DROP;
+            }
+            return true;
+        }
+
+        void sendCommand(Connection& connection, EGameCommand command, int64_t now)
+        {
+            ++connection.sequence;
+            connection.sentMicros[connection.sequence % pendingInputsCount] = now;
+            CServerProtocol::writeInput(connection.output, InputMessage{connection.sequence, command});
+            mInputs.fetch_add(1, std::memory_order_relaxed);
+            flushConnection(connection);
+        }
+
+        void flushConnection(Connection& connection)
+        {
+            if (connection.connecting)
+            {
+                return;
+            }
+            while (connection.outputOffset < connection.output.size())
+            {
+                const ssize_t sent = send(connection.fd, connection.output.data() + connection.outputOffset,
+                                          connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        mDisconnects.fetch_add(1, std::memory_order_relaxed);
+                        closeConnection(connection);
+                    }
+                    else if (!connection.waitingWritable)
+                    {
+                        setWritableWatch(connection, true);
+                    }
+                    return;
+                }
+                connection.outputOffset += static_cast<size_t>(sent);
+            }
+            connection.output.clear();
+            connection.outputOffset = 0;
+            if (connection.waitingWritable)
+            {
+                setWritableWatch(connection, false);
+            }
+        }
+
+        void closeConnection(Connection& connection)
+        {
+            if (!connection.closed)
+            {
+                close(connection.fd);
+                connection.closed = true;
+                if (!connection.connecting)
+                {
+                    (connection.spectator ? mOpenSpectators : mOpenConnections).fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void publishHistograms()
+        {
+            std::lock_guard<std::mutex> lock(mHistogramsMutex);
+            mAckLatency.add(mLocalAckLatency);
+            mTickDelay.add(mLocalTickDelay);
+            mLocalAckLatency.clear();
+            mLocalTickDelay.clear();
+        }
+
+    private:
+        LoadConfig mConfig;
+        int mConnectionsCount;
+        int64_t mConnectRate;
+        int mEpoll;
+        std::thread mThread;
+        std::atomic<bool> mRunning;
+        std::vector<std::unique_ptr<Connection>> mConnections;
+        std::minstd_rand mRandom;
+        double mReplayTickMicros;
+        std::deque<Connection*> mPendingSpectators;
+        int64_t mNextSpectatorMicros;
+        CHeuristicBot mBot;
+        CBitBoard mBoard;
+        TFieldType mField;
+
+        //Recorded without a lock, handed over to the shared ones a few times per second
+        CLatencyHistogram mLocalAckLatency;
+        CLatencyHistogram mLocalTickDelay;
+        mutable std::mutex mHistogramsMutex;
+        CLatencyHistogram mAckLatency;
+        CLatencyHistogram mTickDelay;
+
+        std::atomic<uint64_t> mOpenConnections;
+        std::atomic<uint64_t> mInputs;
+        std::atomic<uint64_t> mStates;
+        std::atomic<uint64_t> mBytesReceived;
+        std::atomic<uint64_t> mConnectErrors;
+        std::atomic<uint64_t> mDisconnects;
+        std::atomic<uint64_t> mProtocolErrors;
+        std::atomic<uint64_t> mResyncs;
+        std::atomic<uint64_t> mOpenSpectators;
+        std::atomic<uint64_t> mSpectatorStates;
+        std::atomic<uint64_t> mSpectatorChecks;
+        std::atomic<uint64_t> mSpectatorMismatches;
+    };
+
+    CLoadGenerator::CLoadGenerator(const LoadConfig& config)
+    : mConfig(config)
+    {
+        if (mConfig.threadsCount == 0)
+        {
+            mConfig.threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (mConfig.mode == ELoadBotMode::BOT_REPLAY && !mConfig.replay)
+        {
+            mConfig.mode = ELoadBotMode::BOT_HEURISTIC;
+        }
+    }
+
+    CLoadGenerator::~CLoadGenerator()
+    {
+        stop();
+    }
+
+    void CLoadGenerator::start()
+    {
+        //Connections and the connect rate are split evenly, the first workers take the remainder
+        const unsigned threads = mConfig.threadsCount;
+        std::random_device random;
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            const int connections = mConfig.connectionsCount / static_cast<int>(threads) +
+                                    (static_cast<int>(i) < mConfig.connectionsCount % static_cast<int>(threads) ? 1 : 0);
+            const int connectRate = mConfig.connectRate / static_cast<int>(threads);
+            mWorkers.push_back(std::make_unique<CWorker>(mConfig, connections, connectRate, random()));
+        }
+        for (auto& worker : mWorkers)
+        {
+            worker->start();
+        }
+    }
+
+    void CLoadGenerator::stop()
+    {
+        for (auto& worker : mWorkers)
+        {
+            worker->stop();
+        }
+    }
+
+    LoadStats CLoadGenerator::getStats() const
+    {
+        LoadStats stats{};
+        for (const auto& worker : mWorkers)
+        {
+            worker->addStats(stats);
+        }
+        return stats;
+    }
+
+    unsigned CLoadGenerator::getThreadsCount() const
+    {
+        return mConfig.threadsCount;
+    }
+}
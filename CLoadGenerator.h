@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CLatencyHistogram.h"
+#include "CReplay.h"
+
+namespace game
+{
+
+enum class ELoadBotMode
+{
+    BOT_HEURISTIC,
+    BOT_RANDOM,
+    BOT_REPLAY
+};
+
+struct LoadConfig
+{
+    std::string address = "127.0.0.1";
+    int port = 7777;
+    int connectionsCount = 1000;
+    unsigned threadsCount = 0; //0 means one per core
+    float inputRate = 5.0f; //Inputs per second of one client, for replays 0 keeps their own pace
+    int connectRate = 2000; //New connections per second
+    ELoadBotMode mode = ELoadBotMode::BOT_HEURISTIC;
+    const CReplay* replay = nullptr;
+    int spectatorsPerGame = 0; //Spectator connections opened for every game once it is welcomed
+    int spectatorPort = 0; //0 means the port after the player one
+};
+
+struct LoadStats
+{
+    uint64_t connections;
+    uint64_t inputs;
+    uint64_t states;
+    uint64_t bytesReceived;
+    uint64_t connectErrors;
+    uint64_t disconnects;
+    uint64_t protocolErrors;
+    uint64_t resyncs;
+    uint64_t spectators;
+    uint64_t spectatorStates;
+    //Boards rebuilt by spectators compared with the state their player got for the same tick and input
+    uint64_t spectatorChecks;
+    uint64_t spectatorMismatches;
+    //Time from sending an input to the first state which acknowledges it
+    CLatencyHistogram ackLatency;
+    //How much later than the steadiest one a state arrives, measured against its server tick
+    CLatencyHistogram tickDelay;
+};
+
+//Opens many client connections to tetris_server and plays them with bots or replays from a few
+//threads, each with its own epoll loop. Inputs carry sequence numbers, the states coming back
+//acknowledge them, which gives the input to state latency as a client sees it.
+//Spectators of the games connect to the spectator port, usually to another shard than the one
+//running the game, and check every board they rebuild against the one their player got.
+class CLoadGenerator
+{
+public:
+    explicit CLoadGenerator(const LoadConfig& config);
+    ~CLoadGenerator();
+
+    void start();
+    void stop();
+    LoadStats getStats() const;
+    unsigned getThreadsCount() const;
+
+    CLoadGenerator(const CLoadGenerator& other) = delete;
+    CLoadGenerator& operator=(const CLoadGenerator& other) = delete;
+
+private:
+    class CWorker;
+
+    LoadConfig mConfig;
+    std::vector<std::unique_ptr<CWorker>> mWorkers;
+};
+
+}
@@ -0,0 +1,398 @@
+#include "CMctsBot.h"
+#include "CTracer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace game
+{
+    namespace
+    {
+        //Rewards are kept as fixed point numbers, so they can be summed with one atomic add
+        const float rewardScale = 1000000.0f;
+        const int defaultIterations = 1000;
+        const int maxTreeDepth = CTetris::mMaxPreviewSize + 1;
+
+        enum ENodeState
+        {
+            NODE_LEAF,
+            NODE_EXPANDING,
+            NODE_EXPANDED,
+            NODE_NO_MEMORY
+        };
+
+        bool isSamePlacement(const Placement& a, const Placement& b)
+        {
+            return a.rotation == b.rotation && a.column == b.column;
+        }
+
+        int drawFigure(bool bagGenerator, unsigned& bag, std::minstd_rand& random)
+        {
+            if (!bagGenerator)
+            {
+                return random() % CTetris::mFiguresCount;
+            }
+            if (bag == 0)
+            {
+                bag = CTetris::mAllFigures;
+            }
+
+            int count = 0;
+            for (int f = 0; f < CTetris::mFiguresCount; ++f)
+            {
+                count += (bag >> f) & 1;
+            }
+            int index = random() % count;
+            int figure = 0;
+            while (!((bag >> figure) & 1) || index-- > 0)
+            {
+                ++figure;
+            }
+            bag &= ~(1u << figure);
+            return figure;
+        }
+    }
+
+    CMctsBot::CMctsBot()
+    : CMctsBot(MctsConfig(), CHeuristicBot::getDefaultWeights())
+    {
+    }
+
+    CMctsBot::CMctsBot(const MctsConfig& config, const THeuristicWeights& weights)
+    : mConfig(config)
+    , mEvaluator(weights)
+    , mNodes(new Node[config.maxNodes])
+    , mSpareNodes(new Node[config.maxNodes])
+    , mNodesCount(0)
+    , mIterations(0)
+    , mStopped(false)
+    , mKnownCount(0)
+    , mBagGenerator(false)
+    , mBag(CTetris::mAllFigures)
+    , mHasTree(false)
+    , mLastMove{0, 0}
+    , mReusedNodes(0)
+    , mCalls(0)
+    {
+    }
+
+    Placement CMctsBot::findPlacement(const CTetris& game)
+    {
+        TETRIS_TRACE_SCOPE("mcts search");
+        CBitBoard board;
+        if (!board.load(game.getField()))
+        {
+            return Placement{0, game.getCurrentFigure()[1].x};
+        }
+        const int knownCount = 1 + game.getPreviewSize();
+        int figures[maxTreeDepth];
+        figures[0] = game.getCurrentFigureId();
+        for (int i = 1; i < knownCount; ++i)
+        {
+            figures[i] = game.getPreviewFigureId(i - 1);
+        }
+
+        mReusedNodes = reuseTree(board, figures, knownCount);
+        if (mReusedNodes == 0)
+        {
+            resetNode(mNodes[0], Placement{0, 0});
+            mNodesCount = 1;
+        }
+
+        mKnownCount = knownCount;
+        std::copy(figures, figures + knownCount, mFigures);
+        mBagGenerator = game.getFigureGenerator() == EFigureGenerator::GENERATOR_BAG;
+        mBag = game.getRemainingFigures();
+        mRootBoard = board;
+
+        mIterations = 0;
+        mStopped = false;
+        mDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mConfig.timeBudgetMs);
+
+        ++mCalls;
+        std::vector<std::thread> threads;
+        for (int i = 1; i < mConfig.threads; ++i)
+        {
+            threads.emplace_back(&CMctsBot::runWorker, this, mConfig.seed + mCalls * mConfig.threads + i);
+        }
+        runWorker(mConfig.seed + mCalls * mConfig.threads);
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        //The most visited move is the most robust choice
+        const Node& root = mNodes[0];
+        Placement best{0, game.getCurrentFigure()[1].x};
+        int bestVisits = -1;
+        if (root.state == NODE_EXPANDED)
+        {
+            for (int i = 0; i < root.childrenCount; ++i)
+            {
+                const Node& child = mNodes[root.firstChild + i];
+                if (child.visits > bestVisits)
+                {
+                    bestVisits = child.visits;
+                    best = child.placement;
+                }
+            }
+        }
+        mLastMove = best;
+        mHasTree = bestVisits >= 0;
+        return best;
+    }
+
+    int CMctsBot::getLastIterations() const
+    {
+        return mIterations;
+    }
+
+    int CMctsBot::getReusedNodes() const
+    {
+        return mReusedNodes;
+    }
+
+    void CMctsBot::resetNode(Node& node, const Placement& placement) const
+    {
+        node.placement = placement;
+        node.visits.store(0, std::memory_order_relaxed);
+        node.virtualLoss.store(0, std::memory_order_relaxed);
+        node.reward.store(0, std::memory_order_relaxed);
+        node.state.store(NODE_LEAF, std::memory_order_relaxed);
+        node.firstChild = 0;
+        node.childrenCount = 0;
+    }
+
+    int CMctsBot::reuseTree(const CBitBoard& board, const int* figures, int knownCount)
+    {
+        TETRIS_TRACE_SCOPE("mcts reuse tree");
+        if (!mHasTree || mNodes[0].state != NODE_EXPANDED)
+        {
+            return 0;
+        }
+
+        //The kept subtree is valid only if the game went exactly as the tree expected
+        CBitBoard expected = mRootBoard;
+        expected.place(mFigures[0], mLastMove);
+        if (expected.isToppedOut() || !(expected == board))
+        {
+            return 0;
+        }
+        for (int i = 1; i < mKnownCount && i - 1 < knownCount; ++i)
+        {
+            if (mFigures[i] != figures[i - 1])
+            {
+                return 0;
+            }
+        }
+
+        const Node& root = mNodes[0];
+        int subtree = -1;
+        for (int i = 0; i < root.childrenCount; ++i)
+        {
+            if (isSamePlacement(mNodes[root.firstChild + i].placement, mLastMove))
+            {
+                subtree = root.firstChild + i;
+                break;
+            }
+        }
+        if (subtree < 0)
+        {
+            return 0;
+        }
+
+        //Copy the subtree breadth first into the spare pool, so children stay contiguous
+        auto copyNode = [](Node& to, const Node& from) {
+            to.placement = from.placement;
+            to.visits.store(from.visits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to.virtualLoss.store(0, std::memory_order_relaxed);
+            to.reward.store(from.reward.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to.state.store(from.state == NODE_EXPANDED ? NODE_EXPANDED : NODE_LEAF, std::memory_order_relaxed);
+            to.firstChild = from.firstChild;
+            to.childrenCount = from.state == NODE_EXPANDED ? from.childrenCount : 0;
+        };
+
+        copyNode(mSpareNodes[0], mNodes[subtree]);
+        int count = 1;
+        for (int i = 0; i < count; ++i)
+        {
+            Node& node = mSpareNodes[i];
+            const int oldFirst = node.firstChild;
+            node.firstChild = count;
+            for (int j = 0; j < node.childrenCount; ++j)
+            {
+                copyNode(mSpareNodes[count++], mNodes[oldFirst + j]);
+            }
+        }
+
+        mNodes.swap(mSpareNodes);
+        mNodesCount = count;
+        return count;
+    }
+
+    void CMctsBot::runWorker(unsigned seed)
+    {
+        TETRIS_TRACE_SCOPE("mcts rollouts");
+        std::minstd_rand random(seed);
+        const int iterations = mConfig.iterations > 0 || mConfig.timeBudgetMs > 0 ? mConfig.iterations : defaultIterations;
+        while (!mStopped.load(std::memory_order_relaxed))
+        {
+            if (iterations > 0 && mIterations.fetch_add(1, std::memory_order_relaxed) >= iterations)
+            {
+                mIterations = iterations;
+                break;
+            }
+            if (mConfig.timeBudgetMs > 0 && std::chrono::steady_clock::now() > mDeadline)
+            {
+                break;
+            }
+            if (!iterate(random))
+            {
+                break;
+            }
+        }
+        mStopped = true;
+    }
+
+    bool CMctsBot::iterate(std::minstd_rand& random)
+    {
+        int path[maxTreeDepth + 1];
+        int pathLength = 0;
+        CBitBoard board = mRootBoard;
+        int lines = 0;
+        int depth = 0;
+        int node = 0;
+        bool terminal = false;
+
+        path[pathLength++] = node;
+        mNodes[node].virtualLoss.fetch_add(1, std::memory_order_relaxed);
+        while (depth < mKnownCount)
+        {
+            Node& current = mNodes[node];
+            int state = current.state.load(std::memory_order_acquire);
+            if (state == NODE_LEAF)
+            {
+                int expected = NODE_LEAF;
+                if (!current.state.compare_exchange_strong(expected, NODE_EXPANDING, std::memory_order_acquire))
+                {
+                    break;
+                }
+                state = expand(node, board, mFigures[depth]);
+            }
+            if (state != NODE_EXPANDED)
+            {
+                break;
+            }
+            if (current.childrenCount == 0)
+            {
+                terminal = true;
+                break;
+            }
+
+            node = selectChild(current);
+            Node& child = mNodes[node];
+            child.virtualLoss.fetch_add(1, std::memory_order_relaxed);
+            path[pathLength++] = node;
+            lines += board.place(mFigures[depth], child.placement);
+            ++depth;
+            if (board.isToppedOut())
+            {
+                terminal = true;
+                break;
+            }
+        }
+
+        const float reward = terminal ? 0.0f : rollout(board, depth, lines, depth, random);
+        const int64_t fixedReward = static_cast<int64_t>(reward * rewardScale);
+        for (int i = 0; i < pathLength; ++i)
+        {
+            Node& visited = mNodes[path[i]];
+            visited.reward.fetch_add(fixedReward, std::memory_order_relaxed);
+            visited.visits.fetch_add(1, std::memory_order_relaxed);
+            visited.virtualLoss.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    int CMctsBot::expand(int node, const CBitBoard& board, int figure)
+    {
+        Placement placements[CBitBoard::mMaxPlacements];
+        const int count = board.getPlacements(figure, placements);
+
+        Node& current = mNodes[node];
+        const int first = mNodesCount.fetch_add(count, std::memory_order_relaxed);
+        if (first + count > mConfig.maxNodes)
+        {
+            current.state.store(NODE_NO_MEMORY, std::memory_order_release);
+            return NODE_NO_MEMORY;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            resetNode(mNodes[first + i], placements[i]);
+        }
+        current.firstChild = first;
+        current.childrenCount = count;
+        current.state.store(NODE_EXPANDED, std::memory_order_release);
+        return NODE_EXPANDED;
+    }
+
+    int CMctsBot::selectChild(const Node& node) const
+    {
+        //Virtual losses count as visits with no reward, which spreads threads over different children
+        const float logVisits = std::log(static_cast<float>(node.visits + node.virtualLoss + 1));
+        int best = node.firstChild;
+        float bestScore = -std::numeric_limits<float>::infinity();
+        for (int i = 0; i < node.childrenCount; ++i)
+        {
+            const Node& child = mNodes[node.firstChild + i];
+            const int visits = child.visits.load(std::memory_order_relaxed) + child.virtualLoss.load(std::memory_order_relaxed);
+            if (visits == 0)
+            {
+                return node.firstChild + i;
+            }
+
+            const float mean = child.reward.load(std::memory_order_relaxed) / rewardScale / visits;
+            const float score = mean + mConfig.exploration * std::sqrt(logVisits / visits);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = node.firstChild + i;
+            }
+        }
+        return best;
+    }
+
+    float CMctsBot::rollout(CBitBoard& board, int index, int lines, int pieces, std::minstd_rand& random) const
+    {
+        unsigned bag = mBag;
+        Placement placements[CBitBoard::mMaxPlacements];
+        for (int i = 0; i < mConfig.rolloutDepth; ++i, ++index)
+        {
+            const int figure = index < mKnownCount ? mFigures[index] : drawFigure(mBagGenerator, bag, random);
+            const int count = board.getPlacements(figure, placements);
+            if (count == 0)
+            {
+                return 0.0f;
+            }
+
+            const Placement placement = mConfig.heuristicRollouts
+                ? mEvaluator.findPlacement(board, figure)
+                : placements[random() % count];
+            lines += board.place(figure, placement);
+            ++pieces;
+            if (board.isToppedOut())
+            {
+                return 0.0f;
+            }
+        }
+
+        //Half of the reward is the line rate (a figure fills at most 4 / width lines),
+        //the other half is the heuristic value of the final board squashed to 0..1
+        const float lineRate = pieces > 0 ? std::min(1.0f, lines * board.getWidth() / (4.0f * pieces)) : 0.0f;
+        const float boardValue = 1.0f / (1.0f + std::exp(-mEvaluator.evaluate(board, 0) / 10.0f));
+        return 0.5f * lineRate + 0.5f * boardValue;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include "CHeuristicBot.h"
+
+namespace game
+{
+
+struct MctsConfig
+{
+    //Search stops after this many rollouts or after timeBudgetMs, whichever comes first (0 disables a limit)
+    int iterations = 5000;
+    int timeBudgetMs = 0;
+    int threads = 1;
+    int rolloutDepth = 10;
+    bool heuristicRollouts = true;
+    float exploration = 0.7f;
+    int maxNodes = 1 << 18;
+    unsigned seed = 1;
+};
+
+//Monte Carlo tree search over placements of the current figure and the visible previews.
+//Rollouts continue with random figures on a stack copy of the board. The tree lives in a
+//preallocated node pool shared by all search threads, and the subtree of the played move
+//is kept for the next call.
+class CMctsBot
+{
+public:
+    CMctsBot();
+    CMctsBot(const MctsConfig& config, const THeuristicWeights& weights);
+
+    Placement findPlacement(const CTetris& game);
+    int getLastIterations() const;
+    int getReusedNodes() const;
+
+    CMctsBot(const CMctsBot& other) = delete;
+    CMctsBot& operator=(const CMctsBot& other) = delete;
+
+private:
+    struct Node
+    {
+        Placement placement;
+        std::atomic<int> visits;
+        std::atomic<int> virtualLoss;
+        std::atomic<int64_t> reward;
+        std::atomic<int> state;
+        int firstChild;
+        int childrenCount;
+    };
+
+    void resetNode(Node& node, const Placement& placement) const;
+    int reuseTree(const CBitBoard& board, const int* figures, int knownCount);
+    void runWorker(unsigned seed);
+    bool iterate(std::minstd_rand& random);
+    int expand(int node, const CBitBoard& board, int figure);
+    int selectChild(const Node& node) const;
+    float rollout(CBitBoard& board, int index, int lines, int pieces, std::minstd_rand& random) const;
+
+private:
+    MctsConfig mConfig;
+    CHeuristicBot mEvaluator;
+    std::unique_ptr<Node[]> mNodes;
+    std::unique_ptr<Node[]> mSpareNodes;
+    std::atomic<int> mNodesCount;
+    std::atomic<int> mIterations;
+    std::atomic<bool> mStopped;
+    std::chrono::steady_clock::time_point mDeadline;
+
+    CBitBoard mRootBoard;
+    int mFigures[CTetris::mMaxPreviewSize + 1];
+    int mKnownCount;
+    bool mBagGenerator;
+    unsigned mBag;
+    bool mHasTree;
+    Placement mLastMove;
+    int mReusedNodes;
+    unsigned mCalls;
+};
+
+}
@@ -0,0 +1,451 @@
+#include "CNeuralEvaluator.h"
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace game
+{
+    namespace
+    {
+        const char networkMagic[4] = {'T', 'N', 'N', '1'};
+        const uint32_t networkVersion = 1;
+        const int sectionAlignment = 64;
+        const int layer2Shift = 6;
+        const int accumulatorTileRegisters = 8;
+        const float outputScale = 127.0f * 64.0f;
+
+        struct NetworkHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t inputs;
+            uint32_t hidden;
+            uint32_t layer2;
+            uint32_t policy;
+        };
+
+        //Takes the next section from the mapped file, or returns nullptr if the file is too short
+        template <typename T>
+        const T* takeSection(const uint8_t* data, size_t dataSize, size_t& offset, size_t count)
+        {
+            offset = (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+            const size_t size = count * sizeof(T);
+            if (offset + size > dataSize)
+            {
+                return nullptr;
+            }
+            const T* section = reinterpret_cast<const T*>(data + offset);
+            offset += size;
+            return section;
+        }
+
+        inline uint8_t clip(int value)
+        {
+            return static_cast<uint8_t>(value < 0 ? 0 : (value > 127 ? 127 : value));
+        }
+
+        //Dot product of unsigned activations and signed weights, size is a multiple of 32
+        inline int32_t dot(const uint8_t* input, const int8_t* weights, int size, bool simd)
+        {
+#ifdef __AVX2__
+            if (!simd)
+            {
+                int32_t sum = 0;
+                for (int i = 0; i < size; ++i)
+                {
+                    sum += static_cast<int32_t>(input[i]) * weights[i];
+                }
+                return sum;
+            }
+            const __m256i ones = _mm256_set1_epi16(1);
+            __m256i sum = _mm256_setzero_si256();
+            for (int i = 0; i < size; i += 32)
+            {
+                __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(input + i));
+                __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, w), ones));
+            }
+            __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+            half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(half);
+#else
+            (void)simd;
+            int32_t sum = 0;
+            for (int i = 0; i < size; ++i)
+            {
+                sum += static_cast<int32_t>(input[i]) * weights[i];
+            }
+            return sum;
+#endif
+        }
+
+        //Pads the data to the next section start, like takeSection() expects
+        template <typename T>
+        void putSection(std::vector<uint8_t>& data, const std::vector<T>& values)
+        {
+            data.resize((data.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment);
+            const size_t offset = data.size();
+            data.resize(offset + values.size() * sizeof(T));
+            std::memcpy(data.data() + offset, values.data(), values.size() * sizeof(T));
+        }
+
+        template <typename T>
+        std::vector<T> getRandomValues(std::mt19937& random, size_t count, int range)
+        {
+            std::uniform_int_distribution<int> distribution(-range, range);
+            std::vector<T> values(count);
+            for (T& value : values)
+            {
+                value = static_cast<T>(distribution(random));
+            }
+            return values;
+        }
+    }
+
+    CNeuralEvaluator::CNeuralEvaluator()
+    : mData(nullptr)
+    , mDataSize(0)
+    , mFileHandle(nullptr)
+    , mMappingHandle(nullptr)
+    , mL1Bias(nullptr)
+    , mL1Weights(nullptr)
+    , mL2Bias(nullptr)
+    , mL2Weights(nullptr)
+    , mValueBias(nullptr)
+    , mValueWeights(nullptr)
+    , mPolicyBias(nullptr)
+    , mPolicyWeights(nullptr)
+    , mSimdEnabled(true)
+    {
+    }
+
+    CNeuralEvaluator::~CNeuralEvaluator()
+    {
+        unmap();
+    }
+
+    bool CNeuralEvaluator::loadFromFile(const std::string& path)
+    {
+        unmap();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size;
+        HANDLE mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        mFileHandle = file;
+        mMappingHandle = mapping;
+        if (view == nullptr)
+        {
+            unmap();
+            return false;
+        }
+        mData = static_cast<const uint8_t*>(view);
+        mDataSize = static_cast<size_t>(size.QuadPart);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        void* view = MAP_FAILED;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+        }
+        close(file);
+        if (view == MAP_FAILED)
+        {
+            return false;
+        }
+        mData = static_cast<const uint8_t*>(view);
+        mDataSize = static_cast<size_t>(info.st_size);
+#endif
+
+        NetworkHeader header;
+        if (mDataSize < sizeof(header))
+        {
+            unmap();
+            return false;
+        }
+        std::memcpy(&header, mData, sizeof(header));
+        if (std::memcmp(header.magic, networkMagic, sizeof(networkMagic)) != 0 || header.version != networkVersion ||
+            header.inputs != mInputsCount || header.hidden != mHiddenSize ||
+            header.layer2 != mLayer2Size || header.policy != mPolicySize)
+        {
+            unmap();
+            return false;
+        }
+
+        size_t offset = sizeof(header);
+        mL1Bias = takeSection<int16_t>(mData, mDataSize, offset, mHiddenSize);
+        mL1Weights = takeSection<int16_t>(mData, mDataSize, offset, static_cast<size_t>(mInputsCount) * mHiddenSize);
+        mL2Bias = takeSection<int32_t>(mData, mDataSize, offset, mLayer2Size);
+        mL2Weights = takeSection<int8_t>(mData, mDataSize, offset, mLayer2Size * mHiddenSize);
+        mValueBias = takeSection<int32_t>(mData, mDataSize, offset, 1);
+        mValueWeights = takeSection<int8_t>(mData, mDataSize, offset, mLayer2Size);
+        mPolicyBias = takeSection<int32_t>(mData, mDataSize, offset, mPolicySize);
+        mPolicyWeights = takeSection<int8_t>(mData, mDataSize, offset, mPolicySize * mLayer2Size);
+        if (mPolicyWeights == nullptr || mPolicyBias == nullptr || mValueWeights == nullptr || mValueBias == nullptr ||
+            mL2Weights == nullptr || mL2Bias == nullptr || mL1Weights == nullptr || mL1Bias == nullptr)
+        {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    bool CNeuralEvaluator::isLoaded() const
+    {
+        return mData != nullptr;
+    }
+
+    bool CNeuralEvaluator::saveRandomWeights(const std::string& path, unsigned seed)
+    {
+        //Small first layer weights keep the accumulators of full boards within 16 bits
+        //and most activations between the clipping bounds
+        std::mt19937 random(seed);
+        NetworkHeader header;
+        std::memcpy(header.magic, networkMagic, sizeof(networkMagic));
+        header.version = networkVersion;
+        header.inputs = mInputsCount;
+        header.hidden = mHiddenSize;
+        header.layer2 = mLayer2Size;
+        header.policy = mPolicySize;
+        std::vector<uint8_t> data(sizeof(header));
+        std::memcpy(data.data(), &header, sizeof(header));
+        putSection(data, getRandomValues<int16_t>(random, mHiddenSize, 64));
+        putSection(data, getRandomValues<int16_t>(random, static_cast<size_t>(mInputsCount) * mHiddenSize, 8));
+        putSection(data, getRandomValues<int32_t>(random, mLayer2Size, 1024));
+        putSection(data, getRandomValues<int8_t>(random, mLayer2Size * mHiddenSize, 16));
+        putSection(data, getRandomValues<int32_t>(random, 1, 1024));
+        putSection(data, getRandomValues<int8_t>(random, mLayer2Size, 64));
+        putSection(data, getRandomValues<int32_t>(random, mPolicySize, 1024));
+        putSection(data, getRandomValues<int8_t>(random, mPolicySize * mLayer2Size, 64));
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+
+    bool CNeuralEvaluator::isSimdAvailable()
+    {
+#ifdef __AVX2__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void CNeuralEvaluator::setSimdEnabled(bool enabled)
+    {
+        mSimdEnabled = enabled;
+    }
+
+    void CNeuralEvaluator::unmap()
+    {
+#ifdef _WIN32
+        if (mData)
+        {
+            UnmapViewOfFile(mData);
+        }
+        if (mMappingHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mMappingHandle));
+        }
+        if (mFileHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mFileHandle));
+        }
+#else
+        if (mData)
+        {
+            munmap(const_cast<uint8_t*>(mData), mDataSize);
+        }
+#endif
+        mData = nullptr;
+        mDataSize = 0;
+        mFileHandle = nullptr;
+        mMappingHandle = nullptr;
+        mL1Bias = nullptr;
+        mL1Weights = nullptr;
+        mL2Bias = nullptr;
+        mL2Weights = nullptr;
+        mValueBias = nullptr;
+        mValueWeights = nullptr;
+        mPolicyBias = nullptr;
+        mPolicyWeights = nullptr;
+    }
+
+    void CNeuralEvaluator::reset(Accumulator& accumulator) const
+    {
+        std::memcpy(accumulator.values, mL1Bias, sizeof(accumulator.values));
+        std::memset(accumulator.rows, 0, sizeof(accumulator.rows));
+        std::memset(accumulator.queue, -1, sizeof(accumulator.queue));
+    }
+
+    void CNeuralEvaluator::applyFeatures(Accumulator& accumulator, const int* added, int addedCount, const int* removed, int removedCount) const
+    {
+#ifdef __AVX2__
+        //A tile of the accumulator stays in registers while every changed feature is applied to it,
+        //so it is loaded and stored once per update instead of once per feature
+        if (mSimdEnabled)
+        {
+            static_assert(mHiddenSize % (accumulatorTileRegisters * 16) == 0, "The accumulator must split into whole tiles");
+            for (int tile = 0; tile < mHiddenSize; tile += accumulatorTileRegisters * 16)
+            {
+                __m256i* values = reinterpret_cast<__m256i*>(accumulator.values + tile);
+                __m256i sums[accumulatorTileRegisters];
+                for (int j = 0; j < accumulatorTileRegisters; ++j)
+                {
+                    sums[j] = _mm256_load_si256(values + j);
+                }
+                for (int i = 0; i < addedCount; ++i)
+                {
+                    const __m256i* weights = reinterpret_cast<const __m256i*>(mL1Weights + static_cast<size_t>(added[i]) * mHiddenSize + tile);
+                    for (int j = 0; j < accumulatorTileRegisters; ++j)
+                    {
+                        sums[j] = _mm256_add_epi16(sums[j], _mm256_loadu_si256(weights + j));
+                    }
+                }
+                for (int i = 0; i < removedCount; ++i)
+                {
+                    const __m256i* weights = reinterpret_cast<const __m256i*>(mL1Weights + static_cast<size_t>(removed[i]) * mHiddenSize + tile);
+                    for (int j = 0; j < accumulatorTileRegisters; ++j)
+                    {
+                        sums[j] = _mm256_sub_epi16(sums[j], _mm256_loadu_si256(weights + j));
+                    }
+                }
+                for (int j = 0; j < accumulatorTileRegisters; ++j)
+                {
+                    _mm256_store_si256(values + j, sums[j]);
+                }
+            }
+            return;
+        }
+#endif
+        for (int i = 0; i < addedCount; ++i)
+        {
+            const int16_t* weights = mL1Weights + static_cast<size_t>(added[i]) * mHiddenSize;
+            for (int j = 0; j < mHiddenSize; ++j)
+            {
+                accumulator.values[j] += weights[j];
+            }
+        }
+        for (int i = 0; i < removedCount; ++i)
+        {
+            const int16_t* weights = mL1Weights + static_cast<size_t>(removed[i]) * mHiddenSize;
+            for (int j = 0; j < mHiddenSize; ++j)
+            {
+                accumulator.values[j] -= weights[j];
+            }
+        }
+    }
+
+    void CNeuralEvaluator::update(Accumulator& accumulator, const CBitBoard& board, const int* queue, int queueSize) const
+    {
+        //Only the cells which differ from the accumulated board touch the weights
+        int added[mMaxChangedFeatures];
+        int removed[mMaxChangedFeatures];
+        int addedCount = 0;
+        int removedCount = 0;
+        for (int y = 0; y < board.getHeight(); ++y)
+        {
+            const CBitBoard::TRow row = board.getRow(y);
+            CBitBoard::TRow changed = row ^ accumulator.rows[y];
+            for (int x = 0; changed; ++x, changed >>= 1)
+            {
+                if (changed & 1)
+                {
+                    const int feature = y * CBitBoard::mMaxWidth + x;
+                    if ((row >> x) & 1)
+                    {
+                        added[addedCount++] = feature;
+                    }
+                    else
+                    {
+                        removed[removedCount++] = feature;
+                    }
+                }
+            }
+            accumulator.rows[y] = row;
+        }
+
+        for (int i = 0; i < mQueueSlots; ++i)
+        {
+            const int figure = i < queueSize ? queue[i] : -1;
+            if (figure == accumulator.queue[i])
+            {
+                continue;
+            }
+            if (accumulator.queue[i] >= 0)
+            {
+                removed[removedCount++] = mBoardFeatures + i * CTetris::mFiguresCount + accumulator.queue[i];
+            }
+            if (figure >= 0)
+            {
+                added[addedCount++] = mBoardFeatures + i * CTetris::mFiguresCount + figure;
+            }
+            accumulator.queue[i] = static_cast<int8_t>(figure);
+        }
+        applyFeatures(accumulator, added, addedCount, removed, removedCount);
+    }
+
+    void CNeuralEvaluator::forwardLayer2(const Accumulator& accumulator, uint8_t* output) const
+    {
+        alignas(32) uint8_t hidden[mHiddenSize];
+        for (int i = 0; i < mHiddenSize; ++i)
+        {
+            hidden[i] = clip(accumulator.values[i]);
+        }
+        for (int i = 0; i < mLayer2Size; ++i)
+        {
+            output[i] = clip((mL2Bias[i] + dot(hidden, mL2Weights + i * mHiddenSize, mHiddenSize, mSimdEnabled)) >> layer2Shift);
+        }
+    }
+
+    float CNeuralEvaluator::evaluate(const Accumulator& accumulator) const
+    {
+        alignas(32) uint8_t layer2[mLayer2Size];
+        forwardLayer2(accumulator, layer2);
+        return (*mValueBias + dot(layer2, mValueWeights, mLayer2Size, mSimdEnabled)) / outputScale;
+    }
+
+    float CNeuralEvaluator::evaluate(const Accumulator& accumulator, float* policy) const
+    {
+        alignas(32) uint8_t layer2[mLayer2Size];
+        forwardLayer2(accumulator, layer2);
+        for (int i = 0; i < mPolicySize; ++i)
+        {
+            policy[i] = (mPolicyBias[i] + dot(layer2, mPolicyWeights + i * mLayer2Size, mLayer2Size, mSimdEnabled)) / outputScale;
+        }
+        return (*mValueBias + dot(layer2, mValueWeights, mLayer2Size, mSimdEnabled)) / outputScale;
+    }
+
+    int CNeuralEvaluator::getPolicyIndex(const Placement& placement)
+    {
+        return placement.rotation * CBitBoard::mMaxWidth + placement.column;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "CBitBoard.h"
+
+namespace game
+{
+
+//Small quantised value/policy network in the NNUE style: the first layer is kept as an
+//accumulator which is updated only for the cells and queue slots that changed.
+//
+//Weights file layout (little endian, every section starts at a multiple of 64 bytes):
+//  header: "TNN1", uint32 version, inputs, hidden, layer2 and policy sizes
+//  int16 first layer biases[hidden], int16 first layer weights[inputs][hidden]
+//  int32 second layer biases[layer2], int8 second layer weights[layer2][hidden]
+//  int32 value bias, int8 value weights[layer2]
+//  int32 policy biases[policy], int8 policy weights[policy][layer2]
+//Inputs are the board cells (x + y * 16) followed by 8 queue slots of 7 figures.
+//Activations are clipped to 0..127, the second layer sum is shifted right by 6.
+class CNeuralEvaluator
+{
+public:
+    static const int mHiddenSize = 256;
+    static const int mLayer2Size = 32;
+    static const int mQueueSlots = 8;
+    static const int mBoardFeatures = CBitBoard::mMaxWidth * CBitBoard::mMaxHeight;
+    static const int mInputsCount = mBoardFeatures + mQueueSlots * CTetris::mFiguresCount;
+    static const int mPolicySize = CBitBoard::mMaxPlacements;
+    static const int mMaxChangedFeatures = mBoardFeatures + 2 * mQueueSlots;
+
+    struct Accumulator
+    {
+        alignas(32) int16_t values[mHiddenSize];
+        CBitBoard::TRow rows[CBitBoard::mMaxHeight];
+        int8_t queue[mQueueSlots];
+    };
+
+    CNeuralEvaluator();
+    ~CNeuralEvaluator();
+
+    bool loadFromFile(const std::string& path);
+    bool isLoaded() const;
+    //Writes a network of small random weights, for checks and benchmarks without a trained one
+    static bool saveRandomWeights(const std::string& path, unsigned seed);
+
+    //The SIMD kernels are compiled in with USE_AVX2 and used unless disabled here,
+    //the scalar ones compute the same results
+    static bool isSimdAvailable();
+    void setSimdEnabled(bool enabled);
+
+    void reset(Accumulator& accumulator) const;
+    void update(Accumulator& accumulator, const CBitBoard& board, const int* queue, int queueSize) const;
+    float evaluate(const Accumulator& accumulator) const;
+    float evaluate(const Accumulator& accumulator, float* policy) const;
+
+    static int getPolicyIndex(const Placement& placement);
+
+    CNeuralEvaluator(const CNeuralEvaluator& other) = delete;
+    CNeuralEvaluator& operator=(const CNeuralEvaluator& other) = delete;
+
+private:
+    void unmap();
+    void applyFeatures(Accumulator& accumulator, const int* added, int addedCount, const int* removed, int removedCount) const;
+    void forwardLayer2(const Accumulator& accumulator, uint8_t* output) const;
+
+private:
+    const uint8_t* mData;
+    size_t mDataSize;
+    void* mFileHandle;
+    void* mMappingHandle;
+
+    const int16_t* mL1Bias;
+    const int16_t* mL1Weights;
+    const int32_t* mL2Bias;
+    const int8_t* mL2Weights;
+    const int32_t* mValueBias;
+    const int8_t* mValueWeights;
+    const int32_t* mPolicyBias;
+    const int8_t* mPolicyWeights;
+    bool mSimdEnabled;
+};
+
+}
@@ -0,0 +1,180 @@
+#include "CReplay.h"
+#include <algorithm>
+#include <fstream>
+
+namespace game
+{
+    namespace
+    {
+        const char replayMagic[4] = {'T', 'R', 'P', '1'};
+        const uint32_t replayVersion = 1;
+        const int headerFields = 9;
+        const uint32_t maxFieldSize = 256;
+        const uint32_t reservedEvents = 1 << 16;
+
+        void writeUint32(std::ostream& stream, uint32_t value)
+        {
+            const char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                                   static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+            stream.write(bytes, sizeof(bytes));
+        }
+
+        bool readUint32(std::istream& stream, uint32_t& value)
+        {
+            unsigned char bytes[4];
+            if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+            {
+                return false;
+            }
+            value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+            return true;
+        }
+    }
+
+    CReplay::CReplay()
+    : CReplay(CTetris(), 120)
+    {
+    }
+
+    CReplay::CReplay(const CTetris& game, int tickRate)
+    : mFieldWidth(game.getFieldWidth())
+    , mFieldHeight(game.getFieldHeight())
+    , mSeed(game.getSeed())
+    , mTickRate(tickRate)
+    , mPreviewSize(game.getPreviewSize())
+    , mFigureGenerator(game.getFigureGenerator())
+    , mTicksCount(0)
+    {
+    }
+
+    CTetris CReplay::createGame() const
+    {
+        CTetris game(mFieldWidth, mFieldHeight, mSeed);
+        game.setFigureGenerator(mFigureGenerator);
+        game.setPreviewSize(mPreviewSize);
+        return game;
+    }
+
+    void CReplay::reserve(size_t eventsCount)
+    {
+        mEvents.reserve(eventsCount);
+    }
+
+    void CReplay::addEvent(uint32_t tick, EGameCommand command)
+    {
+        mEvents.push_back(ReplayEvent{tick, command});
+    }
+
+    void CReplay::setTicksCount(uint32_t ticksCount)
+    {
+        mTicksCount = ticksCount;
+    }
+
+    uint32_t CReplay::getTicksCount() const
+    {
+        return mTicksCount;
+    }
+
+    int CReplay::getTickRate() const
+    {
+        return mTickRate;
+    }
+
+    const std::vector<ReplayEvent>& CReplay::getEvents() const
+    {
+        return mEvents;
+    }
+
+    void CReplay::play(const TTickCallback& onTick) const
+    {
+        CTetris game = createGame();
+        const float dt = 1.0f / mTickRate;
+        size_t next = 0;
+        for (uint32_t tick = 0; tick < mTicksCount; ++tick)
+        {
+            for (; next < mEvents.size() && mEvents[next].tick == tick; ++next)
+            {
+                CSimulationThread::applyCommand(game, mEvents[next].command);
+            }
+            game.update(dt);
+            onTick(game, tick);
+        }
+    }
+
+    bool CReplay::saveToFile(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        file.write(replayMagic, sizeof(replayMagic));
+        writeUint32(file, replayVersion);
+        writeUint32(file, static_cast<uint32_t>(mFieldWidth));
+        writeUint32(file, static_cast<uint32_t>(mFieldHeight));
+        writeUint32(file, mSeed);
+        writeUint32(file, static_cast<uint32_t>(mTickRate));
+        writeUint32(file, static_cast<uint32_t>(mPreviewSize));
+        writeUint32(file, static_cast<uint32_t>(mFigureGenerator));
+        writeUint32(file, mTicksCount);
+        writeUint32(file, static_cast<uint32_t>(mEvents.size()));
+        for (const ReplayEvent& event : mEvents)
+        {
+            writeUint32(file, event.tick);
+            file.put(static_cast<char>(event.command));
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool CReplay::loadFromFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(replayMagic)];
+        if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), replayMagic))
+        {
+            return false;
+        }
+
+        uint32_t header[headerFields];
+        for (uint32_t& value : header)
+        {
+            if (!readUint32(file, value))
+            {
+                return false;
+            }
+        }
+        if (header[0] != replayVersion || header[1] == 0 || header[1] > maxFieldSize || header[2] == 0 ||
+            header[2] > maxFieldSize || header[4] == 0 || header[5] > CTetris::mMaxPreviewSize ||
+            header[6] > static_cast<uint32_t>(EFigureGenerator::GENERATOR_BAG))
+        {
+            return false;
+        }
+
+        //The count isn't trusted for the allocation, a broken file fails on reading instead
+        std::vector<ReplayEvent> events;
+        events.reserve(std::min(header[8], reservedEvents));
+        uint32_t lastTick = 0;
+        for (uint32_t i = 0; i < header[8]; ++i)
+        {
+            uint32_t tick = 0;
+            const int command = readUint32(file, tick) ? file.get() : -1;
+            //Events must be in tick order, play() walks them once
+            if (command < 0 || command > static_cast<int>(EGameCommand::COMMAND_RESET) || tick < lastTick)
+            {
+                return false;
+            }
+            events.push_back(ReplayEvent{tick, static_cast<EGameCommand>(command)});
+            lastTick = tick;
+        }
+
+        mFieldWidth = static_cast<int>(header[1]);
+        mFieldHeight = static_cast<int>(header[2]);
+        mSeed = header[3];
+        mTickRate = static_cast<int>(header[4]);
+        mPreviewSize = static_cast<int>(header[5]);
+        mFigureGenerator = static_cast<EFigureGenerator>(header[6]);
+        mTicksCount = header[7];
+        mEvents.swap(events);
+        return true;
+    }
+}
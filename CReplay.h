@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "CSimulationThread.h"
+
+namespace game
+{
+
+struct ReplayEvent
+{
+    uint32_t tick;
+    EGameCommand command;
+};
+
+//Everything needed to play a session again: how the game was created and the commands
+//with the simulation tick they were applied at. A replay starts from a game built by createGame().
+//
+//File layout (little endian): "TRP1", uint32 version, field width, field height, seed,
+//tick rate, preview size, figure generator, ticks count, events count,
+//then per event uint32 tick and uint8 command.
+class CReplay
+{
+public:
+    using TTickCallback = std::function<void(const CTetris& game, uint32_t tick)>;
+
+    CReplay();
+    explicit CReplay(const CTetris& game, int tickRate);
+
+    CTetris createGame() const;
+    void reserve(size_t eventsCount);
+    void addEvent(uint32_t tick, EGameCommand command);
+    void setTicksCount(uint32_t ticksCount);
+    uint32_t getTicksCount() const;
+    int getTickRate() const;
+    const std::vector<ReplayEvent>& getEvents() const;
+
+    //Runs the ticks in the same order as CSimulationThread: commands, then update
+    void play(const TTickCallback& onTick) const;
+
+    bool saveToFile(const std::string& path) const;
+    bool loadFromFile(const std::string& path);
+
+private:
+    int mFieldWidth;
+    int mFieldHeight;
+    unsigned mSeed;
+    int mTickRate;
+    int mPreviewSize;
+    EFigureGenerator mFigureGenerator;
+    uint32_t mTicksCount;
+    std::vector<ReplayEvent> mEvents;
+};
+
+}
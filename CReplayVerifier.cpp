@@ -0,0 +1,168 @@
+#include "CReplayVerifier.h"
+#include <algorithm>
+
+namespace game
+{
+    CReplayVerifier::CReplayVerifier(const VerifierConfig& config, const TVerdictCallback& onVerdict)
+    : mConfig(config)
+    , mOnVerdict(onVerdict)
+    , mBusyCount(0)
+    , mStopping(false)
+    , mStats()
+    {
+        unsigned threadsCount = config.threadsCount;
+        if (threadsCount == 0)
+        {
+            threadsCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        mThreads.reserve(threadsCount);
+        for (unsigned i = 0; i < threadsCount; ++i)
+        {
+            mThreads.emplace_back(&CReplayVerifier::work, this);
+        }
+    }
+
+    CReplayVerifier::~CReplayVerifier()
+    {
+        stop();
+    }
+
+    bool CReplayVerifier::submit(ReplaySubmission submission)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQueueChanged.wait(lock, [this] { return mStopping || mQueue.size() < mConfig.maxQueued; });
+        if (mStopping)
+        {
+            return false;
+        }
+        mQueue.push_back(std::move(submission));
+        ++mStats.submitted;
+        lock.unlock();
+        mQueueChanged.notify_all();
+        return true;
+    }
+
+    void CReplayVerifier::wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdle.wait(lock, [this] { return mQueue.empty() && mBusyCount == 0; });
+    }
+
+    //Replays still in the queue are dropped without a verdict
+    void CReplayVerifier::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mQueueChanged.notify_all();
+        for (auto& thread : mThreads)
+        {
+            thread.join();
+        }
+        mThreads.clear();
+    }
+
+    VerifierStats CReplayVerifier::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    unsigned CReplayVerifier::getThreadsCount() const
+    {
+        return static_cast<unsigned>(mThreads.size());
+    }
+
+    void CReplayVerifier::work()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mQueueChanged.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+            if (mStopping)
+            {
+                return;
+            }
+
+            ReplaySubmission submission = std::move(mQueue.front());
+            mQueue.pop_front();
+            ++mBusyCount;
+            lock.unlock();
+            //A slot is free for a blocked submit()
+            mQueueChanged.notify_all();
+
+            const Verdict verdict = verify(submission, mConfig);
+            if (mOnVerdict)
+            {
+                mOnVerdict(verdict);
+            }
+
+            lock.lock();
+            --mBusyCount;
+            mStats.simulatedTicks += verdict.simulatedTicks;
+            switch (verdict.verdict)
+            {
+                case EVerdict::VERDICT_VALID:
+                    ++mStats.valid;
+                    break;
+
+                case EVerdict::VERDICT_MISMATCH:
+                    ++mStats.mismatches;
+                    break;
+
+                case EVerdict::VERDICT_REJECTED:
+                    ++mStats.rejected;
+                    break;
+            }
+            if (mQueue.empty() && mBusyCount == 0)
+            {
+                mIdle.notify_all();
+            }
+        }
+    }
+
+    //Same tick order as CReplay::play, without a callback per tick. Outside of the game only
+    //commands change the state, so the run ends early after the last command of a finished game.
+    Verdict CReplayVerifier::verify(const ReplaySubmission& submission, const VerifierConfig& config)
+    {
+        const CReplay& replay = submission.replay;
+        Verdict verdict{submission.id, EVerdict::VERDICT_REJECTED, 0, 0, 0};
+        if (replay.getTicksCount() > config.maxTicks || replay.getTickRate() <= 0 ||
+            replay.getTickRate() > config.maxTickRate)
+        {
+            return verdict;
+        }
+
+        CTetris game = replay.createGame();
+        if (game.getFieldWidth() != config.fieldWidth || game.getFieldHeight() != config.fieldHeight ||
+            game.getPreviewSize() > config.maxPreviewSize || game.getFigureGenerator() != config.figureGenerator)
+        {
+            return verdict;
+        }
+        const std::vector<ReplayEvent>& events = replay.getEvents();
+        const float dt = 1.0f / replay.getTickRate();
+        const uint32_t ticksCount = replay.getTicksCount();
+        size_t next = 0;
+        uint32_t tick = 0;
+        for (; tick < ticksCount; ++tick)
+        {
+            for (; next < events.size() && events[next].tick == tick; ++next)
+            {
+                CSimulationThread::applyCommand(game, events[next].command);
+            }
+            if (game.getGameState() != EGameState::STATE_INGAME && (next == events.size() || events[next].tick >= ticksCount))
+            {
+                break;
+            }
+            game.update(dt);
+        }
+
+        verdict.scores = game.getScores();
+        verdict.lines = game.getLines();
+        verdict.simulatedTicks = tick;
+        verdict.verdict = verdict.scores == submission.claimedScores && verdict.lines == submission.claimedLines ?
+            EVerdict::VERDICT_VALID : EVerdict::VERDICT_MISMATCH;
+        return verdict;
+    }
+}
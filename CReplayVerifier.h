@@ -0,0 +1,103 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CReplay.h"
+
+namespace game
+{
+
+enum class EVerdict
+{
+    VERDICT_VALID,
+    VERDICT_MISMATCH,
+    VERDICT_REJECTED
+};
+
+//A claimed result with the replay which has to reproduce it at its last tick
+struct ReplaySubmission
+{
+    uint64_t id;
+    CReplay replay;
+    int claimedScores;
+    int claimedLines;
+};
+
+struct Verdict
+{
+    uint64_t id;
+    EVerdict verdict;
+    int scores;
+    int lines;
+    //Ticks actually simulated, the run stops once nothing can change anymore
+    uint32_t simulatedTicks;
+};
+
+struct VerifierConfig
+{
+    unsigned threadsCount = 0;
+    size_t maxQueued = 1024;
+    //Longer replays are rejected without simulating, an hour at 120 ticks per second
+    uint32_t maxTicks = 120 * 60 * 60;
+    int maxTickRate = 240;
+    //The ranked rules, the games of tetris_server. A replay of other settings is rejected.
+    int fieldWidth = 10;
+    int fieldHeight = 20;
+    int maxPreviewSize = 1;
+    EFigureGenerator figureGenerator = EFigureGenerator::GENERATOR_RANDOM;
+};
+
+struct VerifierStats
+{
+    uint64_t submitted;
+    uint64_t valid;
+    uint64_t mismatches;
+    uint64_t rejected;
+    uint64_t simulatedTicks;
+};
+
+//Pool of threads which re-simulate submitted replays and check the claimed results.
+//The engine is deterministic (per game random generator, fixed tick), so the same
+//replay gives the same scores on every run. Verdicts are reported from the worker threads.
+class CReplayVerifier
+{
+public:
+    using TVerdictCallback = std::function<void(const Verdict& verdict)>;
+
+    CReplayVerifier(const VerifierConfig& config, const TVerdictCallback& onVerdict);
+    ~CReplayVerifier();
+
+    //Blocks while the queue is full, false after stop()
+    bool submit(ReplaySubmission submission);
+    //Returns once every submitted replay has its verdict
+    void wait();
+    void stop();
+    VerifierStats getStats() const;
+    unsigned getThreadsCount() const;
+
+    static Verdict verify(const ReplaySubmission& submission, const VerifierConfig& config);
+
+    CReplayVerifier(const CReplayVerifier& other) = delete;
+    CReplayVerifier& operator=(const CReplayVerifier& other) = delete;
+
+private:
+    void work();
+
+private:
+    const VerifierConfig mConfig;
+    const TVerdictCallback mOnVerdict;
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::condition_variable mIdle;
+    std::deque<ReplaySubmission> mQueue;
+    size_t mBusyCount;
+    bool mStopping;
+    VerifierStats mStats;
+    std::vector<std::thread> mThreads;
+};
+
+}
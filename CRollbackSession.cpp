@@ -0,0 +1,246 @@
+#include "CRollbackSession.h"
+#include "CTracer.h"
+
+namespace game
+{
+    namespace
+    {
+        const uint32_t noFrame = 0xFFFFFFFFu;
+    }
+
+    CRollbackSession::CRollbackSession(unsigned seed, int localPlayer, int tickRate)
+    : mLocalPlayer(localPlayer)
+    , mDt(1.0f / tickRate)
+    , mFrame(0)
+    , mConfirmedFrame(0)
+    , mRollbackFrame(noFrame)
+    , mGameOverFrame(noFrame)
+    , mStats{0, 0, 0}
+    {
+        //Both players get the same figures
+        for (CTetris& game : mGames)
+        {
+            game = CTetris(10, 20, seed);
+            game.setGameState(EGameState::STATE_INGAME);
+        }
+        //Snapshots start as copies, restoring one later only assigns rows of the same size
+        for (Snapshot& snapshot : mSnapshots)
+        {
+            snapshot.games = mGames;
+        }
+        mLocalInputs.fill(0);
+        mRemoteInputs.fill(0);
+        mRemoteFrames.fill(noFrame);
+        mUsedRemoteInputs.fill(0);
+        mChecksums.fill(0);
+        mChecksumFrames.fill(noFrame);
+    }
+
+    void CRollbackSession::synchronize()
+    {
+        rollback();
+    }
+
+    bool CRollbackSession::canAdvance() const
+    {
+        return mFrame < mConfirmedFrame + mMaxPredictionFrames && mRollbackFrame == noFrame && !isGameOver();
+    }
+
+    void CRollbackSession::advance(uint8_t localInput)
+    {
+        TETRIS_TRACE_SCOPE("rollback advance");
+        rollback();
+        if (isGameOver())
+        {
+            return;
+        }
+        mLocalInputs[mFrame % mRingSize] = localInput;
+        simulate(mFrame);
+        ++mFrame;
+    }
+
+    void CRollbackSession::addRemoteInput(uint32_t frame, uint8_t input)
+    {
+        //Inputs come repeated in every packet until acknowledged, only the first copy counts.
+        //Frames past the window can't be stored, the sender doesn't produce them anyway.
+        const uint32_t slot = frame % mRingSize;
+        if (frame < mConfirmedFrame || frame >= mConfirmedFrame + mRingSize || mRemoteFrames[slot] == frame)
+        {
+            return;
+        }
+        mRemoteFrames[slot] = frame;
+        mRemoteInputs[slot] = input;
+
+        //An already simulated frame with a wrong prediction has to be simulated again
+        if (frame < mFrame && mUsedRemoteInputs[slot] != input && frame < mRollbackFrame)
+        {
+            mRollbackFrame = frame;
+        }
+        while (mRemoteFrames[mConfirmedFrame % mRingSize] == mConfirmedFrame)
+        {
+            ++mConfirmedFrame;
+        }
+    }
+
+    void CRollbackSession::rollback()
+    {
+        if (mRollbackFrame == noFrame)
+        {
+            return;
+        }
+
+        TETRIS_TRACE_SCOPE("rollback");
+        const uint32_t frames = mFrame - mRollbackFrame;
+        ++mStats.rollbacks;
+        mStats.resimulatedFrames += frames;
+        mStats.maxRollbackFrames = static_cast<int>(frames) > mStats.maxRollbackFrames ? static_cast<int>(frames) : mStats.maxRollbackFrames;
+
+        //Every frame is simulated again, its local inputs were sent already. Those after a game over
+        //are simply ignored, and count again if the game over is overturned later.
+        mGames = mSnapshots[mRollbackFrame % mRingSize].games;
+        if (!isGameOver())
+        {
+            mGameOverFrame = noFrame;
+        }
+        for (uint32_t frame = mRollbackFrame; frame < mFrame; ++frame)
+        {
+            simulate(frame);
+        }
+        mRollbackFrame = noFrame;
+    }
+
+    void CRollbackSession::simulate(uint32_t frame)
+    {
+        const uint32_t slot = frame % mRingSize;
+        mSnapshots[slot].games = mGames;
+
+        const uint8_t remoteInput = mRemoteFrames[slot] == frame ? mRemoteInputs[slot] : 0;
+        mUsedRemoteInputs[slot] = remoteInput;
+
+        //Players are always stepped in the same order, so both clients compute the same frame.
+        //After a game over both games stand still.
+        if (!isGameOver())
+        {
+            int lines[mPlayersCount];
+            for (int player = 0; player < mPlayersCount; ++player)
+            {
+                CTetris& game = mGames[player];
+                lines[player] = game.getLines();
+                applyInput(game, player == mLocalPlayer ? mLocalInputs[slot] : remoteInput);
+                game.update(mDt);
+            }
+            for (int player = 0; player < mPlayersCount; ++player)
+            {
+                const int cleared = mGames[player].getLines() - lines[player];
+                if (cleared > 1)
+                {
+                    CTetris& opponent = mGames[1 - player];
+                    opponent.addGarbageLines(cleared - 1, static_cast<int>((frame * 7 + player * 3) % opponent.getFieldWidth()));
+                }
+            }
+            if (isGameOver())
+            {
+                mGameOverFrame = frame;
+            }
+        }
+
+        //The checksum is only reported once the frame is confirmed, a misprediction rewrites it
+        mChecksums[slot] = computeChecksum();
+        mChecksumFrames[slot] = frame;
+    }
+
+    void CRollbackSession::applyInput(CTetris& game, uint8_t input)
+    {
+        if (input & INPUT_ROTATE)
+        {
+            game.rotate();
+        }
+        if (input & INPUT_LEFT)
+        {
+            game.move(-1);
+        }
+        if (input & INPUT_RIGHT)
+        {
+            game.move(1);
+        }
+        if (input & INPUT_DROP)
+        {
+            game.drop();
+        }
+    }
+
+    uint32_t CRollbackSession::computeChecksum() const
+    {
+        uint32_t hash = 2166136261u;
+        auto add = [&hash](uint32_t value) {
+            hash = (hash ^ value) * 16777619u;
+        };
+        for (const CTetris& game : mGames)
+        {
+            for (const auto& row : game.getField())
+            {
+                for (int cell : row)
+                {
+                    add(static_cast<uint32_t>(cell));
+                }
+            }
+            const Point* figure = game.getCurrentFigure();
+            for (int i = 0; i < 4; ++i)
+            {
+                add(static_cast<uint32_t>(figure[i].x));
+                add(static_cast<uint32_t>(figure[i].y));
+            }
+            add(static_cast<uint32_t>(game.getScores()));
+            add(static_cast<uint32_t>(game.getGameState()));
+        }
+        return hash;
+    }
+
+    uint32_t CRollbackSession::getFrame() const
+    {
+        return mFrame;
+    }
+
+    uint32_t CRollbackSession::getConfirmedFrame() const
+    {
+        return mConfirmedFrame;
+    }
+
+    uint8_t CRollbackSession::getLocalInput(uint32_t frame) const
+    {
+        return mLocalInputs[frame % mRingSize];
+    }
+
+    uint32_t CRollbackSession::getChecksum(uint32_t frame) const
+    {
+        const uint32_t slot = frame % mRingSize;
+        const bool confirmed = frame < mConfirmedFrame && frame < mFrame && frame < mRollbackFrame;
+        return confirmed && mChecksumFrames[slot] == frame ? mChecksums[slot] : 0;
+    }
+
+    const CTetris& CRollbackSession::getGame(int player) const
+    {
+        return mGames[player];
+    }
+
+    int CRollbackSession::getLocalPlayer() const
+    {
+        return mLocalPlayer;
+    }
+
+    bool CRollbackSession::isFinished() const
+    {
+        return mGameOverFrame != noFrame && mRollbackFrame == noFrame && mConfirmedFrame > mGameOverFrame;
+    }
+
+    bool CRollbackSession::isGameOver() const
+    {
+        return mGames[0].getGameState() == EGameState::STATE_GAMEOVER ||
+               mGames[1].getGameState() == EGameState::STATE_GAMEOVER;
+    }
+
+    const RollbackStats& CRollbackSession::getStats() const
+    {
+        return mStats;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "CTetris.h"
+
+namespace game
+{
+
+//Inputs of one player for one frame, a bit per command
+enum EVersusInput
+{
+    INPUT_ROTATE = 1,
+    INPUT_LEFT = 2,
+    INPUT_RIGHT = 4,
+    INPUT_DROP = 8
+};
+
+struct RollbackStats
+{
+    uint64_t rollbacks;
+    uint64_t resimulatedFrames;
+    int maxRollbackFrames;
+};
+
+//Two player versus game with rollback in the style of GGPO. Both games are simulated on every
+//client. Missing remote inputs are predicted as "no input", and when a real input differs the
+//games are restored from the snapshot of that frame and simulated forward again.
+//Cleared lines beyond the first are sent to the opponent as garbage rows.
+class CRollbackSession
+{
+public:
+    static const int mPlayersCount = 2;
+    static const uint32_t mMaxPredictionFrames = 8;
+    static const uint32_t mRingSize = 32;
+
+    CRollbackSession(unsigned seed, int localPlayer, int tickRate);
+
+    //Re-simulates the frames whose remote inputs were mispredicted, before the state is looked at
+    void synchronize();
+    //The local side may run ahead of the confirmed remote inputs only by the prediction window.
+    //It also sends no new frames after a game over until the inputs confirm or overturn it.
+    bool canAdvance() const;
+    void advance(uint8_t localInput);
+    void addRemoteInput(uint32_t frame, uint8_t input);
+
+    uint32_t getFrame() const;
+    uint32_t getConfirmedFrame() const;
+    uint8_t getLocalInput(uint32_t frame) const;
+    //Checksum of the state after a confirmed frame, 0 if it is too old or not confirmed yet
+    uint32_t getChecksum(uint32_t frame) const;
+    const CTetris& getGame(int player) const;
+    int getLocalPlayer() const;
+    //A game over reached with confirmed inputs only, the frames after it don't matter
+    bool isFinished() const;
+    const RollbackStats& getStats() const;
+
+private:
+    struct Snapshot
+    {
+        std::array<CTetris, mPlayersCount> games;
+    };
+
+    void rollback();
+    bool isGameOver() const;
+    void simulate(uint32_t frame);
+    static void applyInput(CTetris& game, uint8_t input);
+    uint32_t computeChecksum() const;
+
+private:
+    std::array<CTetris, mPlayersCount> mGames;
+    std::array<Snapshot, mRingSize> mSnapshots;
+    std::array<uint8_t, mRingSize> mLocalInputs;
+    std::array<uint8_t, mRingSize> mRemoteInputs;
+    std::array<uint32_t, mRingSize> mRemoteFrames;
+    std::array<uint8_t, mRingSize> mUsedRemoteInputs;
+    std::array<uint32_t, mRingSize> mChecksums;
+    std::array<uint32_t, mRingSize> mChecksumFrames;
+    int mLocalPlayer;
+    float mDt;
+    uint32_t mFrame;
+    uint32_t mConfirmedFrame;
+    uint32_t mRollbackFrame;
+    uint32_t mGameOverFrame; //The frame which ended the game as simulated so far
+    RollbackStats mStats;
+};
+
+}
@@ -0,0 +1,769 @@
+#include "CServerProtocol.h"
+#include <algorithm>
+
+namespace game
+{
+    namespace
+    {
+        void putUint16(std::vector<uint8_t>& output, uint32_t value)
+        {
+            output.push_back(static_cast<uint8_t>(value));
+            output.push_back(static_cast<uint8_t>(value >> 8));
+        }
+
+        void putUint32(std::vector<uint8_t>& output, uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                output.push_back(static_cast<uint8_t>(value >> (i * 8)));
+            }
+        }
+
+        uint32_t getUint16(const uint8_t* data)
+        {
+            return data[0] | (data[1] << 8);
+        }
+
+        uint32_t getUint32(const uint8_t* data)
+        {
+            return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+        }
+
+        //Little endian base 128, zigzag for signed values
+        void putVarint(std::vector<uint8_t>& output, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                output.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            output.push_back(static_cast<uint8_t>(value));
+        }
+
+        uint32_t toZigzag(int32_t value)
+        {
+            return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        }
+
+        int32_t fromZigzag(uint32_t value)
+        {
+            return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+        }
+
+        //Bounds checked reading of a payload, every read fails once the data is exhausted
+        class CPayloadReader
+        {
+        public:
+            CPayloadReader(const uint8_t* data, size_t size)
+            : mData(data)
+            , mSize(size)
+            , mOffset(0)
+            , mBits(0)
+            , mBitsCount(0)
+            {
+            }
+
+            bool readByte(uint32_t& value)
+            {
+                if (mOffset >= mSize)
+                {
+                    return false;
+                }
+                value = mData[mOffset++];
+                return true;
+            }
+
+            bool readUint16(uint32_t& value)
+            {
+                if (mSize - mOffset < 2)
+                {
+                    return false;
+                }
+                value = getUint16(mData + mOffset);
+                mOffset += 2;
+                return true;
+            }
+
+            bool readUint32(uint32_t& value)
+            {
+                if (mSize - mOffset < 4)
+                {
+                    return false;
+                }
+                value = getUint32(mData + mOffset);
+                mOffset += 4;
+                return true;
+            }
+
+            bool readVarint(uint32_t& value)
+            {
+                value = 0;
+                for (int shift = 0; shift < 35; shift += 7)
+                {
+                    uint32_t byte = 0;
+                    if (!readByte(byte))
+                    {
+                        return false;
+                    }
+                    value |= (byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            //Bits are taken from the lowest bit of each byte first
+            bool readBits(int count, uint32_t& value)
+            {
+                while (mBitsCount < count)
+                {
+                    uint32_t byte = 0;
+                    if (!readByte(byte))
+                    {
+                        return false;
+                    }
+                    mBits |= static_cast<uint64_t>(byte) << mBitsCount;
+                    mBitsCount += 8;
+                }
+                value = static_cast<uint32_t>(mBits & ((1ull << count) - 1));
+                mBits >>= count;
+                mBitsCount -= count;
+                return true;
+            }
+
+            void alignToByte()
+            {
+                mBits = 0;
+                mBitsCount = 0;
+            }
+
+            bool isAtEnd() const
+            {
+                return mOffset == mSize;
+            }
+
+        private:
+            const uint8_t* mData;
+            size_t mSize;
+            size_t mOffset;
+            uint64_t mBits;
+            int mBitsCount;
+        };
+
+        class CBitWriter
+        {
+        public:
+            explicit CBitWriter(std::vector<uint8_t>& output)
+            : mOutput(output)
+            , mBits(0)
+            , mBitsCount(0)
+            {
+            }
+
+            void write(uint32_t value, int count)
+            {
+                mBits |= static_cast<uint64_t>(value) << mBitsCount;
+                mBitsCount += count;
+                while (mBitsCount >= 8)
+                {
+                    mOutput.push_back(static_cast<uint8_t>(mBits));
+                    mBits >>= 8;
+                    mBitsCount -= 8;
+                }
+            }
+
+            void flush()
+            {
+                if (mBitsCount > 0)
+                {
+                    mOutput.push_back(static_cast<uint8_t>(mBits));
+                }
+                mBits = 0;
+                mBitsCount = 0;
+            }
+
+        private:
+            std::vector<uint8_t>& mOutput;
+            uint64_t mBits;
+            int mBitsCount;
+        };
+
+        const size_t inputSize = 5;
+        const size_t welcomeSize = 12;
+        const size_t spectateSize = 4;
+        const int colorBits = 3;
+
+        enum EDeltaFlags
+        {
+            DELTA_STATE = 1,
+            DELTA_SCORES = 2,
+            DELTA_LINES = 4,
+            DELTA_FIGURE = 8,
+            DELTA_REMOVED_ROWS = 16,
+            DELTA_ROWS = 32
+        };
+
+        //Cell 0 position, offsets of the other cells in -3..3 and the colour: 4 + 6 + 18 + 3 bits
+        uint32_t packFigure(const BoardState& state)
+        {
+            const Point* figure = state.figure;
+            uint32_t packed = static_cast<uint32_t>(figure[0].x & 0xF) | (static_cast<uint32_t>((figure[0].y + 4) & 0x3F) << 4);
+            for (int i = 1; i < 4; ++i)
+            {
+                const uint32_t dx = static_cast<uint32_t>(figure[i].x - figure[0].x + 3) & 7;
+                const uint32_t dy = static_cast<uint32_t>(figure[i].y - figure[0].y + 3) & 7;
+                packed |= (dx | (dy << 3)) << (10 + (i - 1) * 6);
+            }
+            return packed | (static_cast<uint32_t>(state.figureColor & 7) << 28);
+        }
+
+        void unpackFigure(uint32_t packed, BoardState& state)
+        {
+            state.figure[0].x = static_cast<int>(packed & 0xF);
+            state.figure[0].y = static_cast<int>((packed >> 4) & 0x3F) - 4;
+            for (int i = 1; i < 4; ++i)
+            {
+                const uint32_t offsets = packed >> (10 + (i - 1) * 6);
+                state.figure[i].x = state.figure[0].x + static_cast<int>(offsets & 7) - 3;
+                state.figure[i].y = state.figure[0].y + static_cast<int>((offsets >> 3) & 7) - 3;
+            }
+            state.figureColor = static_cast<int>((packed >> 28) & 7);
+        }
+
+        bool isFigureEqual(const BoardState& a, const BoardState& b)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                if (a.figure[i].x != b.figure[i].x || a.figure[i].y != b.figure[i].y)
+                {
+                    return false;
+                }
+            }
+            return a.figureColor == b.figureColor;
+        }
+
+        const uint8_t* getRow(const BoardState& state, int row)
+        {
+            return state.cells + row * state.width;
+        }
+
+        bool isRowEqual(const uint8_t* a, const uint8_t* b, int width)
+        {
+            return std::equal(a, a + width, b);
+        }
+
+        bool isRowEmpty(const uint8_t* row, int width)
+        {
+            return std::all_of(row, row + width, [](uint8_t cell) { return cell == 0; });
+        }
+
+        //A row is a bit per cell, then the colours of the set cells
+        void writeRow(CBitWriter& writer, const uint8_t* row, int width)
+        {
+            uint32_t mask = 0;
+            for (int j = 0; j < width; ++j)
+            {
+                mask |= row[j] ? 1u << j : 0;
+            }
+            writer.write(mask, width);
+            for (int j = 0; j < width; ++j)
+            {
+                if (row[j])
+                {
+                    writer.write(row[j] & 7, colorBits);
+                }
+            }
+        }
+
+        bool readRow(CPayloadReader& reader, uint8_t* row, int width)
+        {
+            uint32_t mask = 0;
+            if (!reader.readBits(width, mask))
+            {
+                return false;
+            }
+            for (int j = 0; j < width; ++j)
+            {
+                uint32_t color = 0;
+                if ((mask >> j) & 1)
+                {
+                    if (!reader.readBits(colorBits, color))
+                    {
+                        return false;
+                    }
+                }
+                row[j] = static_cast<uint8_t>(color);
+            }
+            return true;
+        }
+
+        int getRowBits(const uint8_t* row, int width)
+        {
+            int bits = width + 1;
+            for (int j = 0; j < width; ++j)
+            {
+                bits += row[j] ? colorBits : 0;
+            }
+            return bits;
+        }
+
+        //Rows removed from the previous board so that the least rows have to be sent. Line clears
+        //remove rows and shift the ones above down, so the boards are aligned from the bottom:
+        //a kept row is matched with the next new row, a removed one costs its index byte,
+        //and the new rows left at the top are compared with inserted empty rows.
+        uint32_t findRemovedRows(const BoardState& base, const BoardState& state)
+        {
+            const int width = state.width;
+            const int height = state.height;
+            const int removeCost = 8;
+            const int unset = 1 << 30;
+            int cost[BoardState::mMaxHeight + 1][BoardState::mMaxHeight + 1];
+            for (auto& row : cost)
+            {
+                std::fill(row, row + BoardState::mMaxHeight + 1, unset);
+            }
+
+            //cost[i][j]: the bottom i new rows are matched after taking the bottom j old rows
+            cost[0][0] = 0;
+            for (int j = 0; j < height; ++j)
+            {
+                const uint8_t* oldRow = getRow(base, height - 1 - j);
+                for (int i = 0; i <= j; ++i)
+                {
+                    if (cost[i][j] == unset)
+                    {
+                        continue;
+                    }
+                    const uint8_t* newRow = getRow(state, height - 1 - i);
+                    const int match = cost[i][j] + (isRowEqual(oldRow, newRow, width) ? 0 : getRowBits(newRow, width));
+                    cost[i + 1][j + 1] = std::min(cost[i + 1][j + 1], match);
+                    cost[i][j + 1] = std::min(cost[i][j + 1], cost[i][j] + removeCost);
+                }
+            }
+
+            int bestKept = height;
+            int bestCost = unset;
+            int topCost = 0;
+            for (int i = height; i >= 0; --i)
+            {
+                if (i < height)
+                {
+                    const uint8_t* newRow = getRow(state, height - 1 - i);
+                    topCost += isRowEmpty(newRow, width) ? 0 : getRowBits(newRow, width);
+                }
+                if (cost[i][height] != unset && cost[i][height] + topCost < bestCost)
+                {
+                    bestCost = cost[i][height] + topCost;
+                    bestKept = i;
+                }
+            }
+
+            //Walk back from the best end, a step which didn't match an old row removed it
+            uint32_t removed = 0;
+            int i = bestKept;
+            for (int j = height; j > 0; --j)
+            {
+                const uint8_t* oldRow = getRow(base, height - j);
+                if (i > 0)
+                {
+                    const uint8_t* newRow = getRow(state, height - i);
+                    const int match = cost[i - 1][j - 1] + (isRowEqual(oldRow, newRow, width) ? 0 : getRowBits(newRow, width));
+                    if (cost[i - 1][j - 1] != unset && match == cost[i][j])
+                    {
+                        --i;
+                        continue;
+                    }
+                }
+                removed |= 1u << (height - j);
+            }
+            return removed;
+        }
+
+        //Removes the rows of the mask, the rows above move down and empty rows fill the top
+        void removeRows(BoardState& state, uint32_t removed)
+        {
+            const int width = state.width;
+            int to = state.height - 1;
+            for (int from = state.height - 1; from >= 0; --from)
+            {
+                if ((removed >> from) & 1)
+                {
+                    continue;
+                }
+                if (to != from)
+                {
+                    std::copy(state.cells + from * width, state.cells + (from + 1) * width, state.cells + to * width);
+                }
+                --to;
+            }
+            for (; to >= 0; --to)
+            {
+                std::fill(state.cells + to * width, state.cells + (to + 1) * width, 0);
+            }
+        }
+    }
+
+    uint16_t BoardState::getChecksum() const
+    {
+        //FNV-1a over everything a delta changes, folded to 16 bits
+        uint32_t hash = 2166136261u;
+        auto add = [&hash](uint32_t value) {
+            hash = (hash ^ value) * 16777619u;
+        };
+        for (int i = 0; i < width * height; ++i)
+        {
+            add(cells[i]);
+        }
+        for (const Point& cell : figure)
+        {
+            add(static_cast<uint32_t>(cell.x));
+            add(static_cast<uint32_t>(cell.y));
+        }
+        add(static_cast<uint32_t>(figureColor));
+        add(static_cast<uint32_t>(state));
+        add(static_cast<uint32_t>(scores));
+        add(static_cast<uint32_t>(lines));
+        return static_cast<uint16_t>(hash ^ (hash >> 16));
+    }
+
+    void BoardState::load(const CTetris& game, uint32_t stateTick, uint32_t stateLastInput)
+    {
+        tick = stateTick;
+        lastInput = stateLastInput;
+        state = game.getGameState();
+        scores = game.getScores();
+        lines = game.getLines();
+        width = game.getFieldWidth() < mMaxWidth ? game.getFieldWidth() : mMaxWidth;
+        height = game.getFieldHeight() < mMaxHeight ? game.getFieldHeight() : mMaxHeight;
+        figureColor = game.getFigureColor();
+        const Point* current = game.getCurrentFigure();
+        for (int i = 0; i < 4; ++i)
+        {
+            figure[i] = current[i];
+        }
+        const TFieldType& field = game.getField();
+        for (int i = 0; i < height; ++i)
+        {
+            for (int j = 0; j < width; ++j)
+            {
+                cells[i * width + j] = static_cast<uint8_t>(field[i][j]);
+            }
+        }
+    }
+
+    size_t CServerProtocol::beginMessage(std::vector<uint8_t>& output, EMessageType type)
+    {
+        const size_t start = output.size();
+        putUint16(output, 0);
+        output.push_back(static_cast<uint8_t>(type));
+        return start;
+    }
+
+    void CServerProtocol::endMessage(std::vector<uint8_t>& output, size_t start)
+    {
+        const size_t size = output.size() - start - 2;
+        output[start] = static_cast<uint8_t>(size);
+        output[start + 1] = static_cast<uint8_t>(size >> 8);
+    }
+
+    void CServerProtocol::writeInput(std::vector<uint8_t>& output, const InputMessage& input)
+    {
+        const size_t start = beginMessage(output, EMessageType::MESSAGE_INPUT);
+        putUint32(output, input.sequence);
+        output.push_back(static_cast<uint8_t>(input.command));
+        endMessage(output, start);
+    }
+
+    void CServerProtocol::writeWelcome(std::vector<uint8_t>& output, const WelcomeMessage& welcome)
+    {
+        const size_t start = beginMessage(output, EMessageType::MESSAGE_WELCOME);
+        putUint32(output, welcome.sessionId);
+        putUint32(output, welcome.seed);
+        output.push_back(static_cast<uint8_t>(welcome.fieldWidth));
+        output.push_back(static_cast<uint8_t>(welcome.fieldHeight));
+        putUint16(output, static_cast<uint32_t>(welcome.tickRate));
+        endMessage(output, start);
+    }
+
+    void CServerProtocol::writeKeyframe(std::vector<uint8_t>& output, const BoardState& state)
+    {
+        const size_t start = beginMessage(output, EMessageType::MESSAGE_KEYFRAME);
+        putUint32(output, state.tick);
+        putUint32(output, state.lastInput);
+        output.push_back(static_cast<uint8_t>(state.state));
+        putUint32(output, static_cast<uint32_t>(state.scores));
+        putUint32(output, static_cast<uint32_t>(state.lines));
+        output.push_back(static_cast<uint8_t>(state.width));
+        output.push_back(static_cast<uint8_t>(state.height));
+        putUint32(output, packFigure(state));
+        CBitWriter writer(output);
+        for (int i = 0; i < state.height; ++i)
+        {
+            writeRow(writer, getRow(state, i), state.width);
+        }
+        writer.flush();
+        endMessage(output, start);
+    }
+
+    void CServerProtocol::writeDelta(std::vector<uint8_t>& output, const BoardState& base, const BoardState& state)
+    {
+        const size_t start = beginMessage(output, EMessageType::MESSAGE_DELTA);
+        putVarint(output, state.tick - base.tick);
+        putVarint(output, state.lastInput - base.lastInput);
+
+        const int cellsCount = state.width * state.height;
+        const bool cellsChanged = !std::equal(state.cells, state.cells + cellsCount, base.cells);
+        const uint32_t removed = cellsChanged ? findRemovedRows(base, state) : 0;
+        int flags = (state.state != base.state ? DELTA_STATE : 0) |
+                    (state.scores != base.scores ? DELTA_SCORES : 0) |
+                    (state.lines != base.lines ? DELTA_LINES : 0) |
+                    (!isFigureEqual(state, base) ? DELTA_FIGURE : 0) |
+                    (removed ? DELTA_REMOVED_ROWS : 0);
+
+        //Rows are compared with the previous board after the removal, as the client sees it
+        BoardState shifted;
+        uint32_t changedRows = 0;
+        if (cellsChanged)
+        {
+            shifted.width = base.width;
+            shifted.height = base.height;
+            std::copy(base.cells, base.cells + cellsCount, shifted.cells);
+            removeRows(shifted, removed);
+            for (int i = 0; i < state.height; ++i)
+            {
+                if (!isRowEqual(getRow(shifted, i), getRow(state, i), state.width))
+                {
+                    changedRows |= 1u << i;
+                }
+            }
+            flags |= changedRows ? DELTA_ROWS : 0;
+        }
+
+        output.push_back(static_cast<uint8_t>(flags));
+        if (flags & DELTA_STATE)
+        {
+            output.push_back(static_cast<uint8_t>(state.state));
+        }
+        if (flags & DELTA_SCORES)
+        {
+            putVarint(output, toZigzag(state.scores - base.scores));
+        }
+        if (flags & DELTA_LINES)
+        {
+            putVarint(output, toZigzag(state.lines - base.lines));
+        }
+        if (flags & DELTA_FIGURE)
+        {
+            putUint32(output, packFigure(state));
+        }
+        if (flags & DELTA_REMOVED_ROWS)
+        {
+            putVarint(output, removed);
+        }
+        if (flags & DELTA_ROWS)
+        {
+            putVarint(output, changedRows);
+            CBitWriter writer(output);
+            for (int i = 0; i < state.height; ++i)
+            {
+                if ((changedRows >> i) & 1)
+                {
+                    writeRow(writer, getRow(state, i), state.width);
+                }
+            }
+            writer.flush();
+        }
+        putUint16(output, state.getChecksum());
+        endMessage(output, start);
+    }
+
+    void CServerProtocol::writeResync(std::vector<uint8_t>& output)
+    {
+        endMessage(output, beginMessage(output, EMessageType::MESSAGE_RESYNC));
+    }
+
+    void CServerProtocol::writeSpectate(std::vector<uint8_t>& output, const SpectateMessage& spectate)
+    {
+        const size_t start = beginMessage(output, EMessageType::MESSAGE_SPECTATE);
+        putUint32(output, spectate.sessionId);
+        endMessage(output, start);
+    }
+
+    int CServerProtocol::parseMessage(const uint8_t* data, size_t size, MessageView& message)
+    {
+        if (size < 2)
+        {
+            return 0;
+        }
+        const size_t messageSize = getUint16(data);
+        if (messageSize < 1 || messageSize > mMaxMessageSize)
+        {
+            return -1;
+        }
+        if (size < messageSize + 2)
+        {
+            return 0;
+        }
+        message.type = static_cast<EMessageType>(data[2]);
+        message.payload = data + mHeaderSize;
+        message.size = messageSize - 1;
+        return static_cast<int>(messageSize + 2);
+    }
+
+    bool CServerProtocol::readInput(const MessageView& message, InputMessage& input)
+    {
+        if (message.type != EMessageType::MESSAGE_INPUT || message.size != inputSize ||
+            message.payload[4] > static_cast<uint8_t>(EGameCommand::COMMAND_RESET))
+        {
+            return false;
+        }
+        input.sequence = getUint32(message.payload);
+        input.command = static_cast<EGameCommand>(message.payload[4]);
+        return true;
+    }
+
+    bool CServerProtocol::readWelcome(const MessageView& message, WelcomeMessage& welcome)
+    {
+        if (message.type != EMessageType::MESSAGE_WELCOME || message.size != welcomeSize)
+        {
+            return false;
+        }
+        welcome.sessionId = getUint32(message.payload);
+        welcome.seed = getUint32(message.payload + 4);
+        welcome.fieldWidth = message.payload[8];
+        welcome.fieldHeight = message.payload[9];
+        welcome.tickRate = static_cast<int>(getUint16(message.payload + 10));
+        return true;
+    }
+
+    bool CServerProtocol::readSpectate(const MessageView& message, SpectateMessage& spectate)
+    {
+        if (message.type != EMessageType::MESSAGE_SPECTATE || message.size != spectateSize)
+        {
+            return false;
+        }
+        spectate.sessionId = getUint32(message.payload);
+        return true;
+    }
+
+    bool CServerProtocol::readKeyframe(const MessageView& message, BoardState& state)
+    {
+        if (message.type != EMessageType::MESSAGE_KEYFRAME)
+        {
+            return false;
+        }
+        CPayloadReader reader(message.payload, message.size);
+        uint32_t tick = 0;
+        uint32_t lastInput = 0;
+        uint32_t gameState = 0;
+        uint32_t scores = 0;
+        uint32_t lines = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t figure = 0;
+        if (!reader.readUint32(tick) || !reader.readUint32(lastInput) || !reader.readByte(gameState) ||
+            !reader.readUint32(scores) || !reader.readUint32(lines) || !reader.readByte(width) ||
+            !reader.readByte(height) || !reader.readUint32(figure) ||
+            gameState > static_cast<uint32_t>(EGameState::STATE_GAMEOVER) ||
+            width > BoardState::mMaxWidth || height > BoardState::mMaxHeight)
+        {
+            return false;
+        }
+        state.tick = tick;
+        state.lastInput = lastInput;
+        state.state = static_cast<EGameState>(gameState);
+        state.scores = static_cast<int32_t>(scores);
+        state.lines = static_cast<int32_t>(lines);
+        state.width = static_cast<int>(width);
+        state.height = static_cast<int>(height);
+        unpackFigure(figure, state);
+        for (int i = 0; i < state.height; ++i)
+        {
+            if (!readRow(reader, state.cells + i * state.width, state.width))
+            {
+                return false;
+            }
+        }
+        return reader.isAtEnd();
+    }
+
+    bool CServerProtocol::applyDelta(const MessageView& message, BoardState& state)
+    {
+        if (message.type != EMessageType::MESSAGE_DELTA)
+        {
+            return false;
+        }
+        CPayloadReader reader(message.payload, message.size);
+        uint32_t tickDelta = 0;
+        uint32_t inputDelta = 0;
+        uint32_t flags = 0;
+        if (!reader.readVarint(tickDelta) || !reader.readVarint(inputDelta) || !reader.readByte(flags))
+        {
+            return false;
+        }
+        state.tick += tickDelta;
+        state.lastInput += inputDelta;
+
+        uint32_t value = 0;
+        if (flags & DELTA_STATE)
+        {
+            if (!reader.readByte(value) || value > static_cast<uint32_t>(EGameState::STATE_GAMEOVER))
+            {
+                return false;
+            }
+            state.state = static_cast<EGameState>(value);
+        }
+        if (flags & DELTA_SCORES)
+        {
+            if (!reader.readVarint(value))
+            {
+                return false;
+            }
+            state.scores += fromZigzag(value);
+        }
+        if (flags & DELTA_LINES)
+        {
+            if (!reader.readVarint(value))
+            {
+                return false;
+            }
+            state.lines += fromZigzag(value);
+        }
+        if (flags & DELTA_FIGURE)
+        {
+            if (!reader.readUint32(value))
+            {
+                return false;
+            }
+            unpackFigure(value, state);
+        }
+        if (flags & DELTA_REMOVED_ROWS)
+        {
+            if (!reader.readVarint(value))
+            {
+                return false;
+            }
+            removeRows(state, value);
+        }
+        if (flags & DELTA_ROWS)
+        {
+            uint32_t changedRows = 0;
+            if (!reader.readVarint(changedRows))
+            {
+                return false;
+            }
+            for (int i = 0; i < state.height; ++i)
+            {
+                if (((changedRows >> i) & 1) && !readRow(reader, state.cells + i * state.width, state.width))
+                {
+                    return false;
+                }
+            }
+            reader.alignToByte();
+        }
+        uint32_t checksum = 0;
+        return reader.readUint16(checksum) && reader.isAtEnd() && checksum == state.getChecksum();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CSimulationThread.h"
+
+namespace game
+{
+
+enum class EMessageType
+{
+    MESSAGE_INPUT = 1,
+    MESSAGE_WELCOME,
+    MESSAGE_KEYFRAME,
+    MESSAGE_DELTA,
+    MESSAGE_RESYNC,
+    MESSAGE_SPECTATE
+};
+
+struct MessageView
+{
+    EMessageType type;
+    const uint8_t* payload;
+    size_t size;
+};
+
+struct InputMessage
+{
+    uint32_t sequence;
+    EGameCommand command;
+};
+
+struct SpectateMessage
+{
+    uint32_t sessionId;
+};
+
+struct WelcomeMessage
+{
+    uint32_t sessionId;
+    uint32_t seed;
+    int fieldWidth;
+    int fieldHeight;
+    int tickRate;
+};
+
+//Everything a client needs to draw a game, the cells hold the colours of the settled blocks
+struct BoardState
+{
+    static const int mMaxWidth = 16;
+    static const int mMaxHeight = 32;
+
+    uint32_t tick;
+    uint32_t lastInput;
+    EGameState state;
+    int32_t scores;
+    int32_t lines;
+    int width;
+    int height;
+    int figureColor;
+    Point figure[4];
+    uint8_t cells[mMaxWidth * mMaxHeight];
+
+    void load(const CTetris& game, uint32_t tick, uint32_t lastInput);
+    uint16_t getChecksum() const;
+};
+
+//Messages between tetris_server and its clients. Every message is framed as a little endian
+//uint16 size of the rest, a uint8 type and the payload. Clients send only inputs, the server
+//simulates the game and answers with states which acknowledge the last applied input sequence.
+//
+//A keyframe holds the whole state and goes out on join or when the client asks for a resync.
+//Later states are deltas against the previous one on the same connection:
+//  varint tick and last input differences, uint8 flags of the changed parts,
+//  game state, zigzag varint scores and lines differences,
+//  figure in 31 bits (x, y, offsets of the other cells, colour),
+//  removed rows of the previous board (line clears), then a varint mask of changed rows and
+//  for each of them a bit per cell plus 3 colour bits per set cell, and a uint16 checksum.
+//The client applies a delta to its copy and asks for a keyframe when the checksum differs.
+//
+//Spectators connect to the spectator port and send one spectate message with the session id
+//to watch. They get the same keyframes and deltas as the player, and may ask for a resync.
+class CServerProtocol
+{
+public:
+    static const size_t mHeaderSize = 3;
+    static const size_t mMaxMessageSize = 2048;
+
+    static void writeInput(std::vector<uint8_t>& output, const InputMessage& input);
+    static void writeWelcome(std::vector<uint8_t>& output, const WelcomeMessage& welcome);
+    static void writeKeyframe(std::vector<uint8_t>& output, const BoardState& state);
+    static void writeDelta(std::vector<uint8_t>& output, const BoardState& base, const BoardState& state);
+    static void writeResync(std::vector<uint8_t>& output);
+    static void writeSpectate(std::vector<uint8_t>& output, const SpectateMessage& spectate);
+
+    //Returns the bytes taken by the message, 0 when it isn't complete yet and -1 when it is malformed
+    static int parseMessage(const uint8_t* data, size_t size, MessageView& message);
+    static bool readInput(const MessageView& message, InputMessage& input);
+    static bool readWelcome(const MessageView& message, WelcomeMessage& welcome);
+    static bool readSpectate(const MessageView& message, SpectateMessage& spectate);
+    static bool readKeyframe(const MessageView& message, BoardState& state);
+    //Applies the delta to the previous state, fails on malformed data or a checksum mismatch
+    static bool applyDelta(const MessageView& message, BoardState& state);
+
+private:
+    static size_t beginMessage(std::vector<uint8_t>& output, EMessageType type);
+    static void endMessage(std::vector<uint8_t>& output, size_t start);
+};
+
+}
@@ -0,0 +1,1020 @@
+#include "CServerShard.h"
+#include "CTracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace game
+{
+    namespace
+    {
+        int openListener(const std::string& host, int port)
+        {
+            const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                return -1;
+            }
+            const int enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(port));
+            if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+                bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                listen(fd, SOMAXCONN) != 0)
+            {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        //Accepts one connection, -1 when there are no more for now
+        int acceptConnection(int listener, std::atomic<uint64_t>& errors)
+        {
+            while (true)
+            {
+                const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd >= 0)
+                {
+                    const int enable = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+                    return fd;
+                }
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                return -1;
+            }
+        }
+    }
+
+    CServerShard::CServerShard(const ServerConfig& config, unsigned index)
+    : mConfig(config)
+    , mIndex(index)
+    , mListener(-1)
+    , mEpoll(-1)
+    , mSpectatorListener{EConnectionType::CONNECTION_SPECTATOR_LISTENER, -1, false}
+    , mHandoffEvent{EConnectionType::CONNECTION_HANDOFF, -1, false}
+    , mLeaderboard(nullptr)
+    , mRunning(false)
+    , mRandom(std::random_device()())
+    , mNextSessionId(index)
+    , mTick(0)
+    , mClosedCount(0)
+    , mClosedSpectatorsCount(0)
+    , mSpectatorFlushTicks(1)
+    , mState()
+    , mSessionsCount(0)
+    , mTicks(0)
+    , mLateTicks(0)
+    , mMaxTickMicros(0)
+    , mInputs(0)
+    , mStates(0)
+    , mBytesSent(0)
+    , mErrors(0)
+    , mSpectatorsCount(0)
+    , mBroadcasts(0)
+    , mSkippedFrames(0)
+    , mSessionUpdates(0)
+    {
+        //Half of the queue is left for frames which wait for a slow socket
+        const int flushTicks = config.spectatorFlushRate > 0 ? config.tickRate / config.spectatorFlushRate : 1;
+        const int maxFlushTicks = static_cast<int>(mSpectatorQueueLimit / 2);
+        mSpectatorFlushTicks = static_cast<uint32_t>(flushTicks < 1 ? 1 : (flushTicks > maxFlushTicks ? maxFlushTicks : flushTicks));
+    }
+
+    CServerShard::~CServerShard()
+    {
+        stop();
+        for (auto& session : mSessions)
+        {
+            close(session->fd);
+        }
+        for (auto& spectator : mSpectators)
+        {
+            if (spectator->fd >= 0)
+            {
+                close(spectator->fd);
+            }
+        }
+        for (auto& handoff : mHandoffs)
+        {
+            close(handoff.first);
+        }
+        for (int fd : {mListener, mSpectatorListener.fd, mHandoffEvent.fd})
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        if (mEpoll >= 0)
+        {
+            close(mEpoll);
+        }
+    }
+
+    bool CServerShard::open()
+    {
+        mListener = openListener(mConfig.address, mConfig.port);
+        mEpoll = epoll_create1(EPOLL_CLOEXEC);
+        mHandoffEvent.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (mListener < 0 || mEpoll < 0 || mHandoffEvent.fd < 0)
+        {
+            return false;
+        }
+        //The listener is the only registration without a connection pointer
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, mListener, &event) != 0)
+        {
+            return false;
+        }
+        event.data.ptr = &mHandoffEvent;
+        if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, mHandoffEvent.fd, &event) != 0)
+        {
+            return false;
+        }
+        if (mConfig.spectatorPort > 0)
+        {
+            mSpectatorListener.fd = openListener(mConfig.address, mConfig.spectatorPort);
+            event.data.ptr = &mSpectatorListener;
+            if (mSpectatorListener.fd < 0 || epoll_ctl(mEpoll, EPOLL_CTL_ADD, mSpectatorListener.fd, &event) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CServerShard::setShards(const std::vector<CServerShard*>& shards)
+    {
+        mShards = shards;
+    }
+
+    void CServerShard::setLeaderboard(CLeaderboard* leaderboard)
+    {
+        mLeaderboard = leaderboard;
+    }
+
+    void CServerShard::start()
+    {
+        if (!mRunning.exchange(true))
+        {
+            mThread = std::thread(&CServerShard::run, this);
+        }
+    }
+
+    void CServerShard::stop()
+    {
+        if (mRunning.exchange(false))
+        {
+            mThread.join();
+        }
+    }
+
+    ShardStats CServerShard::getStats() const
+    {
+        return ShardStats{mSessionsCount.load(std::memory_order_relaxed), mTicks.load(std::memory_order_relaxed),
+                          mLateTicks.load(std::memory_order_relaxed), mMaxTickMicros.load(std::memory_order_relaxed),
+                          mInputs.load(std::memory_order_relaxed), mStates.load(std::memory_order_relaxed),
+                          mBytesSent.load(std::memory_order_relaxed), mErrors.load(std::memory_order_relaxed),
+                          mSpectatorsCount.load(std::memory_order_relaxed), mBroadcasts.load(std::memory_order_relaxed),
+                          mSkippedFrames.load(std::memory_order_relaxed), mSessionUpdates.load(std::memory_order_relaxed)};
+    }
+
+    void CServerShard::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto tickTime = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / mConfig.tickRate));
+        auto nextTick = Clock::now() + tickTime;
+        epoll_event events[mEventsCapacity];
+
+        while (mRunning.load(std::memory_order_relaxed))
+        {
+            //Wait for sockets until the next tick is due, rounding the timeout up to whole milliseconds
+            const auto wait = nextTick - Clock::now();
+            const int timeout = wait.count() > 0 ?
+                static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(wait).count() + 999) / 1000 : 0;
+            const int count = epoll_wait(mEpoll, events, mEventsCapacity, timeout);
+            for (int i = 0; i < count; ++i)
+            {
+                Connection* connection = static_cast<Connection*>(events[i].data.ptr);
+                if (!connection)
+                {
+                    acceptSessions();
+                    continue;
+                }
+                if (connection->closed)
+                {
+                    continue;
+                }
+                const bool failed = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+                const bool readable = (events[i].events & EPOLLIN) != 0;
+                const bool writable = (events[i].events & EPOLLOUT) != 0;
+                switch (connection->type)
+                {
+                    case EConnectionType::CONNECTION_SESSION:
+                    {
+                        Session& session = static_cast<Session&>(*connection);
+                        if (failed)
+                        {
+                            closeSession(session);
+                            break;
+                        }
+                        if (readable)
+                        {
+                            readSession(session);
+                        }
+                        if (writable && !session.closed)
+                        {
+                            flushSession(session);
+                        }
+                        break;
+                    }
+
+                    case EConnectionType::CONNECTION_SPECTATOR:
+                    {
+                        Spectator& spectator = static_cast<Spectator&>(*connection);
+                        if (failed)
+                        {
+                            closeSpectator(spectator);
+                            break;
+                        }
+                        if (readable)
+                        {
+                            readSpectator(spectator);
+                        }
+                        if (writable && !spectator.closed)
+                        {
+                            flushSpectator(spectator);
+                        }
+                        break;
+                    }
+
+                    case EConnectionType::CONNECTION_SPECTATOR_LISTENER:
+                        acceptSpectators();
+                        break;
+
+                    case EConnectionType::CONNECTION_HANDOFF:
+                        receiveHandoffs();
+                        break;
+                }
+            }
+
+            const auto now = Clock::now();
+            if (now >= nextTick)
+            {
+                tick();
+                const auto tickMicros = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - now).count());
+                if (tickMicros > mMaxTickMicros.load(std::memory_order_relaxed))
+                {
+                    mMaxTickMicros.store(tickMicros, std::memory_order_relaxed);
+                }
+                if (now - nextTick > tickTime)
+                {
+                    mLateTicks.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                //Like the simulation thread: a fixed schedule, started over after a stall longer than a second
+                nextTick += tickTime;
+                if (nextTick < now - tickTime * mConfig.tickRate)
+                {
+                    nextTick = now + tickTime;
+                }
+            }
+            removeClosedSpectators();
+            removeClosedSessions();
+        }
+    }
+
+    void CServerShard::acceptSessions()
+    {
+        for (int fd = acceptConnection(mListener, mErrors); fd >= 0; fd = acceptConnection(mListener, mErrors))
+        {
+            const uint32_t seed = static_cast<uint32_t>(mRandom());
+            auto session = std::make_unique<Session>();
+            session->type = EConnectionType::CONNECTION_SESSION;
+            session->fd = fd;
+            session->id = mNextSessionId;
+            session->updatedTick = mTick;
+            session->active = false;
+            session->resultSubmitted = false;
+            session->game = CTetris(mConfig.fieldWidth, mConfig.fieldHeight, seed);
+            session->lastInput = 0;
+            session->inputSize = 0;
+            session->output.reserve(1024);
+            session->outputOffset = 0;
+            session->waitingWritable = false;
+            session->statePending = false;
+            session->closed = false;
+            session->keyframeNeeded = true;
+            session->sentFieldVersion = 0;
+
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.ptr = session.get();
+            if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                close(fd);
+                mErrors.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            //Session ids are unique across shards: every shard steps by the threads count
+            WelcomeMessage welcome{mNextSessionId, seed, mConfig.fieldWidth, mConfig.fieldHeight, mConfig.tickRate};
+            mNextSessionId += mConfig.threadsCount;
+            CServerProtocol::writeWelcome(session->output, welcome);
+            queueState(*session);
+            mSessionsById[session->id] = session.get();
+            mSessions.push_back(std::move(session));
+            mSessionsCount.store(mSessions.size(), std::memory_order_relaxed);
+            flushSession(*mSessions.back());
+        }
+    }
+
+    void CServerShard::readSession(Session& session)
+    {
+        while (true)
+        {
+            const ssize_t received = recv(session.fd, session.input + session.inputSize,
+                                          mInputCapacity - session.inputSize, 0);
+            if (received == 0)
+            {
+                closeSession(session);
+                return;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closeSession(session);
+                }
+                return;
+            }
+            session.inputSize += static_cast<size_t>(received);
+
+            //The client sends only inputs and resync requests, anything else ends the session
+            size_t offset = 0;
+            MessageView message;
+            int size = 0;
+            while ((size = CServerProtocol::parseMessage(session.input + offset, session.inputSize - offset, message)) > 0)
+            {
+                offset += static_cast<size_t>(size);
+                if (message.type == EMessageType::MESSAGE_RESYNC)
+                {
+                    //Sent right away, a game which doesn't change gives tick() nothing to flush
+                    session.keyframeNeeded = true;
+                    queueState(session);
+                    flushSession(session);
+                    if (session.closed)
+                    {
+                        return;
+                    }
+                    continue;
+                }
+                InputMessage input;
+                if (!CServerProtocol::readInput(message, input))
+                {
+                    mErrors.fetch_add(1, std::memory_order_relaxed);
+                    closeSession(session);
+                    return;
+                }
+                //The game is brought to the current tick first, like it was updated every tick
+                catchUp(session);
+                submitResult(session);
+                CSimulationThread::applyCommand(session.game, input.command);
+                session.lastInput = input.sequence;
+                markActive(session);
+                mInputs.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (size < 0)
+            {
+                mErrors.fetch_add(1, std::memory_order_relaxed);
+                closeSession(session);
+                return;
+            }
+            std::memmove(session.input, session.input + offset, session.inputSize - offset);
+            session.inputSize -= offset;
+        }
+    }
+
+    void CServerShard::tick()
+    {
+        TETRIS_TRACE_SCOPE("server tick");
+        ++mTick;
+        mTimers.advance(mTick, [this](TimerNode& node) { markActive(static_cast<Session&>(node)); });
+        for (Session* session : mActiveSessions)
+        {
+            session->active = false;
+            if (session->closed)
+            {
+                continue;
+            }
+            catchUp(*session);
+            submitResult(*session);
+            scheduleSession(*session);
+            if (isStateChanged(*session, session->sent, session->sentFieldVersion))
+            {
+                queueState(*session);
+                flushSession(*session);
+            }
+            const Broadcast* broadcast = session->broadcast.get();
+            if (broadcast && isStateChanged(*session, broadcast->sent, broadcast->sentFieldVersion))
+            {
+                broadcastState(*session);
+            }
+        }
+        mSessionUpdates.fetch_add(mActiveSessions.size(), std::memory_order_relaxed);
+        mActiveSessions.clear();
+        flushSpectators();
+        mTicks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void CServerShard::catchUp(Session& session)
+    {
+        //Updates between the scheduled falls only add time, a game which doesn't run ignores them
+        const float dt = 1.0f / mConfig.tickRate;
+        while (session.updatedTick != mTick)
+        {
+            if (session.game.getGameState() != EGameState::STATE_INGAME)
+            {
+                session.updatedTick = mTick;
+                break;
+            }
+            session.game.update(dt);
+            ++session.updatedTick;
+        }
+    }
+
+    void CServerShard::markActive(Session& session)
+    {
+        if (!session.active)
+        {
+            session.active = true;
+            mActiveSessions.push_back(&session);
+        }
+    }
+
+    //Called after every catch up: a game which ended by a fall or by the previous input is seen
+    //before the next input can start a new one
+    void CServerShard::submitResult(Session& session)
+    {
+        if (session.game.getGameState() != EGameState::STATE_GAMEOVER)
+        {
+            session.resultSubmitted = false;
+            return;
+        }
+        if (!session.resultSubmitted && mLeaderboard)
+        {
+            mLeaderboard->submit(session.id, session.game.getScores(), session.game.getLines());
+        }
+        session.resultSubmitted = true;
+    }
+
+    void CServerShard::scheduleSession(Session& session)
+    {
+        const int updates = session.game.getUpdatesUntilStep(1.0f / mConfig.tickRate);
+        if (updates > 0)
+        {
+            mTimers.schedule(session, session.updatedTick + static_cast<uint64_t>(updates));
+        }
+        else
+        {
+            mTimers.cancel(session);
+        }
+    }
+
+    bool CServerShard::isStateChanged(const Session& session, const BoardState& sent, unsigned sentFieldVersion)
+    {
+        const CTetris& game = session.game;
+        const Point* figure = game.getCurrentFigure();
+        for (int i = 0; i < 4; ++i)
+        {
+            if (figure[i].x != sent.figure[i].x || figure[i].y != sent.figure[i].y)
+            {
+                return true;
+            }
+        }
+        return game.getFieldVersion() != sentFieldVersion || game.getGameState() != sent.state ||
+               game.getScores() != sent.scores || session.lastInput != sent.lastInput;
+    }
+
+    void CServerShard::queueState(Session& session)
+    {
+        //Only the latest state matters: while a slow client still has unsent bytes the state waits
+        //and is built when the socket drains, so the backlog never grows past one message
+        if (session.outputOffset < session.output.size() && session.waitingWritable)
+        {
+            session.statePending = true;
+            return;
+        }
+
+        //Keyframes go out on join and when the client lost track, otherwise a delta against the last sent state
+        const CTetris& game = session.game;
+        mState.load(game, mTick, session.lastInput);
+        if (session.keyframeNeeded)
+        {
+            CServerProtocol::writeKeyframe(session.output, mState);
+            session.keyframeNeeded = false;
+        }
+        else
+        {
+            CServerProtocol::writeDelta(session.output, session.sent, mState);
+        }
+        session.sent = mState;
+        session.statePending = false;
+        session.sentFieldVersion = game.getFieldVersion();
+        mStates.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void CServerShard::flushSession(Session& session)
+    {
+        while (true)
+        {
+            while (session.outputOffset < session.output.size())
+            {
+                const ssize_t sent = send(session.fd, session.output.data() + session.outputOffset,
+                                          session.output.size() - session.outputOffset, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        closeSession(session);
+                        return;
+                    }
+                    //Wait for the socket to drain, the pending bytes stay in the buffer
+                    if (!session.waitingWritable)
+                    {
+                        setWritableWatch(session, true);
+                        session.waitingWritable = true;
+                    }
+                    if (session.output.size() > mOutputLimit)
+                    {
+                        mErrors.fetch_add(1, std::memory_order_relaxed);
+                        closeSession(session);
+                    }
+                    return;
+                }
+                session.outputOffset += static_cast<size_t>(sent);
+                mBytesSent.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            }
+            //Everything is out: keep the buffer capacity and stop watching for writability
+            session.output.clear();
+            session.outputOffset = 0;
+            if (session.waitingWritable)
+            {
+                setWritableWatch(session, false);
+                session.waitingWritable = false;
+            }
+            if (!session.statePending)
+            {
+                return;
+            }
+            queueState(session);
+        }
+    }
+
+    void CServerShard::closeSession(Session& session)
+    {
+        if (!session.closed)
+        {
+            //Closing the socket also removes it from the epoll set
+            close(session.fd);
+            session.closed = true;
+            ++mClosedCount;
+            mTimers.cancel(session);
+            if (session.broadcast)
+            {
+                for (Spectator* spectator : session.broadcast->spectators)
+                {
+                    closeSpectator(*spectator);
+                }
+            }
+        }
+    }
+
+    void CServerShard::removeClosedSessions()
+    {
+        //Sessions are removed only here, after the epoll events which may point to them were handled
+        if (mClosedCount == 0)
+        {
+            return;
+        }
+        mClosedCount = 0;
+        mActiveSessions.erase(std::remove_if(mActiveSessions.begin(), mActiveSessions.end(),
+                                             [](const Session* session) { return session->closed; }),
+                              mActiveSessions.end());
+        for (const auto& session : mSessions)
+        {
+            if (session->closed)
+            {
+                mSessionsById.erase(session->id);
+            }
+        }
+        auto end = std::remove_if(mSessions.begin(), mSessions.end(),
+                                  [](const std::unique_ptr<Session>& session) { return session->closed; });
+        if (end != mSessions.end())
+        {
+            mSessions.erase(end, mSessions.end());
+            mSessionsCount.store(mSessions.size(), std::memory_order_relaxed);
+        }
+    }
+    void CServerShard::setWritableWatch(Connection& connection, bool enabled)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (enabled ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.ptr = &connection;
+        epoll_ctl(mEpoll, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+
+    void CServerShard::acceptSpectators()
+    {
+        for (int fd = acceptConnection(mSpectatorListener.fd, mErrors); fd >= 0; fd = acceptConnection(mSpectatorListener.fd, mErrors))
+        {
+            addSpectator(fd);
+        }
+    }
+
+    CServerShard::Spectator& CServerShard::addSpectator(int fd)
+    {
+        auto spectator = std::make_unique<Spectator>();
+        spectator->type = EConnectionType::CONNECTION_SPECTATOR;
+        spectator->fd = fd;
+        spectator->closed = false;
+        spectator->session = nullptr;
+        spectator->inputSize = 0;
+        spectator->queueHead = 0;
+        spectator->queueSize = 0;
+        spectator->frameOffset = 0;
+        spectator->waitingWritable = false;
+        spectator->keyframeNeeded = true;
+        mSpectators.push_back(std::move(spectator));
+        mSpectatorsCount.store(mSpectators.size(), std::memory_order_relaxed);
+
+        Spectator& added = *mSpectators.back();
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = &added;
+        if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            mErrors.fetch_add(1, std::memory_order_relaxed);
+            closeSpectator(added);
+        }
+        return added;
+    }
+
+    void CServerShard::readSpectator(Spectator& spectator)
+    {
+        while (!spectator.closed)
+        {
+            const ssize_t received = recv(spectator.fd, spectator.input + spectator.inputSize,
+                                          mSpectatorInputCapacity - spectator.inputSize, 0);
+            if (received == 0)
+            {
+                closeSpectator(spectator);
+                return;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closeSpectator(spectator);
+                }
+                return;
+            }
+            spectator.inputSize += static_cast<size_t>(received);
+
+            //A spectator sends the spectate message once and later only resync requests
+            size_t offset = 0;
+            MessageView message;
+            int size = 0;
+            while (!spectator.closed &&
+                   (size = CServerProtocol::parseMessage(spectator.input + offset, spectator.inputSize - offset, message)) > 0)
+            {
+                offset += static_cast<size_t>(size);
+                SpectateMessage spectate;
+                if (message.type == EMessageType::MESSAGE_RESYNC && spectator.session)
+                {
+                    spectator.keyframeNeeded = true;
+                    queueFrame(spectator, nullptr);
+                    flushSpectator(spectator);
+                }
+                else if (!spectator.session && CServerProtocol::readSpectate(message, spectate))
+                {
+                    attachSpectator(spectator, spectate.sessionId);
+                    return;
+                }
+                else
+                {
+                    mErrors.fetch_add(1, std::memory_order_relaxed);
+                    closeSpectator(spectator);
+                }
+            }
+            if (size < 0)
+            {
+                mErrors.fetch_add(1, std::memory_order_relaxed);
+                closeSpectator(spectator);
+            }
+            if (spectator.closed)
+            {
+                return;
+            }
+            std::memmove(spectator.input, spectator.input + offset, spectator.inputSize - offset);
+            spectator.inputSize -= offset;
+        }
+    }
+
+    void CServerShard::attachSpectator(Spectator& spectator, uint32_t sessionId)
+    {
+        //Every shard steps its session ids by the threads count, so the id tells the owner
+        const unsigned owner = sessionId % mConfig.threadsCount;
+        if (owner != mIndex)
+        {
+            if (owner >= mShards.size())
+            {
+                closeSpectator(spectator);
+                return;
+            }
+            epoll_ctl(mEpoll, EPOLL_CTL_DEL, spectator.fd, nullptr);
+            mShards[owner]->handOffSpectator(spectator.fd, sessionId);
+            spectator.fd = -1;
+            closeSpectator(spectator);
+            return;
+        }
+
+        auto found = mSessionsById.find(sessionId);
+        if (found == mSessionsById.end() || found->second->closed)
+        {
+            closeSpectator(spectator);
+            return;
+        }
+        Session& session = *found->second;
+        if (!session.broadcast)
+        {
+            session.broadcast = std::make_unique<Broadcast>();
+            session.broadcast->sent.load(session.game, mTick, session.lastInput);
+            session.broadcast->sentFieldVersion = session.game.getFieldVersion();
+        }
+        session.broadcast->spectators.push_back(&spectator);
+        spectator.session = &session;
+        queueFrame(spectator, nullptr);
+        flushSpectator(spectator);
+    }
+
+    void CServerShard::handOffSpectator(int fd, uint32_t sessionId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mHandoffMutex);
+            mHandoffs.emplace_back(fd, sessionId);
+        }
+        const uint64_t one = 1;
+        if (write(mHandoffEvent.fd, &one, sizeof(one)) < 0)
+        {
+            mErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void CServerShard::receiveHandoffs()
+    {
+        uint64_t counter = 0;
+        if (read(mHandoffEvent.fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+        {
+            mErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::vector<std::pair<int, uint32_t>> handoffs;
+        {
+            std::lock_guard<std::mutex> lock(mHandoffMutex);
+            handoffs.swap(mHandoffs);
+        }
+        for (const auto& handoff : handoffs)
+        {
+            Spectator& spectator = addSpectator(handoff.first);
+            if (!spectator.closed)
+            {
+                attachSpectator(spectator, handoff.second);
+            }
+        }
+    }
+
+    void CServerShard::broadcastState(Session& session)
+    {
+        //One encoding per state for all spectators, the keyframe is only built when someone needs it
+        Broadcast& broadcast = *session.broadcast;
+        mState.load(session.game, mTick, session.lastInput);
+        auto frame = std::make_shared<std::vector<uint8_t>>();
+        CServerProtocol::writeDelta(*frame, broadcast.sent, mState);
+        broadcast.sent = mState;
+        broadcast.sentFieldVersion = session.game.getFieldVersion();
+        broadcast.keyframe.reset();
+        mBroadcasts.fetch_add(1, std::memory_order_relaxed);
+
+        const TSharedFrame delta = std::move(frame);
+        for (Spectator* spectator : broadcast.spectators)
+        {
+            if (!spectator->closed)
+            {
+                queueFrame(*spectator, delta);
+            }
+        }
+    }
+
+    const TSharedFrame& CServerShard::getKeyframe(Broadcast& broadcast)
+    {
+        if (!broadcast.keyframe)
+        {
+            auto frame = std::make_shared<std::vector<uint8_t>>();
+            CServerProtocol::writeKeyframe(*frame, broadcast.sent);
+            broadcast.keyframe = std::move(frame);
+        }
+        return broadcast.keyframe;
+    }
+
+    void CServerShard::queueFrame(Spectator& spectator, const TSharedFrame& frame)
+    {
+        //Instead of buffering without a limit a slow spectator drops the frames it hasn't started
+        //to receive and continues from the current keyframe. A partly written frame is completed.
+        if (spectator.queueSize == mSpectatorQueueLimit)
+        {
+            spectator.keyframeNeeded = true;
+        }
+        if (spectator.keyframeNeeded || !frame)
+        {
+            const size_t kept = spectator.frameOffset > 0 ? 1 : 0;
+            for (size_t i = kept; i < spectator.queueSize; ++i)
+            {
+                spectator.queue[(spectator.queueHead + i) % mSpectatorQueueLimit].reset();
+            }
+            mSkippedFrames.fetch_add(spectator.queueSize - kept, std::memory_order_relaxed);
+            spectator.queueSize = kept;
+            spectator.keyframeNeeded = false;
+            spectator.queue[(spectator.queueHead + spectator.queueSize++) % mSpectatorQueueLimit] =
+                getKeyframe(*spectator.session->broadcast);
+            return;
+        }
+        spectator.queue[(spectator.queueHead + spectator.queueSize++) % mSpectatorQueueLimit] = frame;
+    }
+
+    void CServerShard::flushSpectator(Spectator& spectator)
+    {
+        while (spectator.queueSize > 0)
+        {
+            //All queued frames go out in one call straight from the shared buffers
+            iovec vectors[mSpectatorQueueLimit];
+            size_t bytes = 0;
+            for (size_t i = 0; i < spectator.queueSize; ++i)
+            {
+                const std::vector<uint8_t>& frame = *spectator.queue[(spectator.queueHead + i) % mSpectatorQueueLimit];
+                const size_t offset = i == 0 ? spectator.frameOffset : 0;
+                vectors[i].iov_base = const_cast<uint8_t*>(frame.data() + offset);
+                vectors[i].iov_len = frame.size() - offset;
+                bytes += vectors[i].iov_len;
+            }
+            msghdr message{};
+            message.msg_iov = vectors;
+            message.msg_iovlen = spectator.queueSize;
+            const ssize_t written = sendmsg(spectator.fd, &message, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closeSpectator(spectator);
+                    return;
+                }
+                if (!spectator.waitingWritable)
+                {
+                    setWritableWatch(spectator, true);
+                    spectator.waitingWritable = true;
+                }
+                return;
+            }
+            mBytesSent.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+
+            //Release the frames which were written completely
+            size_t sent = static_cast<size_t>(written);
+            while (sent > 0)
+            {
+                TSharedFrame& front = spectator.queue[spectator.queueHead];
+                const size_t remaining = front->size() - spectator.frameOffset;
+                if (sent < remaining)
+                {
+                    spectator.frameOffset += sent;
+                    break;
+                }
+                sent -= remaining;
+                front.reset();
+                spectator.frameOffset = 0;
+                spectator.queueHead = (spectator.queueHead + 1) % mSpectatorQueueLimit;
+                --spectator.queueSize;
+            }
+            //A short write means the socket buffer is full, the rest waits for writability
+            if (static_cast<size_t>(written) < bytes)
+            {
+                if (!spectator.waitingWritable)
+                {
+                    setWritableWatch(spectator, true);
+                    spectator.waitingWritable = true;
+                }
+                return;
+            }
+        }
+        if (spectator.waitingWritable)
+        {
+            setWritableWatch(spectator, false);
+            spectator.waitingWritable = false;
+        }
+    }
+
+    void CServerShard::flushSpectators()
+    {
+        //Every tick writes to a different part of the spectators, each of them once per flush period
+        for (size_t i = mTick % mSpectatorFlushTicks; i < mSpectators.size(); i += mSpectatorFlushTicks)
+        {
+            Spectator& spectator = *mSpectators[i];
+            if (!spectator.closed && !spectator.waitingWritable && spectator.queueSize > 0)
+            {
+                flushSpectator(spectator);
+            }
+        }
+    }
+
+    void CServerShard::closeSpectator(Spectator& spectator)
+    {
+        if (!spectator.closed)
+        {
+            //A handed over spectator has no socket here any more
+            if (spectator.fd >= 0)
+            {
+                close(spectator.fd);
+            }
+            spectator.closed = true;
+            ++mClosedSpectatorsCount;
+        }
+    }
+
+    void CServerShard::removeClosedSpectators()
+    {
+        if (mClosedSpectatorsCount == 0)
+        {
+            return;
+        }
+        mClosedSpectatorsCount = 0;
+        //Games nobody watches any more stop encoding broadcast frames
+        for (auto& session : mSessions)
+        {
+            if (session->broadcast)
+            {
+                auto& spectators = session->broadcast->spectators;
+                spectators.erase(std::remove_if(spectators.begin(), spectators.end(),
+                                                [](const Spectator* spectator) { return spectator->closed; }),
+                                 spectators.end());
+                if (spectators.empty())
+                {
+                    session->broadcast.reset();
+                }
+            }
+        }
+        mSpectators.erase(std::remove_if(mSpectators.begin(), mSpectators.end(),
+                                         [](const std::unique_ptr<Spectator>& spectator) { return spectator->closed; }),
+                          mSpectators.end());
+        mSpectatorsCount.store(mSpectators.size(), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "CLeaderboard.h"
+#include "CServerProtocol.h"
+#include "CTimerWheel.h"
+
+namespace game
+{
+
+struct ServerConfig
+{
+    std::string address = "127.0.0.1";
+    int port = 7777;
+    int spectatorPort = 7778; //0 disables spectating
+    int spectatorFlushRate = 10; //Writes per second to a spectator, the frames between them go out in one write
+    unsigned threadsCount = 0; //0 means one per core
+    int tickRate = 60;
+    int fieldWidth = 10;
+    int fieldHeight = 20;
+    std::string leaderboardPath; //Empty keeps the high scores in memory only
+};
+
+struct ShardStats
+{
+    uint64_t sessions;
+    uint64_t ticks;
+    uint64_t lateTicks;
+    uint64_t maxTickMicros;
+    uint64_t inputs;
+    uint64_t states;
+    uint64_t bytesSent;
+    uint64_t errors;
+    uint64_t spectators;
+    uint64_t broadcasts;
+    uint64_t skippedFrames;
+    uint64_t sessionUpdates;
+};
+
+//An encoded message shared by all connections which send it
+using TSharedFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+//One server thread with its own epoll loop and listening socket. All shards listen on the same
+//port with SO_REUSEPORT, so the kernel spreads new connections and a session stays on one thread.
+//A tick touches only the sessions which got input or whose figure falls a row, the falls are
+//scheduled in a timer wheel. Idle games cost nothing, a due game is caught up with the ticks
+//it skipped. Changed states are sent to their clients as deltas against the previous state
+//sent on the connection.
+//
+//Spectators of a game are served by the shard of its session, a spectator accepted by another
+//shard is handed over. Each state of a watched game is encoded once into a shared frame which is
+//queued to all of its spectators. The queues are written a few times per second with one sendmsg
+//per spectator, spread over the ticks. A spectator whose queue is full loses the queued frames
+//and continues from a keyframe.
+//
+//A game which ends submits its scores to the leaderboard shared by all shards.
+class CServerShard
+{
+public:
+    CServerShard(const ServerConfig& config, unsigned index);
+    ~CServerShard();
+
+    bool open();
+    void setShards(const std::vector<CServerShard*>& shards);
+    void setLeaderboard(CLeaderboard* leaderboard);
+    void start();
+    void stop();
+    ShardStats getStats() const;
+    //Called by other shards: the shard takes the socket of a spectator of one of its sessions
+    void handOffSpectator(int fd, uint32_t sessionId);
+
+    CServerShard(const CServerShard& other) = delete;
+    CServerShard& operator=(const CServerShard& other) = delete;
+
+private:
+    static const size_t mInputCapacity = 4096;
+    static const size_t mOutputLimit = 64 * 1024;
+    static const int mEventsCapacity = 256;
+    static const size_t mSpectatorInputCapacity = 64;
+    static const size_t mSpectatorQueueLimit = 32;
+
+    enum class EConnectionType
+    {
+        CONNECTION_SESSION,
+        CONNECTION_SPECTATOR,
+        CONNECTION_SPECTATOR_LISTENER,
+        CONNECTION_HANDOFF
+    };
+
+    //Common head of everything registered in epoll, the player listener is registered as nullptr
+    struct Connection
+    {
+        EConnectionType type;
+        int fd;
+        bool closed;
+    };
+
+    struct Spectator;
+
+    //Created by the first spectator of a session, the encoded states follow their own base state
+    struct Broadcast
+    {
+        BoardState sent;
+        unsigned sentFieldVersion;
+        TSharedFrame keyframe;
+        std::vector<Spectator*> spectators;
+    };
+
+    struct Session : Connection, TimerNode
+    {
+        uint32_t id;
+        CTetris game;
+        uint32_t updatedTick;
+        bool active;
+        bool resultSubmitted;
+        uint32_t lastInput;
+        uint8_t input[mInputCapacity];
+        size_t inputSize;
+        std::vector<uint8_t> output;
+        size_t outputOffset;
+        bool waitingWritable;
+        bool statePending;
+        bool keyframeNeeded;
+        unsigned sentFieldVersion;
+        BoardState sent;
+        std::unique_ptr<Broadcast> broadcast;
+    };
+
+    struct Spectator : Connection
+    {
+        Session* session; //nullptr until the spectate message arrives
+        uint8_t input[mSpectatorInputCapacity];
+        size_t inputSize;
+        std::array<TSharedFrame, mSpectatorQueueLimit> queue;
+        size_t queueHead;
+        size_t queueSize;
+        size_t frameOffset;
+        bool waitingWritable;
+        bool keyframeNeeded;
+    };
+
+    void run();
+    void acceptSessions();
+    void readSession(Session& session);
+    void tick();
+    void catchUp(Session& session);
+    void markActive(Session& session);
+    void scheduleSession(Session& session);
+    void submitResult(Session& session);
+    static bool isStateChanged(const Session& session, const BoardState& sent, unsigned sentFieldVersion);
+    void queueState(Session& session);
+    void flushSession(Session& session);
+    void closeSession(Session& session);
+    void removeClosedSessions();
+
+    void acceptSpectators();
+    Spectator& addSpectator(int fd);
+    void readSpectator(Spectator& spectator);
+    void receiveHandoffs();
+    void attachSpectator(Spectator& spectator, uint32_t sessionId);
+    void broadcastState(Session& session);
+    const TSharedFrame& getKeyframe(Broadcast& broadcast);
+    void queueFrame(Spectator& spectator, const TSharedFrame& frame);
+    void flushSpectator(Spectator& spectator);
+    void flushSpectators();
+    void setWritableWatch(Connection& connection, bool enabled);
+    void closeSpectator(Spectator& spectator);
+    void removeClosedSpectators();
+
+private:
+    ServerConfig mConfig;
+    unsigned mIndex;
+    int mListener;
+    int mEpoll;
+    Connection mSpectatorListener;
+    Connection mHandoffEvent;
+    std::vector<CServerShard*> mShards;
+    CLeaderboard* mLeaderboard;
+    std::thread mThread;
+    std::atomic<bool> mRunning;
+    std::vector<std::unique_ptr<Session>> mSessions;
+    std::unordered_map<uint32_t, Session*> mSessionsById;
+    std::minstd_rand mRandom;
+    uint32_t mNextSessionId;
+    uint32_t mTick;
+    size_t mClosedCount;
+    CTimerWheel mTimers;
+    std::vector<Session*> mActiveSessions;
+    std::vector<std::unique_ptr<Spectator>> mSpectators;
+    size_t mClosedSpectatorsCount;
+    uint32_t mSpectatorFlushTicks;
+    std::mutex mHandoffMutex;
+    std::vector<std::pair<int, uint32_t>> mHandoffs;
+    BoardState mState;
+
+    std::atomic<uint64_t> mSessionsCount;
+    std::atomic<uint64_t> mTicks;
+    std::atomic<uint64_t> mLateTicks;
+    std::atomic<uint64_t> mMaxTickMicros;
+    std::atomic<uint64_t> mInputs;
+    std::atomic<uint64_t> mStates;
+    std::atomic<uint64_t> mBytesSent;
+    std::atomic<uint64_t> mErrors;
+    std::atomic<uint64_t> mSpectatorsCount;
+    std::atomic<uint64_t> mBroadcasts;
+    std::atomic<uint64_t> mSkippedFrames;
+    std::atomic<uint64_t> mSessionUpdates;
+};
+
+}
@@ -0,0 +1,270 @@
+#include "CSharedState.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace game
+{
+    namespace
+    {
+        //The counter is shared between processes, it must not fall back to a lock
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "The sequence counter must be lock-free");
+
+        std::string getSegmentName(const std::string& name)
+        {
+#ifdef _WIN32
+            return name;
+#else
+            return name.empty() || name[0] != '/' ? "/" + name : name;
+#endif
+        }
+    }
+
+    CSharedStateWriter::CSharedStateWriter()
+    : mShared(nullptr)
+    , mMappingHandle(nullptr)
+    {
+    }
+
+    CSharedStateWriter::~CSharedStateWriter()
+    {
+        close();
+    }
+
+    bool CSharedStateWriter::open(const std::string& name)
+    {
+        close();
+        mName = getSegmentName(name);
+
+#ifdef _WIN32
+        HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                            static_cast<DWORD>(sizeof(SharedGameState)), mName.c_str());
+        //A mapping of the same name belongs to another writer, it is never shared
+        if (mapping && GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            CloseHandle(mapping);
+            return false;
+        }
+        void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedGameState)) : nullptr;
+        mMappingHandle = mapping;
+        if (view == nullptr)
+        {
+            close();
+            return false;
+        }
+#else
+        //An existing segment belongs to another writer, or to one which crashed, and is left alone
+        const int file = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (file < 0)
+        {
+            return false;
+        }
+        void* view = MAP_FAILED;
+        if (ftruncate(file, sizeof(SharedGameState)) == 0)
+        {
+            view = mmap(nullptr, sizeof(SharedGameState), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        }
+        ::close(file);
+        if (view == MAP_FAILED)
+        {
+            shm_unlink(mName.c_str());
+            return false;
+        }
+#endif
+
+        //Readers see no state until the first publish
+        mShared = new (view) SharedGameState();
+        mShared->magic = SharedGameState::mMagic;
+        mShared->version = SharedGameState::mVersion;
+        mShared->size = sizeof(SharedGameState);
+        return true;
+    }
+
+    void CSharedStateWriter::close()
+    {
+#ifdef _WIN32
+        if (mShared)
+        {
+            UnmapViewOfFile(mShared);
+        }
+        if (mMappingHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mMappingHandle));
+        }
+#else
+        if (mShared)
+        {
+            munmap(mShared, sizeof(SharedGameState));
+            shm_unlink(mName.c_str());
+        }
+#endif
+        mShared = nullptr;
+        mMappingHandle = nullptr;
+    }
+
+    bool CSharedStateWriter::isOpen() const
+    {
+        return mShared != nullptr;
+    }
+
+    void CSharedStateWriter::publish(const CTetris& game, uint64_t tick)
+    {
+        if (!mShared)
+        {
+            return;
+        }
+
+        //The odd value must be visible before any of the state changes
+        const uint32_t sequence = mShared->sequence.load(std::memory_order_relaxed);
+        mShared->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        LiveGameState& live = mShared->live;
+        const int width = std::min(game.getFieldWidth(), LiveGameState::mMaxWidth);
+        const int height = std::min(game.getFieldHeight(), LiveGameState::mMaxHeight);
+        live.tick = tick;
+        live.state = static_cast<int32_t>(game.getGameState());
+        live.scores = game.getScores();
+        live.lines = game.getLines();
+        live.fieldWidth = width;
+        live.fieldHeight = height;
+        live.figure = game.getCurrentFigureId();
+        live.figureColor = game.getFigureColor();
+        std::copy(game.getCurrentFigure(), game.getCurrentFigure() + 4, live.figureCells);
+        live.previewSize = game.getPreviewSize();
+        for (int i = 0; i < live.previewSize; ++i)
+        {
+            live.preview[i] = game.getPreviewFigureId(i);
+        }
+        const TFieldType& field = game.getField();
+        for (int i = 0; i < height; ++i)
+        {
+            for (int j = 0; j < width; ++j)
+            {
+                live.field[i][j] = static_cast<uint8_t>(field[i][j]);
+            }
+        }
+
+        mShared->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    CSharedStateReader::CSharedStateReader()
+    : mShared(nullptr)
+    , mMappingHandle(nullptr)
+    {
+    }
+
+    CSharedStateReader::~CSharedStateReader()
+    {
+        close();
+    }
+
+    bool CSharedStateReader::open(const std::string& name)
+    {
+        close();
+        const std::string segmentName = getSegmentName(name);
+
+#ifdef _WIN32
+        HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segmentName.c_str());
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedGameState)) : nullptr;
+        mMappingHandle = mapping;
+        if (view == nullptr)
+        {
+            close();
+            return false;
+        }
+#else
+        const int file = shm_open(segmentName.c_str(), O_RDONLY, 0);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        void* view = MAP_FAILED;
+        if (fstat(file, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(SharedGameState)))
+        {
+            view = mmap(nullptr, sizeof(SharedGameState), PROT_READ, MAP_SHARED, file, 0);
+        }
+        ::close(file);
+        if (view == MAP_FAILED)
+        {
+            return false;
+        }
+#endif
+
+        mShared = static_cast<const SharedGameState*>(view);
+        if (mShared->magic != SharedGameState::mMagic || mShared->version != SharedGameState::mVersion ||
+            mShared->size != sizeof(SharedGameState))
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void CSharedStateReader::close()
+    {
+#ifdef _WIN32
+        if (mShared)
+        {
+            UnmapViewOfFile(mShared);
+        }
+        if (mMappingHandle)
+        {
+            CloseHandle(static_cast<HANDLE>(mMappingHandle));
+        }
+#else
+        if (mShared)
+        {
+            munmap(const_cast<SharedGameState*>(mShared), sizeof(SharedGameState));
+        }
+#endif
+        mShared = nullptr;
+        mMappingHandle = nullptr;
+    }
+
+    uint32_t CSharedStateReader::getSequence() const
+    {
+        return mShared ? mShared->sequence.load(std::memory_order_acquire) : 0;
+    }
+
+    bool CSharedStateReader::read(LiveGameState& state, uint32_t& sequence) const
+    {
+        if (!mShared)
+        {
+            return false;
+        }
+        for (int attempt = 0; attempt < mReadAttempts; ++attempt)
+        {
+            const uint32_t before = mShared->sequence.load(std::memory_order_acquire);
+            if (before == 0)
+            {
+                return false;
+            }
+            if (before & 1)
+            {
+                continue;
+            }
+            std::memcpy(&state, &mShared->live, sizeof(state));
+            //The copy must be complete before the counter is checked again
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mShared->sequence.load(std::memory_order_relaxed) == before)
+            {
+                sequence = before;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "CTetris.h"
+
+namespace game
+{
+
+//Game state as external observers see it, plain data with a fixed layout
+struct LiveGameState
+{
+    static const int mMaxWidth = 32;
+    static const int mMaxHeight = 64;
+
+    uint64_t tick;
+    int32_t state; //EGameState
+    int32_t scores;
+    int32_t lines;
+    int32_t fieldWidth;
+    int32_t fieldHeight;
+    int32_t figure;
+    int32_t figureColor;
+    Point figureCells[4];
+    int32_t previewSize;
+    int32_t preview[CTetris::mMaxPreviewSize];
+    uint8_t field[mMaxHeight][mMaxWidth]; //Colors, 0 is empty
+};
+
+//The shared memory segment: a sequence counter which is odd while the state is written.
+//A reader copies the state between two loads of the counter and keeps the copy if they
+//are equal and even, so neither side ever locks or calls into the kernel.
+struct SharedGameState
+{
+    static const uint32_t mMagic = 0x31535454; //"TTS1"
+    static const uint32_t mVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    std::atomic<uint32_t> sequence;
+    LiveGameState live;
+};
+
+//Publishes the game into a named shared memory segment ("/name" with shm_open,
+//a named file mapping on Windows). The segment is removed by the destructor.
+//open() fails when the name is already in use, a segment left by a crashed writer
+//has to be removed first (rm /dev/shm/name).
+class CSharedStateWriter
+{
+public:
+    CSharedStateWriter();
+    ~CSharedStateWriter();
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const;
+    //Doesn't allocate, it may be called every tick of the simulation thread
+    void publish(const CTetris& game, uint64_t tick);
+
+    CSharedStateWriter(const CSharedStateWriter& other) = delete;
+    CSharedStateWriter& operator=(const CSharedStateWriter& other) = delete;
+
+private:
+    SharedGameState* mShared;
+    std::string mName;
+    void* mMappingHandle;
+};
+
+class CSharedStateReader
+{
+public:
+    CSharedStateReader();
+    ~CSharedStateReader();
+
+    bool open(const std::string& name);
+    void close();
+    //Changes with every published state, a poller can skip the copy while it stays the same
+    uint32_t getSequence() const;
+    //A consistent copy of the last published state, false when the writer kept it busy
+    //for every attempt or nothing was published yet
+    bool read(LiveGameState& state, uint32_t& sequence) const;
+
+    CSharedStateReader(const CSharedStateReader& other) = delete;
+    CSharedStateReader& operator=(const CSharedStateReader& other) = delete;
+
+private:
+    static const int mReadAttempts = 64;
+
+    const SharedGameState* mShared;
+    void* mMappingHandle;
+};
+
+}
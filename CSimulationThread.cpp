@@ -0,0 +1,178 @@
+#include "CSimulationThread.h"
+#include "CAllocationTracker.h"
+#include "CReplay.h"
+#include "CSharedState.h"
+#include <chrono>
+
+namespace game
+{
+    CSimulationThread::CSimulationThread(const CTetris& game, int tickRate)
+    : mGame(game)
+    , mSnapshots(game)
+    , mRunning(false)
+    , mSteadyAllocations(0)
+    , mTickRate(tickRate)
+    , mProfiler(nullptr)
+    , mReplay(nullptr)
+    , mStateWriter(nullptr)
+    {
+    }
+
+    CSimulationThread::~CSimulationThread()
+    {
+        stop();
+    }
+
+    void CSimulationThread::start()
+    {
+        if (!mRunning.exchange(true))
+        {
+            mThread = std::thread(&CSimulationThread::run, this);
+        }
+    }
+
+    void CSimulationThread::stop()
+    {
+        if (mRunning.exchange(false))
+        {
+            mThread.join();
+        }
+    }
+
+    void CSimulationThread::setProfiler(CFrameProfiler* profiler)
+    {
+        //Must be set before start(), the thread reads it without synchronisation
+        mProfiler = profiler;
+    }
+
+    void CSimulationThread::setReplay(CReplay* replay)
+    {
+        //Must be set before start() on a game built like CReplay::createGame(), the thread
+        //records every command into it. The replay may be read again after stop().
+        mReplay = replay;
+    }
+
+    void CSimulationThread::setStateWriter(CSharedStateWriter* writer)
+    {
+        //Must be set before start(), every tick is published to it for external observers
+        mStateWriter = writer;
+    }
+
+    bool CSimulationThread::pushCommand(EGameCommand command)
+    {
+        return mCommands.push(command);
+    }
+
+    const CTetris& CSimulationThread::getSnapshot()
+    {
+        return mSnapshots.getReadBuffer();
+    }
+
+    uint64_t CSimulationThread::getSteadyAllocationsCount() const
+    {
+        //Heap allocations made by ticks after the warm-up, it stays zero while the game runs
+        return mSteadyAllocations.load(std::memory_order_relaxed);
+    }
+
+    void CSimulationThread::run()
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / mTickRate));
+        const float dt = 1.0f / mTickRate;
+        auto nextTick = Clock::now();
+        int ticksCount = 0;
+        uint32_t replayTick = 0;
+
+        while (mRunning.load(std::memory_order_relaxed))
+        {
+            CAllocationScope allocations;
+            EGameCommand command;
+            bool changed = mGame.getGameState() == EGameState::STATE_INGAME;
+            while (mCommands.pop(command))
+            {
+                applyCommand(mGame, command);
+                if (mReplay)
+                {
+                    mReplay->addEvent(replayTick, command);
+                }
+                changed = true;
+            }
+            {
+                CProfileScope scope(mProfiler, EFramePhase::PHASE_UPDATE);
+                mGame.update(dt);
+            }
+
+            //Outside of the game the state only changes by commands, idle ticks publish nothing.
+            //Assigning into the same sized snapshot reuses its field storage.
+            if (changed)
+            {
+                mSnapshots.getWriteBuffer() = mGame;
+                mSnapshots.publish();
+            }
+            if (mStateWriter)
+            {
+                mStateWriter->publish(mGame, replayTick);
+            }
+
+            ++replayTick;
+            if (mReplay)
+            {
+                mReplay->setTicksCount(replayTick);
+            }
+
+            //The first ticks may allocate once, like the tracer ring of this thread
+            if (ticksCount < mWarmUpTicks)
+            {
+                ++ticksCount;
+            }
+            else
+            {
+                mSteadyAllocations.fetch_add(allocations.getCount(), std::memory_order_relaxed);
+            }
+
+            //Ticks are scheduled from a fixed origin, so a late tick doesn't shift the following ones.
+            //After a stall longer than a second the schedule starts over instead of catching up.
+            nextTick += tick;
+            const auto now = Clock::now();
+            if (nextTick < now - tick * mTickRate)
+            {
+                nextTick = now;
+            }
+            std::this_thread::sleep_until(nextTick);
+        }
+    }
+
+    void CSimulationThread::applyCommand(CTetris& game, EGameCommand command)
+    {
+        switch (command)
+        {
+            case EGameCommand::COMMAND_ROTATE:
+                game.rotate();
+                break;
+
+            case EGameCommand::COMMAND_MOVE_LEFT:
+                game.move(-1);
+                break;
+
+            case EGameCommand::COMMAND_MOVE_RIGHT:
+                game.move(1);
+                break;
+
+            case EGameCommand::COMMAND_DROP:
+                game.drop();
+                break;
+
+            case EGameCommand::COMMAND_NEW_GAME:
+                game.setGameState(EGameState::STATE_INGAME);
+                break;
+
+            case EGameCommand::COMMAND_PAUSE:
+                game.setGamePause();
+                break;
+
+            case EGameCommand::COMMAND_RESET:
+                game.resetGame();
+                break;
+        }
+    }
+}
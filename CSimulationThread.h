@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "CFrameProfiler.h"
+#include "CSpscQueue.h"
+#include "CTetris.h"
+#include "CTripleBuffer.h"
+
+namespace game
+{
+
+class CReplay;
+class CSharedStateWriter;
+
+enum class EGameCommand
+{
+    COMMAND_ROTATE,
+    COMMAND_MOVE_LEFT,
+    COMMAND_MOVE_RIGHT,
+    COMMAND_DROP,
+    COMMAND_NEW_GAME,
+    COMMAND_PAUSE,
+    COMMAND_RESET
+};
+
+//Runs the game on its own thread at a fixed tick rate. Commands come in through a
+//lock-free queue and every tick publishes a copy of the game for the render thread.
+class CSimulationThread
+{
+public:
+    CSimulationThread(const CTetris& game, int tickRate);
+    ~CSimulationThread();
+
+    void start();
+    void stop();
+    void setProfiler(CFrameProfiler* profiler);
+    void setReplay(CReplay* replay);
+    void setStateWriter(CSharedStateWriter* writer);
+    bool pushCommand(EGameCommand command);
+    const CTetris& getSnapshot();
+    uint64_t getSteadyAllocationsCount() const;
+
+    static void applyCommand(CTetris& game, EGameCommand command);
+
+    CSimulationThread(const CSimulationThread& other) = delete;
+    CSimulationThread& operator=(const CSimulationThread& other) = delete;
+
+private:
+    void run();
+
+private:
+    static const size_t mCommandsCapacity = 64;
+    static const int mWarmUpTicks = 120;
+
+    CTetris mGame;
+    CTripleBuffer<CTetris> mSnapshots;
+    CSpscQueue<EGameCommand, mCommandsCapacity> mCommands;
+    std::thread mThread;
+    std::atomic<bool> mRunning;
+    std::atomic<uint64_t> mSteadyAllocations;
+    int mTickRate;
+    CFrameProfiler* mProfiler;
+    CReplay* mReplay;
+    CSharedStateWriter* mStateWriter;
+};
+
+}
@@ -0,0 +1,240 @@
+#include "CSoftwareRenderer.h"
+#include "CTracer.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TETRIS_SSE2
+#endif
+
+namespace
+{
+    const int figureCells = 4;
+    const int previewSpacing = 5;
+    //The same tile as the previews of CBlocksRenderer
+    const int previewTile = 0;
+    const uint32_t ghostAlpha = 90;
+
+    //Pixels are stored as bytes R, G, B, A, like sf::Image
+    uint32_t makePixel(uint8_t r, uint8_t g, uint8_t b)
+    {
+        const uint8_t bytes[4] = {r, g, b, 255};
+        uint32_t pixel;
+        std::memcpy(&pixel, bytes, sizeof(pixel));
+        return pixel;
+    }
+
+    //Blends a row of source pixels over the destination with the ghost alpha, the destination stays opaque
+    void blendRow(uint8_t* dst, const uint8_t* src, int count)
+    {
+        int i = 0;
+#ifdef TETRIS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha = _mm_set1_epi16(static_cast<short>(ghostAlpha));
+        const __m128i inverse = _mm_set1_epi16(static_cast<short>(255 - ghostAlpha));
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        auto blend = [&](__m128i s, __m128i d) {
+            //(s * a + d * (255 - a)) / 255 with the exact rounding of x / 255 = (x + 1 + (x >> 8)) >> 8
+            __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, alpha), _mm_mullo_epi16(d, inverse));
+            return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8)), 8);
+        };
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+            const __m128i low = blend(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            const __m128i high = blend(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_packus_epi16(low, high), opaque));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const uint32_t x = src[i * 4 + c] * ghostAlpha + dst[i * 4 + c] * (255 - ghostAlpha);
+                dst[i * 4 + c] = static_cast<uint8_t>((x + 1 + (x >> 8)) >> 8);
+            }
+            dst[i * 4 + 3] = 255;
+        }
+    }
+}
+
+CSoftwareRenderer::CSoftwareRenderer(const sf::Image& blocks, const sf::Image& backGround, sf::Vector2f backGroundScale,
+                                     sf::Vector2u size, int blockSize, float scaleFactor)
+: mBackGroundLayer(static_cast<size_t>(size.x) * size.y, makePixel(0, 0, 30))
+, mBoardLayer(mBackGroundLayer.size())
+, mWidth(size.x)
+, mHeight(size.y)
+, mFieldVersion(0)
+, mBoardLayerValid(false)
+, mBlockSize(blockSize)
+, mTileSize(static_cast<int>(blockSize * scaleFactor + 0.5f))
+, mTilesCount(static_cast<int>(blocks.getSize().x) / blockSize)
+{
+    //Nearest sampling at pixel centres, like a sprite of a texture without smoothing
+    const uint8_t* backPixels = backGround.getPixelsPtr();
+    const sf::Vector2u backSize = backGround.getSize();
+    const unsigned backWidth = static_cast<unsigned>(backSize.x * backGroundScale.x);
+    const unsigned backHeight = static_cast<unsigned>(backSize.y * backGroundScale.y);
+    for (unsigned y = 0; y < mHeight && y < backHeight; ++y)
+    {
+        const unsigned sy = static_cast<unsigned>((y + 0.5f) / backGroundScale.y);
+        for (unsigned x = 0; x < mWidth && x < backWidth; ++x)
+        {
+            const unsigned sx = static_cast<unsigned>((x + 0.5f) / backGroundScale.x);
+            const uint8_t* p = backPixels + (static_cast<size_t>(sy) * backSize.x + sx) * 4;
+            mBackGroundLayer[static_cast<size_t>(y) * mWidth + x] = makePixel(p[0], p[1], p[2]);
+        }
+    }
+
+    //Every tile of the blocks texture scaled to the block size on the screen, tiles one after another
+    const uint8_t* blockPixels = blocks.getPixelsPtr();
+    const unsigned blocksWidth = blocks.getSize().x;
+    mTiles.resize(static_cast<size_t>(mTilesCount) * mTileSize * mTileSize);
+    for (int tile = 0; tile < mTilesCount; ++tile)
+    {
+        for (int y = 0; y < mTileSize; ++y)
+        {
+            const int sy = static_cast<int>((y + 0.5f) * blockSize / mTileSize);
+            for (int x = 0; x < mTileSize; ++x)
+            {
+                const int sx = tile * blockSize + static_cast<int>((x + 0.5f) * blockSize / mTileSize);
+                const uint8_t* p = blockPixels + (static_cast<size_t>(sy) * blocksWidth + sx) * 4;
+                mTiles[(static_cast<size_t>(tile) * mTileSize + y) * mTileSize + x] = makePixel(p[0], p[1], p[2]);
+            }
+        }
+    }
+}
+
+unsigned CSoftwareRenderer::getWidth() const
+{
+    return mWidth;
+}
+
+unsigned CSoftwareRenderer::getHeight() const
+{
+    return mHeight;
+}
+
+void CSoftwareRenderer::drawTile(uint8_t* pixels, size_t stride, int x, int y, int tile, bool ghost) const
+{
+    //Clip the tile to the buffer, figures may stick out above the field
+    const int left = x < 0 ? -x : 0;
+    const int top = y < 0 ? -y : 0;
+    const int right = x + mTileSize > static_cast<int>(mWidth) ? static_cast<int>(mWidth) - x : mTileSize;
+    const int bottom = y + mTileSize > static_cast<int>(mHeight) ? static_cast<int>(mHeight) - y : mTileSize;
+    if (tile < 0 || tile >= mTilesCount || left >= right || top >= bottom)
+    {
+        return;
+    }
+
+    const size_t rowBytes = static_cast<size_t>(right - left) * 4;
+    for (int ty = top; ty < bottom; ++ty)
+    {
+        const uint32_t* src = &mTiles[(static_cast<size_t>(tile) * mTileSize + ty) * mTileSize + left];
+        uint8_t* dst = pixels + static_cast<size_t>(y + ty) * stride + static_cast<size_t>(x + left) * 4;
+        if (ghost)
+        {
+            blendRow(dst, reinterpret_cast<const uint8_t*>(src), right - left);
+        }
+        else
+        {
+            std::memcpy(dst, src, rowBytes);
+        }
+    }
+}
+
+void CSoftwareRenderer::updateBoardLayer(const game::CTetris& game)
+{
+    TETRIS_TRACE_SCOPE("software board layer");
+    mBoardLayer = mBackGroundLayer;
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(mBoardLayer.data());
+    const size_t stride = static_cast<size_t>(mWidth) * 4;
+    const game::TFieldType& field = game.getField();
+    for (int i = 0; i < game.getFieldHeight(); ++i)
+    {
+        for (int j = 0; j < game.getFieldWidth(); ++j)
+        {
+            if (field[i][j] != 0)
+            {
+                drawTile(pixels, stride, j * mBlockSize, i * mBlockSize, field[i][j], false);
+            }
+        }
+    }
+}
+
+void CSoftwareRenderer::render(const game::CTetris& game, uint8_t* pixels, size_t stride)
+{
+    TETRIS_TRACE_SCOPE("software render");
+    if (!mBoardLayerValid || mFieldVersion != game.getFieldVersion())
+    {
+        updateBoardLayer(game);
+        mFieldVersion = game.getFieldVersion();
+        mBoardLayerValid = true;
+    }
+
+    const size_t rowBytes = static_cast<size_t>(mWidth) * 4;
+    if (stride == rowBytes)
+    {
+        std::memcpy(pixels, mBoardLayer.data(), rowBytes * mHeight);
+    }
+    else
+    {
+        for (unsigned y = 0; y < mHeight; ++y)
+        {
+            std::memcpy(pixels + y * stride, &mBoardLayer[static_cast<size_t>(y) * mWidth], rowBytes);
+        }
+    }
+
+    const bool figureVisible = game.getGameState() == game::EGameState::STATE_INGAME ||
+                               game.getGameState() == game::EGameState::STATE_PAUSE;
+    if (!figureVisible)
+    {
+        return;
+    }
+
+    const int fieldWidth = game.getFieldWidth();
+    const int fieldHeight = game.getFieldHeight();
+    const game::TFieldType& field = game.getField();
+    const game::Point* figure = game.getCurrentFigure();
+    const int color = game.getFigureColor();
+
+    //The ghost shows where the figure lands: shift it down while it still fits
+    auto fits = [&field, fieldWidth, fieldHeight, figure](int dy) {
+        for (int i = 0; i < figureCells; ++i)
+        {
+            const int x = figure[i].x;
+            const int y = figure[i].y + dy;
+            if (x < 0 || x >= fieldWidth || y >= fieldHeight || (y >= 0 && field[y][x]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    int ghostShift = 0;
+    while (fits(ghostShift + 1))
+    {
+        ++ghostShift;
+    }
+
+    //Same drawing order as the quads of CBlocksRenderer: ghost, figure, previews
+    for (int i = 0; i < figureCells; ++i)
+    {
+        drawTile(pixels, stride, figure[i].x * mBlockSize, (figure[i].y + ghostShift) * mBlockSize, color, true);
+    }
+    for (int i = 0; i < figureCells; ++i)
+    {
+        drawTile(pixels, stride, figure[i].x * mBlockSize, figure[i].y * mBlockSize, color, false);
+    }
+    for (int p = 0; p < game.getPreviewSize(); ++p)
+    {
+        const game::Point* nextFigure = game.getPreviewFigure(p);
+        for (int i = 0; i < figureCells; ++i)
+        {
+            drawTile(pixels, stride, nextFigure[i].x * mBlockSize + fieldWidth * mBlockSize + 40,
+                     (nextFigure[i].y + p * previewSpacing) * mBlockSize + 100, previewTile, false);
+        }
+    }
+}
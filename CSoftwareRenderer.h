@@ -0,0 +1,36 @@
+#pragma once
+#include <SFML/Graphics/Image.hpp>
+#include <cstdint>
+#include <vector>
+#include "CTetris.h"
+
+//Draws the same picture as CBlocksRenderer on the CPU into a caller owned RGBA buffer,
+//for rendering without a GPU or a window. Tiles are scaled once to the block size on the
+//screen and the background with the settled blocks is cached until the field version changes.
+class CSoftwareRenderer
+{
+public:
+    CSoftwareRenderer(const sf::Image& blocks, const sf::Image& backGround, sf::Vector2f backGroundScale,
+                      sf::Vector2u size, int blockSize, float scaleFactor);
+
+    //The buffer holds getHeight() rows of getWidth() RGBA pixels, stride is the row size in bytes
+    void render(const game::CTetris& game, uint8_t* pixels, size_t stride);
+    unsigned getWidth() const;
+    unsigned getHeight() const;
+
+private:
+    void updateBoardLayer(const game::CTetris& game);
+    void drawTile(uint8_t* pixels, size_t stride, int x, int y, int tile, bool ghost) const;
+
+private:
+    std::vector<uint32_t> mBackGroundLayer;
+    std::vector<uint32_t> mBoardLayer;
+    std::vector<uint32_t> mTiles;
+    unsigned mWidth;
+    unsigned mHeight;
+    unsigned mFieldVersion;
+    bool mBoardLayerValid;
+    int mBlockSize;
+    int mTileSize;
+    int mTilesCount;
+};
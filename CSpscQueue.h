@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace game
+{
+
+//Fixed size lock-free queue for exactly one producer and one consumer thread
+template <typename T, size_t N>
+class CSpscQueue
+{
+public:
+    CSpscQueue()
+    : mHead(0)
+    , mTail(0)
+    {
+    }
+
+    bool push(const T& item)
+    {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) == N)
+        {
+            return false;
+        }
+        mItems[tail % N] = item;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = mItems[head % N];
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    CSpscQueue(const CSpscQueue& other) = delete;
+    CSpscQueue& operator=(const CSpscQueue& other) = delete;
+
+private:
+    std::array<T, N> mItems;
+    alignas(64) std::atomic<size_t> mHead;
+    alignas(64) std::atomic<size_t> mTail;
+};
+
+}
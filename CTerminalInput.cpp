@@ -0,0 +1,172 @@
+#include "CTerminalInput.h"
+
+#ifdef _WIN32
+#include <conio.h>
+#include <windows.h>
+#else
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace
+{
+    //Over a slow connection the bytes of an arrow key may arrive apart, a lone ESC
+    //is taken as the Esc key only when nothing followed it for this long
+    const std::chrono::milliseconds escapeTimeout(100);
+}
+
+struct CTerminalInput::Settings
+{
+    termios saved;
+};
+#endif
+
+CTerminalInput::CTerminalInput()
+: mRawMode(false)
+#ifdef _WIN32
+, mOutputMode(0)
+#else
+, mSettings(std::make_unique<Settings>())
+, mEscapeLength(0)
+#endif
+{
+    #ifdef _WIN32
+    //Escape sequences need the virtual terminal mode of the console
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(output, &mode))
+    {
+        mOutputMode = mode;
+        SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        mRawMode = true;
+    }
+    #else
+    //Without a terminal on stdin (like a piped CI job) keys are simply never read
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &mSettings->saved) == 0)
+    {
+        termios raw = mSettings->saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        mRawMode = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+    #endif
+}
+
+CTerminalInput::~CTerminalInput()
+{
+    #ifdef _WIN32
+    if (mRawMode)
+    {
+        SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), mOutputMode);
+    }
+    #else
+    if (mRawMode)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &mSettings->saved);
+    }
+    #endif
+}
+
+int CTerminalInput::readByte()
+{
+    #ifdef _WIN32
+    return _kbhit() ? _getch() : -1;
+    #else
+    unsigned char c = 0;
+    return mRawMode && read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+    #endif
+}
+
+#ifndef _WIN32
+ETerminalKey CTerminalInput::readEscape()
+{
+    const int c = readByte();
+    if (c < 0)
+    {
+        if (std::chrono::steady_clock::now() - mEscapeTime < escapeTimeout)
+        {
+            return ETerminalKey::KEY_NONE;
+        }
+        const bool lone = mEscapeLength == 1;
+        mEscapeLength = 0;
+        return lone ? ETerminalKey::KEY_QUIT : ETerminalKey::KEY_NONE;
+    }
+    if (mEscapeLength == 1)
+    {
+        //Arrows come as ESC [ A..D, or as ESC O A..D in the application cursor mode
+        if (c != '[' && c != 'O')
+        {
+            mEscapeLength = 0;
+            return ETerminalKey::KEY_QUIT;
+        }
+        mEscapeLength = 2;
+        return readEscape();
+    }
+    mEscapeLength = 0;
+    switch (c)
+    {
+        case 'D': return ETerminalKey::KEY_LEFT;
+        case 'C': return ETerminalKey::KEY_RIGHT;
+        case 'A': return ETerminalKey::KEY_UP;
+        case 'B': return ETerminalKey::KEY_DOWN;
+        default: return ETerminalKey::KEY_NONE;
+    }
+}
+#endif
+
+ETerminalKey CTerminalInput::poll()
+{
+    #ifndef _WIN32
+    if (mEscapeLength > 0)
+    {
+        return readEscape();
+    }
+    #endif
+    const int c = readByte();
+    switch (c)
+    {
+        #ifdef _WIN32
+        //Arrows come as a prefix byte and a scan code
+        case 0:
+        case 224:
+            switch (readByte())
+            {
+                case 75: return ETerminalKey::KEY_LEFT;
+                case 77: return ETerminalKey::KEY_RIGHT;
+                case 72: return ETerminalKey::KEY_UP;
+                case 80: return ETerminalKey::KEY_DOWN;
+                default: return ETerminalKey::KEY_NONE;
+            }
+
+        //The console gives Esc as a single byte
+        case 27:
+            return ETerminalKey::KEY_QUIT;
+        #else
+        //An escape sequence, or the Esc key once the timeout has passed without one
+        case 27:
+            mEscapeLength = 1;
+            mEscapeTime = std::chrono::steady_clock::now();
+            return readEscape();
+        #endif
+        case 'n':
+        case 'N':
+            return ETerminalKey::KEY_NEW_GAME;
+
+        case 'p':
+        case 'P':
+            return ETerminalKey::KEY_PAUSE;
+
+        case 'r':
+        case 'R':
+            return ETerminalKey::KEY_RESET;
+
+        case 'q':
+        case 'Q':
+            return ETerminalKey::KEY_QUIT;
+
+        default:
+            return ETerminalKey::KEY_NONE;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <memory>
+
+enum class ETerminalKey
+{
+    KEY_NONE,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_NEW_GAME,
+    KEY_PAUSE,
+    KEY_RESET,
+    KEY_QUIT
+};
+
+//Reads keys from the console without waiting for enter and without echo.
+//The console mode is restored by the destructor.
+class CTerminalInput
+{
+public:
+    CTerminalInput();
+    ~CTerminalInput();
+
+    //Returns KEY_NONE when no key is waiting
+    ETerminalKey poll();
+
+    CTerminalInput(const CTerminalInput& other) = delete;
+    CTerminalInput& operator=(const CTerminalInput& other) = delete;
+
+private:
+    int readByte();
+    #ifndef _WIN32
+    ETerminalKey readEscape();
+    #endif
+
+private:
+    bool mRawMode;
+    #ifdef _WIN32
+    unsigned long mOutputMode;
+    #else
+    struct Settings;
+    std::unique_ptr<Settings> mSettings;
+    //Bytes of an escape sequence read so far, the rest may come with a later read
+    int mEscapeLength;
+    std::chrono::steady_clock::time_point mEscapeTime;
+    #endif
+};
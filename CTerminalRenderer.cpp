@@ -0,0 +1,256 @@
+#include "CTerminalRenderer.h"
+#include "CTracer.h"
+#include <algorithm>
+
+namespace
+{
+    const int figureCells = 4;
+    const int previewSpacing = 5;
+    const int previewColumns = 4;
+
+    //Cell styles: 0 is empty, 1..7 are block colours, ghosts are offset by ghostStyle
+    const uint8_t emptyStyle = 0;
+    const uint8_t ghostStyle = 8;
+    const uint8_t wallStyle = 16;
+    const uint8_t previewStyle = 1;
+
+    //Every screen cell is two characters wide, so blocks look square
+    const char* getCellText(uint8_t style)
+    {
+        return style > ghostStyle && style < wallStyle ? "[]" : "  ";
+    }
+
+    const char* getCellColor(uint8_t style)
+    {
+        static const char* const colors[] = {
+            "\x1b[0m", "\x1b[41m", "\x1b[42m", "\x1b[43m", "\x1b[44m", "\x1b[45m", "\x1b[46m", "\x1b[47m",
+            "\x1b[0m", "\x1b[0;31m", "\x1b[0;32m", "\x1b[0;33m", "\x1b[0;34m", "\x1b[0;35m", "\x1b[0;36m", "\x1b[0;37m",
+            "\x1b[100m"
+        };
+        return colors[style];
+    }
+}
+
+CTerminalRenderer::CTerminalRenderer(std::FILE* output)
+: mOutput(output)
+, mColumns(0)
+, mRows(0)
+, mCursorRow(0)
+, mCursorColumn(0)
+, mStyle(-1)
+, mValid(false)
+{
+    //A full redraw of a standard board is a few kilobytes, later frames reuse the storage
+    mBuffer.reserve(16 * 1024);
+    mStatus.reserve(128);
+    mShownStatus.reserve(128);
+}
+
+CTerminalRenderer::~CTerminalRenderer()
+{
+    //Leave the cursor under the board with the default colours
+    std::fprintf(mOutput, "\x1b[0m\x1b[%d;1H\x1b[?25h\n", mRows + 2);
+    std::fflush(mOutput);
+}
+
+void CTerminalRenderer::invalidate()
+{
+    mValid = false;
+}
+
+void CTerminalRenderer::resize(int fieldWidth, int fieldHeight)
+{
+    mColumns = fieldWidth + 2 + previewColumns + 1;
+    mRows = fieldHeight + 2;
+    mCells.assign(static_cast<size_t>(mColumns * mRows), emptyStyle);
+    mShownCells.assign(mCells.size(), emptyStyle);
+}
+
+void CTerminalRenderer::composeFrame(const game::CTetris& game)
+{
+    const int fieldWidth = game.getFieldWidth();
+    const int fieldHeight = game.getFieldHeight();
+    const game::TFieldType& field = game.getField();
+    auto cell = [this](int row, int column) -> uint8_t& {
+        return mCells[static_cast<size_t>(row * mColumns + column)];
+    };
+
+    std::fill(mCells.begin(), mCells.end(), emptyStyle);
+    for (int i = 0; i < mRows; ++i)
+    {
+        cell(i, 0) = wallStyle;
+        cell(i, fieldWidth + 1) = wallStyle;
+    }
+    for (int j = 0; j < fieldWidth + 2; ++j)
+    {
+        cell(0, j) = wallStyle;
+        cell(mRows - 1, j) = wallStyle;
+    }
+    for (int i = 0; i < fieldHeight; ++i)
+    {
+        for (int j = 0; j < fieldWidth; ++j)
+        {
+            cell(i + 1, j + 1) = static_cast<uint8_t>(field[i][j]);
+        }
+    }
+
+    const bool figureVisible = game.getGameState() == game::EGameState::STATE_INGAME ||
+                               game.getGameState() == game::EGameState::STATE_PAUSE;
+    if (!figureVisible)
+    {
+        return;
+    }
+
+    //The ghost is found the same way as in CBlocksRenderer: shift down while the figure fits
+    const game::Point* figure = game.getCurrentFigure();
+    const uint8_t color = static_cast<uint8_t>(game.getFigureColor());
+    auto fits = [&field, fieldWidth, fieldHeight, figure](int dy) {
+        for (int i = 0; i < figureCells; ++i)
+        {
+            const int x = figure[i].x;
+            const int y = figure[i].y + dy;
+            if (x < 0 || x >= fieldWidth || y >= fieldHeight || (y >= 0 && field[y][x]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    int ghostShift = 0;
+    while (fits(ghostShift + 1))
+    {
+        ++ghostShift;
+    }
+
+    for (int i = 0; i < figureCells; ++i)
+    {
+        const int ghostY = figure[i].y + ghostShift;
+        if (ghostY >= 0)
+        {
+            cell(ghostY + 1, figure[i].x + 1) = static_cast<uint8_t>(ghostStyle + color);
+        }
+    }
+    for (int i = 0; i < figureCells; ++i)
+    {
+        if (figure[i].y >= 0)
+        {
+            cell(figure[i].y + 1, figure[i].x + 1) = color;
+        }
+    }
+
+    //Previews are stacked next to the field as long as they fit in its height
+    for (int p = 0; p < game.getPreviewSize(); ++p)
+    {
+        const game::Point* nextFigure = game.getPreviewFigure(p);
+        for (int i = 0; i < figureCells; ++i)
+        {
+            const int row = 1 + p * previewSpacing + nextFigure[i].y;
+            if (row < mRows - 1)
+            {
+                cell(row, fieldWidth + 3 + nextFigure[i].x) = previewStyle;
+            }
+        }
+    }
+}
+
+void CTerminalRenderer::moveCursor(int row, int column)
+{
+    if (row == mCursorRow && column == mCursorColumn)
+    {
+        return;
+    }
+    char sequence[24];
+    const int length = std::snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", row + 1, column * 2 + 1);
+    mBuffer.append(sequence, static_cast<size_t>(length));
+    mCursorRow = row;
+    mCursorColumn = column;
+}
+
+void CTerminalRenderer::writeStatus(const game::CTetris& game)
+{
+    const char* state = "";
+    switch (game.getGameState())
+    {
+        case game::EGameState::STATE_MAIN_MENU:
+            state = "Press N to start new game";
+            break;
+
+        case game::EGameState::STATE_PAUSE:
+            state = "Pause";
+            break;
+
+        case game::EGameState::STATE_GAMEOVER:
+            state = "Game over";
+            break;
+
+        default:
+            break;
+    }
+
+    char status[128];
+    const int length = std::snprintf(status, sizeof(status), "Score: %d  Lines: %d  %s",
+                                     game.getScores(), game.getLines(), state);
+    mStatus.assign(status, length > 0 ? static_cast<size_t>(length) : 0);
+    if (mStatus == mShownStatus)
+    {
+        return;
+    }
+
+    moveCursor(mRows, 0);
+    mBuffer.append("\x1b[0m\x1b[2K");
+    mBuffer.append(mStatus);
+    mStyle = emptyStyle;
+    mShownStatus = mStatus;
+    //The cursor position after the text isn't tracked
+    mCursorRow = -1;
+}
+
+void CTerminalRenderer::update(const game::CTetris& game)
+{
+    TETRIS_TRACE_SCOPE("render terminal update");
+    mBuffer.clear();
+    if (mColumns != game.getFieldWidth() + 2 + previewColumns + 1 || mRows != game.getFieldHeight() + 2)
+    {
+        resize(game.getFieldWidth(), game.getFieldHeight());
+        mValid = false;
+    }
+    if (!mValid)
+    {
+        //Clear the screen and hide the cursor, then every cell is written once
+        mBuffer.append("\x1b[0m\x1b[2J\x1b[?25l");
+        mShownStatus.clear();
+        mStyle = emptyStyle;
+        mCursorRow = -1;
+    }
+
+    composeFrame(game);
+    for (int row = 0; row < mRows; ++row)
+    {
+        for (int column = 0; column < mColumns; ++column)
+        {
+            const size_t index = static_cast<size_t>(row * mColumns + column);
+            const uint8_t style = mCells[index];
+            if (mValid && style == mShownCells[index])
+            {
+                continue;
+            }
+            moveCursor(row, column);
+            if (style != mStyle)
+            {
+                mBuffer.append(getCellColor(style));
+                mStyle = style;
+            }
+            mBuffer.append(getCellText(style));
+            ++mCursorColumn;
+            mShownCells[index] = style;
+        }
+    }
+    writeStatus(game);
+    mValid = true;
+
+    if (!mBuffer.empty())
+    {
+        std::fwrite(mBuffer.data(), 1, mBuffer.size(), mOutput);
+        std::fflush(mOutput);
+    }
+}
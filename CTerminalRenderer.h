@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "CTetris.h"
+
+//Draws the game into an ANSI terminal. Every cell of the screen is kept from the last
+//frame and only the changed ones are written, so the output stays small over slow links.
+class CTerminalRenderer
+{
+public:
+    explicit CTerminalRenderer(std::FILE* output);
+    ~CTerminalRenderer();
+
+    void update(const game::CTetris& game);
+    void invalidate();
+
+    CTerminalRenderer(const CTerminalRenderer& other) = delete;
+    CTerminalRenderer& operator=(const CTerminalRenderer& other) = delete;
+
+private:
+    void resize(int fieldWidth, int fieldHeight);
+    void composeFrame(const game::CTetris& game);
+    void writeStatus(const game::CTetris& game);
+    void moveCursor(int row, int column);
+
+private:
+    std::FILE* mOutput;
+    std::vector<uint8_t> mCells;
+    std::vector<uint8_t> mShownCells;
+    std::string mStatus;
+    std::string mShownStatus;
+    std::string mBuffer;
+    int mColumns;
+    int mRows;
+    int mCursorRow;
+    int mCursorColumn;
+    int mStyle;
+    bool mValid;
+};
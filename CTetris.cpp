@@ -1,26 +1,48 @@
 #include "CTetris.h"
-#include <iostream>
+#include "CTracer.h"
+#include <algorithm>
+#include <array>
 
 namespace game
 {
+    const int CTetris::mFigures[CTetris::mFiguresCount][4] = {
+        1, 3, 5, 7,
+        2, 4, 5, 7,
+        3, 5, 4, 6,
+        3, 5, 4, 7,
+        2, 3, 5, 7,
+        3, 5, 7, 6,
+        2, 3, 4, 5
+    };
+
     CTetris::CTetris()
     : CTetris(mDefaultFieldWidth, mDefaultFieldHeight)
     {
     }
 
-    CTetris::CTetris(const int fieldWidth, const int fieldHeight)
+    CTetris::CTetris(const int fieldWidth, const int fieldHeight, const unsigned seed)
     : mFieldWidth(fieldWidth)
     , mFieldHeight(fieldHeight)
     , mCurrentFigure(-1)
-    , mNextFigure(-1)
     , mTime(0.)
     , mFigureColor(-1)
     , mCurrentSpeed(mDefaultSpeed)
     , mCurrentNumLines(0)
     , mScores(0)
+    , mLines(0)
+    , mFieldVersion(0)
     , mGameState(EGameState::STATE_MAIN_MENU)
+    , mRandom(seed)
+    , mSeed(seed)
+    , mQueueHead(0)
+    , mPreviewSize(1)
+    , mFigureGenerator(EFigureGenerator::GENERATOR_RANDOM)
+    , mBag(0)
+    , mPlayedBag(0)
+    , mSpawnedCount(0)
     {
         initField();
+        fillQueue();
         spawnFigure();
     }
 
@@ -35,6 +57,7 @@ namespace game
 
     void CTetris::resetField()
     {
+        ++mFieldVersion;
         for(int i = 0; i < mFieldHeight; ++i)
         {
             for(int j = 0; j < mFieldWidth; ++j)
@@ -44,27 +67,82 @@ namespace game
         }
     }
 
-    void CTetris::spawnFigure()
+    const Point* CTetris::getFigureShape(int figure)
+    {
+        static const auto shapes = []() {
+            std::array<std::array<Point, 4>, mFiguresCount> result;
+            for (int f = 0; f < mFiguresCount; ++f)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    result[f][i] = Point{mFigures[f][i] % 2, mFigures[f][i] / 2};
+                }
+            }
+            return result;
+        }();
+        return shapes[figure].data();
+    }
+
+    int CTetris::generateFigure()
     {
-        if (mNextFigure == -1)
+        if (mFigureGenerator == EFigureGenerator::GENERATOR_RANDOM)
         {
-            mNextFigure = rand() % 7;
-            mCurrentFigure = rand() % 7;
+            return mRandom() % mFiguresCount;
         }
-        else
+
+        if (mBag == 0)
         {
-            mCurrentFigure = mNextFigure;
-            mNextFigure = rand() % 7;
+            mBag = mAllFigures;
         }
 
-        mFigureColor = 1 + rand() % 7;
-        for (int i = 0; i < 4; i++)
+        int count = 0;
+        for (int f = 0; f < mFiguresCount; ++f)
+        {
+            count += (mBag >> f) & 1;
+        }
+
+        int index = mRandom() % count;
+        int figure = 0;
+        while (!((mBag >> figure) & 1) || index-- > 0)
         {
-            mA[i].x = (mFigures[mCurrentFigure][i] % 2) + mFieldWidth / 2;
-            mA[i].y = (mFigures[mCurrentFigure][i] / 2) - 3;
+            ++figure;
+        }
+        mBag &= ~(1u << figure);
+        return figure;
+    }
 
-            mNext[i].x = mFigures[mNextFigure][i] % 2;
-            mNext[i].y = mFigures[mNextFigure][i] / 2;
+    void CTetris::fillQueue()
+    {
+        mQueueHead = 0;
+        mBag = 0;
+        mPlayedBag = 0;
+        mSpawnedCount = 0;
+        for (int i = 0; i < mMaxPreviewSize; ++i)
+        {
+            mQueue[i] = generateFigure();
+        }
+    }
+
+    void CTetris::spawnFigure()
+    {
+        TETRIS_TRACE_SCOPE("CTetris::spawnFigure");
+        mCurrentFigure = mQueue[mQueueHead];
+        mQueue[mQueueHead] = generateFigure();
+        mQueueHead = (mQueueHead + 1) % mMaxPreviewSize;
+
+        if (mSpawnedCount % mFiguresCount == 0)
+        {
+            mPlayedBag = 0;
+        }
+        mPlayedBag |= 1u << mCurrentFigure;
+        ++mSpawnedCount;
+
+        mFigureColor = 1 + mRandom() % 7;
+        const Point* shape = getFigureShape(mCurrentFigure);
+        for (int i = 0; i < 4; i++)
+        {
+            mA[i].x = shape[i].x + mFieldWidth / 2;
+            mA[i].y = shape[i].y - 3;
         }
     }
 
@@ -148,6 +226,7 @@ namespace game
 
     void CTetris::update(float dt)
     {
+        TETRIS_TRACE_SCOPE("CTetris::update");
         if(mGameState != EGameState::STATE_INGAME)
         {
             return;
@@ -166,55 +245,173 @@ namespace game
                 for (int i = 0; i < 4; ++i)
                 {
                     mA[i] = mB[i];
-                    if(mA[i].y <= 0)
-                    {
-                        mGameState = EGameState::STATE_GAMEOVER;
-                        std::cout << "Game over" << std::endl;
-                    }
-
-                    if(mA[i].y >= 0)
-                    {
-                        mField[mA[i].y][mA[i].x] = mFigureColor;
-                    } 
                 }
+                lockFigure();
+            }
+            mTime = 0.;
+            mCurrentSpeed = mDefaultSpeed;
+        }
+    }
+
+    int CTetris::getUpdatesUntilStep(float dt) const
+    {
+        if (mGameState != EGameState::STATE_INGAME || dt <= 0.0f)
+        {
+            return 0;
+        }
+        //The same float additions as update, so the result matches it exactly
+        float time = mTime;
+        int updates = 0;
+        do
+        {
+            time += dt;
+            ++updates;
+        }
+        while (!(time > mCurrentSpeed));
+        return updates;
+    }
 
-                if(mGameState != EGameState::STATE_GAMEOVER)
+    void CTetris::addGarbageLines(int count, int holeColumn)
+    {
+        if (mGameState != EGameState::STATE_INGAME || count <= 0)
+        {
+            return;
+        }
+        count = count < mFieldHeight ? count : mFieldHeight;
+        ++mFieldVersion;
+
+        //Blocks pushed out of the top end the game
+        for (int i = 0; i < count; ++i)
+        {
+            for (int j = 0; j < mFieldWidth; ++j)
+            {
+                if (mField[i][j])
                 {
-                    spawnFigure();
-                    scanLines();
+                    mGameState = EGameState::STATE_GAMEOVER;
                 }
+            }
+        }
+
+        //Rotating the rows swaps their storage, the rows coming to the bottom are refilled
+        std::rotate(mField.begin(), mField.begin() + count, mField.end());
+        for (int i = mFieldHeight - count; i < mFieldHeight; ++i)
+        {
+            for (int j = 0; j < mFieldWidth; ++j)
+            {
+                mField[i][j] = j == holeColumn ? 0 : mGarbageColor;
+            }
+        }
 
-                if(mCurrentNumLines != 0)
+        //The falling figure is lifted when the new rows reach it
+        while (isCollided())
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                mA[i].y -= 1;
+            }
+        }
+    }
+
+    void CTetris::hardDrop()
+    {
+        if(mGameState != EGameState::STATE_INGAME)
+        {
+            return;
+        }
+
+        while (true)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                mB[i] = mA[i];
+                mA[i].y += 1;
+            }
+            if (isCollided())
+            {
+                for (int i = 0; i < 4; ++i)
                 {
-                    switch(mCurrentNumLines)
-                    {
-                        case 1:
-                            mScores += 100;
-                            break;
-
-                        case 2:
-                            mScores += 250;
-                            break;
-                        
-                        case 3:
-                            mScores += 350;
-                            break;
-
-                        case 4:
-                            mScores += 700;
-                            break;
-                    }
-                    std::cout << mScores << std::endl;
-                    mCurrentNumLines = 0;
+                    mA[i] = mB[i];
                 }
+                break;
             }
-            mTime = 0.;
-            mCurrentSpeed = mDefaultSpeed;
+        }
+        lockFigure();
+        mTime = 0.;
+        mCurrentSpeed = mDefaultSpeed;
+    }
+
+    void CTetris::place(const Placement& placement)
+    {
+        for (int i = 0; i < placement.rotation; ++i)
+        {
+            rotate();
+        }
+
+        //Move one column at a time so a blocked path stops the figure the same way the keyboard does
+        int deltaX = placement.column - mA[1].x;
+        int step = deltaX < 0 ? -1 : 1;
+        for (int i = 0; i != deltaX; i += step)
+        {
+            int x = mA[1].x;
+            move(step);
+            if (mA[1].x == x)
+            {
+                break;
+            }
+        }
+        hardDrop();
+    }
+
+    void CTetris::lockFigure()
+    {
+        ++mFieldVersion;
+        for (int i = 0; i < 4; ++i)
+        {
+            if(mA[i].y <= 0)
+            {
+                mGameState = EGameState::STATE_GAMEOVER;
+            }
+
+            if(mA[i].y >= 0)
+            {
+                mField[mA[i].y][mA[i].x] = mFigureColor;
+            } 
+        }
+
+        if(mGameState != EGameState::STATE_GAMEOVER)
+        {
+            spawnFigure();
+            scanLines();
+        }
+
+        if(mCurrentNumLines != 0)
+        {
+            switch(mCurrentNumLines)
+            {
+                case 1:
+                    mScores += 100;
+                    break;
+
+                case 2:
+                    mScores += 250;
+                    break;
+                
+                case 3:
+                    mScores += 350;
+                    break;
+
+                case 4:
+                    mScores += 700;
+                    break;
+            }
+            mLines += mCurrentNumLines;
+            mCurrentNumLines = 0;
         }
     }
 
     void CTetris::scanLines()
     {
+        TETRIS_TRACE_SCOPE("CTetris::scanLines");
         int lines = mFieldHeight - 1;
         for (int i = mFieldHeight - 1; i > 0; --i)
         {
@@ -243,9 +440,85 @@ namespace game
         return mScores;
     }
 
+    const int CTetris::getLines() const
+    {
+        return mLines;
+    }
+
+    const unsigned CTetris::getFieldVersion() const
+    {
+        return mFieldVersion;
+    }
+
+    const int CTetris::getCurrentFigureId() const
+    {
+        return mCurrentFigure;
+    }
+
+    const int CTetris::getNextFigureId() const
+    {
+        return getPreviewFigureId(0);
+    }
+
+    const int CTetris::getPreviewFigureId(int index) const
+    {
+        return mQueue[(mQueueHead + index) % mMaxPreviewSize];
+    }
+
+    const Point* CTetris::getPreviewFigure(int index) const
+    {
+        return getFigureShape(getPreviewFigureId(index));
+    }
+
+    const int CTetris::getPreviewSize() const
+    {
+        return mPreviewSize;
+    }
+
+    void CTetris::setPreviewSize(int size)
+    {
+        mPreviewSize = size < 1 ? 1 : (size > mMaxPreviewSize ? mMaxPreviewSize : size);
+    }
+
+    void CTetris::setFigureGenerator(EFigureGenerator generator)
+    {
+        //Set it before resetGame(seed): the bag bookkeeping starts with the refilled queue
+        mFigureGenerator = generator;
+    }
+
+    const EFigureGenerator CTetris::getFigureGenerator() const
+    {
+        return mFigureGenerator;
+    }
+
+    const unsigned CTetris::getRemainingFigures() const
+    {
+        //Mask of figures which may follow the last visible preview
+        if (mFigureGenerator == EFigureGenerator::GENERATOR_RANDOM)
+        {
+            return mAllFigures;
+        }
+
+        //Bags start at every 7th figure since the reset. Collect the figures of the
+        //bag which holds the first hidden figure and are already known to the player
+        int current = mSpawnedCount - 1;
+        int hidden = current + 1 + mPreviewSize;
+        int bagStart = hidden - hidden % mFiguresCount;
+        unsigned drawn = 0;
+        for (int i = std::max(bagStart, current); i < hidden; ++i)
+        {
+            drawn |= 1u << (i == current ? mCurrentFigure : getPreviewFigureId(i - current - 1));
+        }
+        if (bagStart < current)
+        {
+            drawn |= mPlayedBag;
+        }
+        return mAllFigures & ~drawn;
+    }
+
     const Point* CTetris::getNextFigure() const
     {
-        return &mNext[0];
+        return getPreviewFigure(0);
     }
 
     const int CTetris::getFieldWidth() const
@@ -287,7 +560,28 @@ namespace game
             resetField();
             spawnFigure();
             mScores = 0;
+            mLines = 0;
             mGameState = EGameState::STATE_INGAME;
         }
     }
-}
\ No newline at end of file
+
+    void CTetris::resetGame(const unsigned seed)
+    {
+        mRandom.seed(seed);
+        mSeed = seed;
+        fillQueue();
+        mTime = 0.;
+        mCurrentSpeed = mDefaultSpeed;
+        mCurrentNumLines = 0;
+        mLines = 0;
+        resetField();
+        spawnFigure();
+        mScores = 0;
+        mGameState = EGameState::STATE_INGAME;
+    }
+
+    const unsigned CTetris::getSeed() const
+    {
+        return mSeed;
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <random>
 
 namespace game
 {
@@ -15,41 +16,81 @@ enum class EGameState
     STATE_GAMEOVER
 };
 
+enum class EFigureGenerator
+{
+    GENERATOR_RANDOM,
+    GENERATOR_BAG
+};
+
 struct Point
 {
     int x;
     int y;
 };
 
+struct Placement
+{
+    int rotation;
+    int column;
+};
+
 class CTetris
 {
 public: 
+    static const int mFiguresCount = 7;
+    static const int mMaxPreviewSize = 14;
+    static const int mGarbageColor = 1;
+    static const unsigned mAllFigures = (1u << mFiguresCount) - 1;
+
     CTetris();
-    CTetris(const int fieldWidth, const int fieldHeight);
+    CTetris(const int fieldWidth, const int fieldHeight, const unsigned seed = mDefaultSeed);
     ~CTetris() = default;
     const TFieldType& getField() const;
+    //Changes whenever settled cells change, so views of the field can be cached until then
+    const unsigned getFieldVersion() const;
     void move(int deltaX);
     void rotate();
     void drop();
+    void hardDrop();
+    void place(const Placement& placement);
+    //Pushes the field up by rows filled except one column, like an opponent's attack in versus play
+    void addGarbageLines(int count, int holeColumn);
     void update(float dt);
+    //Calls of update(dt) until the one which moves the figure down, 0 when the game doesn't run
+    int getUpdatesUntilStep(float dt) const;
     const Point* getCurrentFigure() const;
     const Point* getNextFigure() const;
+    const Point* getPreviewFigure(int index) const;
+    const int getCurrentFigureId() const;
+    const int getNextFigureId() const;
+    const int getPreviewFigureId(int index) const;
+    const int getPreviewSize() const;
+    void setPreviewSize(int size);
+    void setFigureGenerator(EFigureGenerator generator);
+    const EFigureGenerator getFigureGenerator() const;
+    const unsigned getRemainingFigures() const;
     const int getFigureColor() const;
     const int getScores() const;
+    const int getLines() const;
     const int getFieldWidth() const;
     const int getFieldHeight() const;
     void setGameState(EGameState state);
     const EGameState getGameState() const;
     void setGamePause();
     void resetGame();
+    void resetGame(const unsigned seed);
+    //Seed of the construction or of the last resetGame(seed)
+    const unsigned getSeed() const;
 
-    CTetris(const CTetris& other) = delete;
-    CTetris& operator=(const CTetris& other) = delete;
+    static const Point* getFigureShape(int figure);
 
 private:
     void initField();
     void resetField();
+    int generateFigure();
+    void fillQueue();
     void spawnFigure();
+    void lockFigure();
     bool isCollided();
     void scanLines();
 
@@ -57,33 +98,39 @@ private:
     int mFieldWidth;
     int mFieldHeight;
     int mCurrentFigure;
-    int mNextFigure;
     TFieldType mField;
     float mTime;
     int mFigureColor;
     float mCurrentSpeed;
     int mCurrentNumLines;
     int mScores;
+    int mLines;
+    unsigned mFieldVersion;
     EGameState mGameState;
+    std::minstd_rand mRandom;
+    unsigned mSeed;
+
+    //Upcoming figures. The ring is always kept full, so the figure sequence
+    //doesn't depend on how many of them are shown
+    int mQueue[mMaxPreviewSize];
+    int mQueueHead;
+    int mPreviewSize;
+
+    EFigureGenerator mFigureGenerator;
+    unsigned mBag;
+    unsigned mPlayedBag;
+    int mSpawnedCount;
 
     static const int mDefaultFieldWidth = 10;
     static const int mDefaultFieldHeight = 20;
-    const float mDefaultSpeed = 0.3f;
-    const float mDropDefaultSpeed = 0.01f;
+    static const unsigned mDefaultSeed = 1;
+    static constexpr float mDefaultSpeed = 0.3f;
+    static constexpr float mDropDefaultSpeed = 0.01f;
 
     Point mA[4];
     Point mB[4];
-    Point mNext[4];
-
-    int mFigures[7][4] = {
-        1, 3, 5, 7,
-        2, 4, 5, 7,
-        3, 5, 4, 6,
-        3, 5, 4, 7,
-        2, 3, 5, 7,
-        3, 5, 7, 6,
-        2, 3, 4, 5
-    };
+
+    static const int mFigures[mFiguresCount][4];
 };
 
 }
@@ -0,0 +1,109 @@
+#include "CTimerWheel.h"
+
+namespace game
+{
+    CTimerWheel::CTimerWheel(uint64_t now)
+    : mNow(now)
+    {
+        for (auto& level : mSlots)
+        {
+            for (TimerNode& slot : level)
+            {
+                slot.prev = &slot;
+                slot.next = &slot;
+            }
+        }
+    }
+
+    void CTimerWheel::schedule(TimerNode& node, uint64_t expires)
+    {
+        cancel(node);
+        node.expires = expires > mNow ? expires : mNow + 1;
+        insert(node);
+    }
+
+    void CTimerWheel::cancel(TimerNode& node)
+    {
+        if (node.next)
+        {
+            node.prev->next = node.next;
+            node.next->prev = node.prev;
+            node.prev = nullptr;
+            node.next = nullptr;
+        }
+    }
+
+    bool CTimerWheel::isScheduled(const TimerNode& node) const
+    {
+        return node.next != nullptr;
+    }
+
+    void CTimerWheel::insert(TimerNode& node)
+    {
+        //The level is the lowest one whose slot for the tick is still ahead in its current turn
+        int level = 0;
+        int shift = 0;
+        while (level < mLevelsCount - 1 && (node.expires >> shift) - (mNow >> shift) >= mSlotsCount)
+        {
+            ++level;
+            shift += mSlotBits;
+        }
+        //Too far for the top level: wait in its last slot and get placed again when it cascades
+        if ((node.expires >> shift) - (mNow >> shift) >= mSlotsCount)
+        {
+            node.expires = ((mNow >> shift) + mSlotsCount - 1) << shift;
+        }
+
+        TimerNode& slot = mSlots[level][(node.expires >> shift) & (mSlotsCount - 1)];
+        node.prev = slot.prev;
+        node.next = &slot;
+        slot.prev->next = &node;
+        slot.prev = &node;
+    }
+
+    void CTimerWheel::cascade(int level)
+    {
+        TimerNode& slot = mSlots[level][(mNow >> (level * mSlotBits)) & (mSlotsCount - 1)];
+        TimerNode* node = slot.next;
+        slot.prev = &slot;
+        slot.next = &slot;
+        while (node != &slot)
+        {
+            TimerNode* next = node->next;
+            insert(*node);
+            node = next;
+        }
+    }
+
+    void CTimerWheel::advance(uint64_t now, const TTimerCallback& onExpired)
+    {
+        while (mNow < now)
+        {
+            ++mNow;
+            //Entering a new turn of a level moves the timers of its current slot a level down.
+            //Higher levels go first, their timers may land in the current slot of a lower level.
+            int levels = 1;
+            while (levels < mLevelsCount && (mNow & ((uint64_t(1) << (levels * mSlotBits)) - 1)) == 0)
+            {
+                ++levels;
+            }
+            for (int level = levels - 1; level > 0; --level)
+            {
+                cascade(level);
+            }
+
+            TimerNode& slot = mSlots[0][mNow & (mSlotsCount - 1)];
+            while (slot.next != &slot)
+            {
+                TimerNode& node = *slot.next;
+                cancel(node);
+                onExpired(node);
+            }
+        }
+    }
+
+    uint64_t CTimerWheel::getNow() const
+    {
+        return mNow;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <functional>
+
+namespace game
+{
+
+//Link of a timer, embedded in the object it belongs to
+struct TimerNode
+{
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expires = 0;
+};
+
+//Hierarchical timer wheel over integer ticks. Scheduling and cancelling are O(1), advancing costs
+//one slot per tick plus the timers which expire or move down a level, however many are waiting.
+//Level 0 has a slot per tick, each next level a slot per 64 ticks of the previous one.
+class CTimerWheel
+{
+public:
+    using TTimerCallback = std::function<void(TimerNode& node)>;
+
+    static const int mLevelsCount = 4;
+    static const int mSlotBits = 6;
+    static const int mSlotsCount = 1 << mSlotBits;
+
+    explicit CTimerWheel(uint64_t now = 0);
+
+    //A tick which already passed fires on the next advance, ticks past the range are clamped to it
+    void schedule(TimerNode& node, uint64_t expires);
+    void cancel(TimerNode& node);
+    bool isScheduled(const TimerNode& node) const;
+    //Fires the timers up to the tick in the order of their ticks, the callback may schedule again
+    void advance(uint64_t now, const TTimerCallback& onExpired);
+    uint64_t getNow() const;
+
+    CTimerWheel(const CTimerWheel& other) = delete;
+    CTimerWheel& operator=(const CTimerWheel& other) = delete;
+
+private:
+    void insert(TimerNode& node);
+    void cascade(int level);
+
+private:
+    //Slots are circular lists around a sentinel, so unlinking needs no slot lookup
+    std::array<std::array<TimerNode, mSlotsCount>, mLevelsCount> mSlots;
+    uint64_t mNow;
+};
+
+}
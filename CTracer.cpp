@@ -0,0 +1,143 @@
+#include "CTracer.h"
+#include <fstream>
+
+namespace game
+{
+    //Gives every thread its own buffer on first use and hands it back when the thread ends,
+    //so short-lived worker threads reuse buffers instead of adding new ones
+    struct CTracer::ThreadSlot
+    {
+        ThreadBuffer* buffer = nullptr;
+
+        ~ThreadSlot()
+        {
+            if (buffer)
+            {
+                buffer->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    CTracer::CTracer()
+    : mEnabled(false)
+    , mTraceStart(0)
+    , mEpoch(std::chrono::steady_clock::now())
+    {
+    }
+
+    CTracer& CTracer::getInstance()
+    {
+        static CTracer tracer;
+        return tracer;
+    }
+
+    void CTracer::setEnabled(bool enabled)
+    {
+        //The rings belong to their threads, so instead of clearing them the older spans are skipped on writing
+        if (enabled && !mEnabled.load(std::memory_order_relaxed))
+        {
+            mTraceStart.store(now(), std::memory_order_relaxed);
+        }
+        mEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    int64_t CTracer::now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mEpoch).count();
+    }
+
+    CTracer::ThreadBuffer* CTracer::acquireBuffer()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& buffer : mBuffers)
+        {
+            bool expected = false;
+            if (buffer->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                return buffer.get();
+            }
+        }
+
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->events.reset(new Event[mEventsPerThread]);
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->inUse.store(true, std::memory_order_relaxed);
+        buffer->id = static_cast<int>(mBuffers.size()) + 1;
+        mBuffers.push_back(std::move(buffer));
+        return mBuffers.back().get();
+    }
+
+    void CTracer::record(const char* name, int64_t start, int64_t end)
+    {
+        thread_local ThreadSlot slot;
+        if (slot.buffer == nullptr)
+        {
+            slot.buffer = acquireBuffer();
+        }
+
+        ThreadBuffer& buffer = *slot.buffer;
+        const size_t index = buffer.count.load(std::memory_order_relaxed);
+        Event& event = buffer.events[index % mEventsPerThread];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.duration.store(end - start, std::memory_order_relaxed);
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    bool CTracer::writeJson(const std::string& path)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        struct Copy
+        {
+            const char* name;
+            int64_t start;
+            int64_t duration;
+        };
+        std::vector<Copy> events;
+        events.reserve(mEventsPerThread);
+
+        file << std::fixed;
+        file.precision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& buffer : mBuffers)
+        {
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                 << ",\"args\":{\"name\":\"thread " << buffer->id << "\"}}";
+            first = false;
+
+            //Events older than one ring behind the writer may be overwritten while copying, they are dropped
+            const size_t count = buffer->count.load(std::memory_order_acquire);
+            const size_t begin = count > mEventsPerThread ? count - mEventsPerThread : 0;
+            events.clear();
+            for (size_t i = begin; i < count; ++i)
+            {
+                const Event& event = buffer->events[i % mEventsPerThread];
+                events.push_back(Copy{event.name.load(std::memory_order_relaxed),
+                                      event.start.load(std::memory_order_relaxed),
+                                      event.duration.load(std::memory_order_relaxed)});
+            }
+            const size_t countAfter = buffer->count.load(std::memory_order_acquire);
+            const size_t valid = countAfter > mEventsPerThread ? countAfter - mEventsPerThread : 0;
+
+            const int64_t traceStart = mTraceStart.load(std::memory_order_relaxed);
+            for (size_t i = valid > begin ? valid - begin : 0; i < events.size(); ++i)
+            {
+                if (events[i].start < traceStart)
+                {
+                    continue;
+                }
+                file << ",\n{\"name\":\"" << events[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                     << ",\"ts\":" << events[i].start / 1000.0 << ",\"dur\":" << events[i].duration / 1000.0 << "}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace game
+{
+
+//Collects timed spans into preallocated per-thread rings and writes them as Chrome
+//trace events (chrome://tracing, ui.perfetto.dev). Span names must be string literals.
+//Enabling it again starts a new trace, the spans of the previous one are not written.
+class CTracer
+{
+public:
+    static const size_t mEventsPerThread = 1 << 14;
+
+    static CTracer& getInstance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+    int64_t now() const;
+    void record(const char* name, int64_t start, int64_t end);
+    bool writeJson(const std::string& path);
+
+    CTracer(const CTracer& other) = delete;
+    CTracer& operator=(const CTracer& other) = delete;
+
+private:
+    struct Event
+    {
+        std::atomic<const char*> name;
+        std::atomic<int64_t> start;
+        std::atomic<int64_t> duration;
+    };
+
+    struct ThreadBuffer
+    {
+        std::unique_ptr<Event[]> events;
+        std::atomic<size_t> count;
+        std::atomic<bool> inUse;
+        int id;
+    };
+
+    struct ThreadSlot;
+
+    CTracer();
+    ThreadBuffer* acquireBuffer();
+
+private:
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+    std::atomic<bool> mEnabled;
+    std::atomic<int64_t> mTraceStart;
+    const std::chrono::steady_clock::time_point mEpoch;
+};
+
+class CTraceScope
+{
+public:
+    explicit CTraceScope(const char* name)
+    : mName(CTracer::getInstance().isEnabled() ? name : nullptr)
+    , mStart(mName ? CTracer::getInstance().now() : 0)
+    {
+    }
+
+    ~CTraceScope()
+    {
+        if (mName)
+        {
+            CTracer& tracer = CTracer::getInstance();
+            tracer.record(mName, mStart, tracer.now());
+        }
+    }
+
+    CTraceScope(const CTraceScope& other) = delete;
+    CTraceScope& operator=(const CTraceScope& other) = delete;
+
+private:
+    const char* mName;
+    int64_t mStart;
+};
+
+}
+
+#define TETRIS_TRACE_CONCAT_IMPL(a, b) a##b
+#define TETRIS_TRACE_CONCAT(a, b) TETRIS_TRACE_CONCAT_IMPL(a, b)
+#define TETRIS_TRACE_SCOPE(name) game::CTraceScope TETRIS_TRACE_CONCAT(traceScope, __LINE__)(name)
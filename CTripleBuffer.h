@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+
+namespace game
+{
+
+//Lock-free handoff of the latest value from one writer thread to one reader thread.
+//The writer fills the back buffer and publishes it, the reader always gets the newest
+//published buffer. Neither side ever waits for the other.
+template <typename T>
+class CTripleBuffer
+{
+public:
+    explicit CTripleBuffer(const T& initial)
+    : mBuffers{initial, initial, initial}
+    , mBack(0)
+    , mMiddle(1)
+    , mFront(2)
+    {
+    }
+
+    T& getWriteBuffer()
+    {
+        return mBuffers[mBack];
+    }
+
+    void publish()
+    {
+        mBack = mMiddle.exchange(mBack | mFreshFlag, std::memory_order_acq_rel) & mIndexMask;
+    }
+
+    const T& getReadBuffer()
+    {
+        if (mMiddle.load(std::memory_order_relaxed) & mFreshFlag)
+        {
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & mIndexMask;
+        }
+        return mBuffers[mFront];
+    }
+
+    CTripleBuffer(const CTripleBuffer& other) = delete;
+    CTripleBuffer& operator=(const CTripleBuffer& other) = delete;
+
+private:
+    static const int mIndexMask = 3;
+    static const int mFreshFlag = 4;
+
+    T mBuffers[3];
+    int mBack;
+    std::atomic<int> mMiddle;
+    int mFront;
+};
+
+}
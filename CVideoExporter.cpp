@@ -0,0 +1,218 @@
+#include "CVideoExporter.h"
+#include "CTracer.h"
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    //BT.601 full range (the "jpeg" colour space of Y4M) in 16.16 fixed point
+    inline uint8_t toLuma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+    }
+
+    inline uint8_t toChromaBlue(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16) + 128);
+    }
+
+    inline uint8_t toChromaRed(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((32768 * r - 27439 * g - 5329 * b + 32768) >> 16) + 128);
+    }
+}
+
+CVideoExporter::CVideoExporter(const CSoftwareRenderer& renderer, const VideoExportConfig& config)
+: mRenderer(renderer)
+, mConfig(config)
+, mQueuedCount(0)
+, mWrittenCount(0)
+, mFinished(false)
+, mFailed(false)
+{
+    if (mConfig.threadsCount == 0)
+    {
+        mConfig.threadsCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (mConfig.framesInFlight == 0)
+    {
+        mConfig.framesInFlight = mConfig.threadsCount * 2;
+    }
+    mConfig.framesPerSecond = std::max(1, mConfig.framesPerSecond);
+}
+
+void CVideoExporter::convertToYuv(Frame& frame) const
+{
+    const unsigned width = mRenderer.getWidth();
+    const unsigned height = mRenderer.getHeight();
+    const unsigned chromaWidth = (width + 1) / 2;
+    const unsigned chromaHeight = (height + 1) / 2;
+    uint8_t* luma = frame.planes.data();
+    uint8_t* blue = luma + static_cast<size_t>(width) * height;
+    uint8_t* red = blue + static_cast<size_t>(chromaWidth) * chromaHeight;
+    const uint8_t* pixels = frame.pixels.data();
+
+    for (unsigned y = 0; y < height; ++y)
+    {
+        const uint8_t* p = pixels + static_cast<size_t>(y) * width * 4;
+        for (unsigned x = 0; x < width; ++x, p += 4)
+        {
+            luma[static_cast<size_t>(y) * width + x] = toLuma(p[0], p[1], p[2]);
+        }
+    }
+
+    //Chroma of a 2x2 block is taken from its average colour, odd sizes repeat the last row or column
+    for (unsigned cy = 0; cy < chromaHeight; ++cy)
+    {
+        const unsigned y0 = cy * 2;
+        const unsigned y1 = y0 + 1 < height ? y0 + 1 : y0;
+        for (unsigned cx = 0; cx < chromaWidth; ++cx)
+        {
+            const unsigned x0 = cx * 2;
+            const unsigned x1 = x0 + 1 < width ? x0 + 1 : x0;
+            const uint8_t* p00 = pixels + (static_cast<size_t>(y0) * width + x0) * 4;
+            const uint8_t* p01 = pixels + (static_cast<size_t>(y0) * width + x1) * 4;
+            const uint8_t* p10 = pixels + (static_cast<size_t>(y1) * width + x0) * 4;
+            const uint8_t* p11 = pixels + (static_cast<size_t>(y1) * width + x1) * 4;
+            const int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+            const int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+            const int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+            blue[static_cast<size_t>(cy) * chromaWidth + cx] = toChromaBlue(r, g, b);
+            red[static_cast<size_t>(cy) * chromaWidth + cx] = toChromaRed(r, g, b);
+        }
+    }
+}
+
+void CVideoExporter::renderFrames(CSoftwareRenderer renderer)
+{
+    const size_t stride = static_cast<size_t>(renderer.getWidth()) * 4;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        //Take the oldest queued frame, the writer waits for them in order
+        Frame* frame = nullptr;
+        mFrameQueued.wait(lock, [this, &frame]() {
+            for (size_t i = mWrittenCount; i < mQueuedCount && !frame; ++i)
+            {
+                Frame& candidate = mFrames[i % mFrames.size()];
+                frame = candidate.state == EFrameState::FRAME_QUEUED ? &candidate : nullptr;
+            }
+            return frame || mFinished || mFailed;
+        });
+        if (!frame)
+        {
+            return;
+        }
+
+        frame->state = EFrameState::FRAME_RENDERING;
+        lock.unlock();
+        {
+            TETRIS_TRACE_SCOPE("export frame");
+            renderer.render(frame->game, frame->pixels.data(), stride);
+            convertToYuv(*frame);
+        }
+        lock.lock();
+        frame->state = EFrameState::FRAME_DONE;
+        mFrameDone.notify_all();
+    }
+}
+
+void CVideoExporter::writeFrames(std::FILE* output)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        Frame& frame = mFrames[mWrittenCount % mFrames.size()];
+        mFrameDone.wait(lock, [this, &frame]() {
+            return (mWrittenCount < mQueuedCount && frame.state == EFrameState::FRAME_DONE) ||
+                   (mFinished && mWrittenCount == mQueuedCount);
+        });
+        if (mWrittenCount == mQueuedCount)
+        {
+            return;
+        }
+
+        lock.unlock();
+        const bool written = std::fputs("FRAME\n", output) >= 0 &&
+                             std::fwrite(frame.planes.data(), 1, frame.planes.size(), output) == frame.planes.size();
+        lock.lock();
+        frame.state = EFrameState::FRAME_FREE;
+        ++mWrittenCount;
+        if (!written)
+        {
+            mFailed = true;
+            mFrameQueued.notify_all();
+            mFrameFree.notify_all();
+            return;
+        }
+        mFrameFree.notify_all();
+    }
+}
+
+int CVideoExporter::exportY4m(const game::CReplay& replay, std::FILE* output)
+{
+    const unsigned width = mRenderer.getWidth();
+    const unsigned height = mRenderer.getHeight();
+    const size_t planesSize = static_cast<size_t>(width) * height + 2 * static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+    mFrames.resize(mConfig.framesInFlight);
+    for (Frame& frame : mFrames)
+    {
+        frame.game = replay.createGame();
+        frame.pixels.resize(static_cast<size_t>(width) * height * 4);
+        frame.planes.resize(planesSize);
+        frame.state = EFrameState::FRAME_FREE;
+    }
+    mQueuedCount = 0;
+    mWrittenCount = 0;
+    mFinished = false;
+    mFailed = false;
+
+    if (std::fprintf(output, "YUV4MPEG2 W%u H%u F%d:1 Ip A1:1 C420jpeg\n", width, height, mConfig.framesPerSecond) < 0)
+    {
+        return -1;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(mConfig.threadsCount + 1);
+    threads.emplace_back(&CVideoExporter::writeFrames, this, output);
+    for (unsigned i = 0; i < mConfig.threadsCount; ++i)
+    {
+        threads.emplace_back(&CVideoExporter::renderFrames, this, mRenderer);
+    }
+
+    //A frame is taken whenever the video time passes the next frame, so any tick rate maps to the frame rate
+    const uint64_t tickRate = static_cast<uint64_t>(replay.getTickRate());
+    const uint64_t framesPerSecond = static_cast<uint64_t>(mConfig.framesPerSecond);
+    replay.play([this, tickRate, framesPerSecond](const game::CTetris& game, uint32_t tick) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mFailed && mQueuedCount * tickRate < (tick + 1ull) * framesPerSecond)
+        {
+            Frame& frame = mFrames[mQueuedCount % mFrames.size()];
+            mFrameFree.wait(lock, [this, &frame]() {
+                return frame.state == EFrameState::FRAME_FREE || mFailed;
+            });
+            if (mFailed)
+            {
+                break;
+            }
+            //The copy reuses the field storage of the frame
+            frame.game = game;
+            frame.state = EFrameState::FRAME_QUEUED;
+            ++mQueuedCount;
+            mFrameQueued.notify_one();
+        }
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinished = true;
+    }
+    mFrameQueued.notify_all();
+    mFrameDone.notify_all();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    std::fflush(output);
+    return mFailed ? -1 : static_cast<int>(mWrittenCount);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "CReplay.h"
+#include "CSoftwareRenderer.h"
+
+struct VideoExportConfig
+{
+    int framesPerSecond = 30;
+    unsigned threadsCount = 0; //0 means one per core
+    unsigned framesInFlight = 0; //0 means two per thread
+};
+
+//Turns a replay into a YUV4MPEG2 (4:2:0) stream. The replay is simulated on the calling thread,
+//workers render and convert the frames in parallel and a writer thread streams them in order.
+//Only framesInFlight frames exist at a time, so memory doesn't grow with the replay length.
+class CVideoExporter
+{
+public:
+    CVideoExporter(const CSoftwareRenderer& renderer, const VideoExportConfig& config);
+
+    //Returns the number of written frames, or -1 when writing fails
+    int exportY4m(const game::CReplay& replay, std::FILE* output);
+
+    CVideoExporter(const CVideoExporter& other) = delete;
+    CVideoExporter& operator=(const CVideoExporter& other) = delete;
+
+private:
+    enum class EFrameState
+    {
+        FRAME_FREE,
+        FRAME_QUEUED,
+        FRAME_RENDERING,
+        FRAME_DONE
+    };
+
+    struct Frame
+    {
+        game::CTetris game;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> planes;
+        EFrameState state;
+    };
+
+    void renderFrames(CSoftwareRenderer renderer);
+    void writeFrames(std::FILE* output);
+    void convertToYuv(Frame& frame) const;
+
+private:
+    const CSoftwareRenderer& mRenderer;
+    VideoExportConfig mConfig;
+    std::vector<Frame> mFrames;
+    std::mutex mMutex;
+    std::condition_variable mFrameQueued;
+    std::condition_variable mFrameDone;
+    std::condition_variable mFrameFree;
+    size_t mQueuedCount;
+    size_t mWrittenCount;
+    bool mFinished;
+    bool mFailed;
+};
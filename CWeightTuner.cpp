@@ -0,0 +1,268 @@
+#include "CWeightTuner.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+namespace game
+{
+    namespace
+    {
+        const char* checkpointHeader = "tetris-tuner-checkpoint";
+        const int checkpointVersion = 1;
+    }
+
+    CWeightTuner::CWeightTuner(const TunerConfig& config, CBatchSimulator& simulator)
+    : mConfig(config)
+    , mSimulator(simulator)
+    , mBest{CHeuristicBot::getDefaultWeights(), -std::numeric_limits<float>::infinity()}
+    , mGeneration(0)
+    , mRandom(config.randomSeed)
+    {
+        //Selection and the fitness average need at least one candidate, seed and tournament entrant
+        mConfig.populationSize = std::max(1, mConfig.populationSize);
+        mConfig.seedsCount = std::max(1, mConfig.seedsCount);
+        mConfig.tournamentSize = std::max(1, mConfig.tournamentSize);
+        mConfig.eliteCount = std::max(0, std::min(mConfig.eliteCount, mConfig.populationSize));
+        for (int i = 0; i < mConfig.seedsCount; ++i)
+        {
+            mSeeds.push_back(mConfig.firstSeed + i);
+        }
+        mResults.resize(mSeeds.size() * mConfig.populationSize);
+        mNextPopulation.reserve(mConfig.populationSize);
+        initPopulation();
+    }
+
+    void CWeightTuner::initPopulation()
+    {
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        mPopulation.resize(mConfig.populationSize);
+        for (auto& candidate : mPopulation)
+        {
+            for (auto& weight : candidate.weights)
+            {
+                weight = distribution(mRandom);
+            }
+            normalize(candidate.weights);
+            candidate.fitness = 0.0f;
+        }
+        mPopulation[0].weights = CHeuristicBot::getDefaultWeights();
+    }
+
+    bool CWeightTuner::step()
+    {
+        evaluate();
+        breed();
+        ++mGeneration;
+        return mConfig.checkpointPath.empty() || saveCheckpoint();
+    }
+
+    bool CWeightTuner::run(const TGenerationCallback& onGeneration)
+    {
+        while (mGeneration < mConfig.generations)
+        {
+            const bool saved = step();
+            if (onGeneration)
+            {
+                onGeneration(mGeneration, mBest);
+            }
+            if (!saved)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CWeightTuner::evaluate()
+    {
+        const size_t seedsCount = mSeeds.size();
+        const int maxPieces = mConfig.maxPieces;
+        mSimulator.run(mResults.size(), [this, seedsCount, maxPieces](size_t job, CTetris& game) {
+            const CHeuristicBot bot(mPopulation[job / seedsCount].weights);
+            mResults[job] = CBatchSimulator::playGame(game, mSeeds[job % seedsCount],
+                [&bot](const CTetris& state) { return bot.findPlacement(state); }, maxPieces);
+        });
+
+        for (size_t i = 0; i < mPopulation.size(); ++i)
+        {
+            int lines = 0;
+            for (size_t j = 0; j < seedsCount; ++j)
+            {
+                lines += mResults[i * seedsCount + j].lines;
+            }
+            mPopulation[i].fitness = static_cast<float>(lines) / seedsCount;
+            if (mPopulation[i].fitness > mBest.fitness)
+            {
+                mBest = mPopulation[i];
+            }
+        }
+    }
+
+    void CWeightTuner::breed()
+    {
+        std::sort(mPopulation.begin(), mPopulation.end(), [](const Candidate& a, const Candidate& b) {
+            return a.fitness > b.fitness;
+        });
+
+        std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+        std::normal_distribution<float> mutation(0.0f, mConfig.mutationStep);
+
+        mNextPopulation.assign(mPopulation.begin(), mPopulation.begin() + mConfig.eliteCount);
+        while (static_cast<int>(mNextPopulation.size()) < mConfig.populationSize)
+        {
+            const Candidate& first = select();
+            const Candidate& second = select();
+
+            //Fitness weighted crossover, so the child leans towards the stronger parent
+            float total = first.fitness + second.fitness;
+            float ratio = total > 0.0f ? first.fitness / total : 0.5f;
+
+            Candidate child{};
+            for (int i = 0; i < CHeuristicBot::mFeaturesCount; ++i)
+            {
+                child.weights[i] = first.weights[i] * ratio + second.weights[i] * (1.0f - ratio);
+                if (chance(mRandom) < mConfig.mutationRate)
+                {
+                    child.weights[i] += mutation(mRandom);
+                }
+            }
+            normalize(child.weights);
+            mNextPopulation.push_back(child);
+        }
+        mPopulation.swap(mNextPopulation);
+    }
+
+    const Candidate& CWeightTuner::select()
+    {
+        std::uniform_int_distribution<size_t> index(0, mPopulation.size() - 1);
+        const Candidate* best = &mPopulation[index(mRandom)];
+        for (int i = 1; i < mConfig.tournamentSize; ++i)
+        {
+            const Candidate* candidate = &mPopulation[index(mRandom)];
+            if (candidate->fitness > best->fitness)
+            {
+                best = candidate;
+            }
+        }
+        return *best;
+    }
+
+    void CWeightTuner::normalize(THeuristicWeights& weights) const
+    {
+        float length = 0.0f;
+        for (float weight : weights)
+        {
+            length += weight * weight;
+        }
+        length = std::sqrt(length);
+        if (length > 0.0f)
+        {
+            for (auto& weight : weights)
+            {
+                weight /= length;
+            }
+        }
+    }
+
+    bool CWeightTuner::saveCheckpoint() const
+    {
+        //Write next to the checkpoint and rename, so an interrupted run never leaves a broken file
+        const std::string tmpPath = mConfig.checkpointPath + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::trunc);
+            if (!file)
+            {
+                return false;
+            }
+            file.precision(std::numeric_limits<float>::max_digits10);
+            file << checkpointHeader << ' ' << checkpointVersion << '\n';
+            file << mGeneration << ' ' << mPopulation.size() << '\n';
+            file << mRandom << '\n';
+            file << mBest.fitness;
+            for (float weight : mBest.weights)
+            {
+                file << ' ' << weight;
+            }
+            file << '\n';
+            for (const auto& candidate : mPopulation)
+            {
+                file << candidate.fitness;
+                for (float weight : candidate.weights)
+                {
+                    file << ' ' << weight;
+                }
+                file << '\n';
+            }
+            if (!file)
+            {
+                return false;
+            }
+        }
+
+        if (std::rename(tmpPath.c_str(), mConfig.checkpointPath.c_str()) != 0)
+        {
+            std::remove(mConfig.checkpointPath.c_str());
+            return std::rename(tmpPath.c_str(), mConfig.checkpointPath.c_str()) == 0;
+        }
+        return true;
+    }
+
+    ECheckpointStatus CWeightTuner::loadCheckpoint()
+    {
+        std::ifstream file(mConfig.checkpointPath);
+        if (!file)
+        {
+            return ECheckpointStatus::CHECKPOINT_MISSING;
+        }
+
+        std::string header;
+        int version = 0;
+        int generation = 0;
+        size_t populationSize = 0;
+        file >> header >> version >> generation >> populationSize;
+        if (!file || header != checkpointHeader || version != checkpointVersion ||
+            populationSize != static_cast<size_t>(mConfig.populationSize))
+        {
+            return ECheckpointStatus::CHECKPOINT_INVALID;
+        }
+
+        std::mt19937 random;
+        Candidate best;
+        std::vector<Candidate> population(populationSize);
+        file >> random >> best.fitness;
+        for (auto& weight : best.weights)
+        {
+            file >> weight;
+        }
+        for (auto& candidate : population)
+        {
+            file >> candidate.fitness;
+            for (auto& weight : candidate.weights)
+            {
+                file >> weight;
+            }
+        }
+        if (!file)
+        {
+            return ECheckpointStatus::CHECKPOINT_INVALID;
+        }
+
+        mGeneration = generation;
+        mRandom = random;
+        mBest = best;
+        mPopulation.swap(population);
+        return ECheckpointStatus::CHECKPOINT_LOADED;
+    }
+
+    int CWeightTuner::getGeneration() const
+    {
+        return mGeneration;
+    }
+
+    const Candidate& CWeightTuner::getBest() const
+    {
+        return mBest;
+    }
+}
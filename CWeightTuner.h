@@ -0,0 +1,76 @@
+#pragma once
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include "CBatchSimulator.h"
+#include "CHeuristicBot.h"
+
+namespace game
+{
+
+struct TunerConfig
+{
+    int populationSize = 40;
+    int generations = 30;
+    int eliteCount = 4;
+    int tournamentSize = 4;
+    float mutationRate = 0.3f;
+    float mutationStep = 0.2f;
+    int seedsCount = 16;
+    unsigned firstSeed = 1;
+    int maxPieces = 500;
+    unsigned randomSeed = 1;
+    std::string checkpointPath;
+};
+
+enum class ECheckpointStatus
+{
+    CHECKPOINT_LOADED,
+    CHECKPOINT_MISSING,
+    CHECKPOINT_INVALID //Broken or of another population size, a new run must not overwrite it
+};
+
+struct Candidate
+{
+    THeuristicWeights weights;
+    float fitness;
+};
+
+//Genetic tuner for the heuristic bot weights. Every candidate plays the same fixed
+//seeds, fitness is the average number of cleared lines.
+class CWeightTuner
+{
+public:
+    using TGenerationCallback = std::function<void(int generation, const Candidate& best)>;
+
+    CWeightTuner(const TunerConfig& config, CBatchSimulator& simulator);
+
+    ECheckpointStatus loadCheckpoint();
+    bool saveCheckpoint() const;
+    //False when the checkpoint couldn't be written, run() stops after that generation
+    bool step();
+    bool run(const TGenerationCallback& onGeneration);
+    int getGeneration() const;
+    const Candidate& getBest() const;
+
+private:
+    void initPopulation();
+    void evaluate();
+    void breed();
+    const Candidate& select();
+    void normalize(THeuristicWeights& weights) const;
+
+private:
+    TunerConfig mConfig;
+    CBatchSimulator& mSimulator;
+    std::vector<unsigned> mSeeds;
+    std::vector<Candidate> mPopulation;
+    std::vector<Candidate> mNextPopulation;
+    std::vector<GameResult> mResults;
+    Candidate mBest;
+    int mGeneration;
+    std::mt19937 mRandom;
+};
+
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "CAllocationTracker.h"
+#include "CHeuristicBot.h"
+#include "CReplay.h"
+#include "CSimulationThread.h"
+
+namespace
+{
+    const int warmUpTicks = 120;
+    const int ticksPerPiece = 8;
+    const int tickRate = 120;
+    const int threadTickRate = 1000;
+    const size_t replayReservedEvents = 1 << 16;
+
+    const game::EGameCommand playerCommands[] = {
+        game::EGameCommand::COMMAND_ROTATE,
+        game::EGameCommand::COMMAND_MOVE_LEFT,
+        game::EGameCommand::COMMAND_MOVE_RIGHT,
+        game::EGameCommand::COMMAND_DROP
+    };
+
+    //Ticks the engine the way the simulation thread does, with a bot placing a figure every few ticks
+    //and random keys in between. Every tick after the warm-up is counted.
+    uint64_t checkEngine(int gamesCount, uint64_t& ticksCount)
+    {
+        const float dt = 1.0f / tickRate;
+        const game::CHeuristicBot bot;
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> command(0, 3);
+        game::CTetris tetris;
+        game::CTetris snapshot(tetris);
+        uint64_t allocations = 0;
+        for (int i = 0; i < gamesCount; ++i)
+        {
+            tetris.resetGame(static_cast<unsigned>(i + 1));
+            for (int tick = 0; tetris.getGameState() == game::EGameState::STATE_INGAME; ++tick)
+            {
+                game::CAllocationScope scope;
+                if (tick % ticksPerPiece == 0)
+                {
+                    tetris.place(bot.findPlacement(tetris));
+                }
+                else
+                {
+                    game::CSimulationThread::applyCommand(tetris, playerCommands[command(random)]);
+                }
+                tetris.update(dt);
+                snapshot = tetris;
+                if (++ticksCount > warmUpTicks)
+                {
+                    allocations += scope.getCount();
+                }
+            }
+        }
+        return allocations;
+    }
+
+    //Runs the simulation thread with a recorded replay and feeds it random keys, restarting lost games.
+    //The thread itself counts the allocations of its ticks after the warm-up.
+    uint64_t checkSimulationThread(double seconds)
+    {
+        game::CTetris tetris;
+        game::CReplay replay(tetris, threadTickRate);
+        replay.reserve(replayReservedEvents);
+        game::CSimulationThread simulation(tetris, threadTickRate);
+        simulation.setReplay(&replay);
+        simulation.start();
+        simulation.pushCommand(game::EGameCommand::COMMAND_NEW_GAME);
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> command(0, 3);
+        const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            if (simulation.getSnapshot().getGameState() == game::EGameState::STATE_GAMEOVER)
+            {
+                simulation.pushCommand(game::EGameCommand::COMMAND_RESET);
+            }
+            else
+            {
+                simulation.pushCommand(playerCommands[command(random)]);
+            }
+        }
+        simulation.stop();
+        return simulation.getSteadyAllocationsCount();
+    }
+}
+
+//Usage: tetris_alloccheck [games] [seconds]
+//Exits with 2 when a steady state tick of the engine or of the simulation thread allocated.
+int main(int argv, char* argc[])
+{
+    if (!game::CAllocationTracker::isEnabled())
+    {
+        std::cerr << "Built without allocation tracking, nothing to check" << std::endl;
+        return 1;
+    }
+    const int gamesCount = argv > 1 ? std::max(1, std::atoi(argc[1])) : 100;
+    const double seconds = argv > 2 ? std::max(0.1, std::atof(argc[2])) : 2.0;
+
+    uint64_t ticksCount = 0;
+    const uint64_t engineAllocations = checkEngine(gamesCount, ticksCount);
+    std::cout << "Engine: " << engineAllocations << " allocations in " << ticksCount << " ticks of "
+              << gamesCount << " games" << std::endl;
+    const uint64_t threadAllocations = checkSimulationThread(seconds);
+    std::cout << "Simulation thread: " << threadAllocations << " allocations in " << seconds << " s" << std::endl;
+    return engineAllocations + threadAllocations == 0 ? 0 : 2;
+}
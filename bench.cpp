@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+#include "CBatchSimulator.h"
+#include "CBitBoard.h"
+#include "CExpectimaxBot.h"
+#include "CHeuristicBot.h"
+#include "CMctsBot.h"
+#include "CNeuralEvaluator.h"
+
+namespace
+{
+    const int mctsIterations = 500;
+    const int neuralMaxPieces = 200;
+    const int neuralEvaluations = 200000;
+    const int neuralUpdates = 200000;
+    const char* usage = "Usage: tetris_bench <heuristic|expectimax|mcts> [games] [max pieces]\n"
+                        "       tetris_bench weights <output file> [seed]\n"
+                        "       tetris_bench neural <weights file> [games]";
+
+    struct BenchStats
+    {
+        int games = 0;
+        int pieces = 0;
+        int lines = 0;
+        int illegalMoves = 0;
+        double seconds = 0.0;
+    };
+
+    //A bot must pick one of the placements the bit board finds, anything else would be
+    //played differently by the game than the bot has searched it.
+    //On a field too large for the bit board the bots keep the figure where it is.
+    bool isLegal(const game::CTetris& state, const game::Placement& placement)
+    {
+        game::CBitBoard board;
+        if (!board.load(state.getField()))
+        {
+            return placement.rotation == 0 && placement.column == state.getCurrentFigure()[1].x;
+        }
+        game::Placement placements[game::CBitBoard::mMaxPlacements];
+        const int count = board.getPlacements(state.getCurrentFigureId(), placements);
+        return std::any_of(placements, placements + count, [&placement](const game::Placement& legal) {
+            return legal.rotation == placement.rotation && legal.column == placement.column;
+        });
+    }
+
+    //Plays the same seeds one game after another, so the time per move is the bot's alone
+    BenchStats play(const game::TPlayer& player, int gamesCount, int maxPieces)
+    {
+        using Clock = std::chrono::steady_clock;
+        BenchStats stats;
+        game::CTetris tetris;
+        auto checked = [&player, &stats](const game::CTetris& state) {
+            const auto start = Clock::now();
+            const game::Placement placement = player(state);
+            stats.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            if (!isLegal(state, placement))
+            {
+                ++stats.illegalMoves;
+            }
+            return placement;
+        };
+        for (int i = 0; i < gamesCount; ++i)
+        {
+            const game::GameResult result = game::CBatchSimulator::playGame(tetris, static_cast<unsigned>(i + 1), checked, maxPieces);
+            ++stats.games;
+            stats.pieces += result.pieces;
+            stats.lines += result.lines;
+        }
+        return stats;
+    }
+
+    //Writes random weights and loads them back, a copy cut short must be rejected
+    int writeWeights(const std::string& path, unsigned seed)
+    {
+        game::CNeuralEvaluator evaluator;
+        if (!game::CNeuralEvaluator::saveRandomWeights(path, seed) || !evaluator.loadFromFile(path))
+        {
+            std::cerr << "Can't write or load back " << path << std::endl;
+            return 1;
+        }
+
+        const std::string truncatedPath = path + ".truncated";
+        {
+            std::ifstream input(path, std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            std::ofstream output(truncatedPath, std::ios::binary | std::ios::trunc);
+            output.write(data.data(), static_cast<std::streamsize>(data.size() - 1));
+        }
+        const bool truncatedLoaded = evaluator.loadFromFile(truncatedPath);
+        std::remove(truncatedPath.c_str());
+        if (truncatedLoaded)
+        {
+            std::cerr << "A truncated weights file was loaded" << std::endl;
+            return 2;
+        }
+        std::cout << "Wrote " << path << std::endl;
+        return 0;
+    }
+
+    struct Position
+    {
+        game::CBitBoard board;
+        int queue[game::CNeuralEvaluator::mQueueSlots];
+        int queueSize;
+    };
+
+    //Incremental accumulators must equal ones built from scratch and the scalar kernels must
+    //give the SIMD results, then both kernels are timed on the positions of heuristic games.
+    //Updates follow the positions in order, like a game moving from one placement to the next.
+    int benchNeural(const std::string& path, int gamesCount)
+    {
+        using Clock = std::chrono::steady_clock;
+        game::CNeuralEvaluator evaluator;
+        if (!evaluator.loadFromFile(path))
+        {
+            std::cerr << "Can't load " << path << std::endl;
+            return 1;
+        }
+
+        std::vector<Position> positions;
+        const game::CHeuristicBot bot;
+        game::CTetris tetris;
+        for (int i = 0; i < gamesCount; ++i)
+        {
+            game::CBatchSimulator::playGame(tetris, static_cast<unsigned>(i + 1), [&bot, &positions](const game::CTetris& state) {
+                Position position;
+                position.board.load(state.getField());
+                position.queueSize = std::min(game::CNeuralEvaluator::mQueueSlots, 1 + state.getPreviewSize());
+                position.queue[0] = state.getCurrentFigureId();
+                for (int j = 1; j < position.queueSize; ++j)
+                {
+                    position.queue[j] = state.getPreviewFigureId(j - 1);
+                }
+                positions.push_back(position);
+                return bot.findPlacement(state);
+            }, neuralMaxPieces);
+        }
+
+        std::vector<game::CNeuralEvaluator::Accumulator> accumulators(positions.size());
+        game::CNeuralEvaluator::Accumulator incremental;
+        game::CNeuralEvaluator::Accumulator scalarIncremental;
+        evaluator.reset(incremental);
+        evaluator.reset(scalarIncremental);
+        int accumulatorMismatches = 0;
+        int kernelMismatches = 0;
+        float simdPolicy[game::CNeuralEvaluator::mPolicySize];
+        float scalarPolicy[game::CNeuralEvaluator::mPolicySize];
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            evaluator.setSimdEnabled(true);
+            evaluator.update(incremental, positions[i].board, positions[i].queue, positions[i].queueSize);
+            evaluator.reset(accumulators[i]);
+            evaluator.update(accumulators[i], positions[i].board, positions[i].queue, positions[i].queueSize);
+            evaluator.setSimdEnabled(false);
+            evaluator.update(scalarIncremental, positions[i].board, positions[i].queue, positions[i].queueSize);
+            if (std::memcmp(incremental.values, accumulators[i].values, sizeof(incremental.values)) != 0 ||
+                std::memcmp(scalarIncremental.values, accumulators[i].values, sizeof(scalarIncremental.values)) != 0)
+            {
+                ++accumulatorMismatches;
+            }
+
+            evaluator.setSimdEnabled(true);
+            const float simdValue = evaluator.evaluate(accumulators[i], simdPolicy);
+            evaluator.setSimdEnabled(false);
+            const float scalarValue = evaluator.evaluate(accumulators[i], scalarPolicy);
+            if (simdValue != scalarValue || std::memcmp(simdPolicy, scalarPolicy, sizeof(simdPolicy)) != 0)
+            {
+                ++kernelMismatches;
+            }
+        }
+
+        auto measure = [&evaluator, &accumulators](bool simd, float* policy) {
+            evaluator.setSimdEnabled(simd);
+            volatile float sink = 0.0f;
+            int evaluations = 0;
+            const auto start = Clock::now();
+            while (evaluations < neuralEvaluations)
+            {
+                for (const auto& accumulator : accumulators)
+                {
+                    sink = sink + evaluator.evaluate(accumulator, policy);
+                }
+                evaluations += static_cast<int>(accumulators.size());
+            }
+            return evaluations / std::chrono::duration<double>(Clock::now() - start).count();
+        };
+        auto measureUpdates = [&evaluator, &positions](bool simd, game::CNeuralEvaluator::Accumulator& accumulator) {
+            evaluator.setSimdEnabled(simd);
+            evaluator.reset(accumulator);
+            int updates = 0;
+            const auto start = Clock::now();
+            while (updates < neuralUpdates)
+            {
+                for (const Position& position : positions)
+                {
+                    evaluator.update(accumulator, position.board, position.queue, position.queueSize);
+                }
+                updates += static_cast<int>(positions.size());
+            }
+            return updates / std::chrono::duration<double>(Clock::now() - start).count();
+        };
+        const double scalarUpdateRate = measureUpdates(false, scalarIncremental);
+        const double scalarRate = measure(false, scalarPolicy);
+        std::cout << positions.size() << " positions" << std::endl;
+        std::cout << "Scalar incremental updates: " << static_cast<uint64_t>(scalarUpdateRate) << "/s" << std::endl;
+        std::cout << "Scalar evaluations with policy: " << static_cast<uint64_t>(scalarRate) << "/s" << std::endl;
+        if (game::CNeuralEvaluator::isSimdAvailable())
+        {
+            const double simdUpdateRate = measureUpdates(true, incremental);
+            const double simdRate = measure(true, simdPolicy);
+            std::cout << "AVX2 incremental updates: " << static_cast<uint64_t>(simdUpdateRate) << "/s, "
+                      << simdUpdateRate / scalarUpdateRate << " times the scalar rate" << std::endl;
+            std::cout << "AVX2 evaluations with policy: " << static_cast<uint64_t>(simdRate) << "/s, "
+                      << simdRate / scalarRate << " times the scalar rate" << std::endl;
+        }
+        else
+        {
+            std::cout << "Built without USE_AVX2, only the scalar kernels ran" << std::endl;
+        }
+
+        if (accumulatorMismatches + kernelMismatches > 0)
+        {
+            std::cerr << accumulatorMismatches << " incremental accumulators differ from fresh ones, "
+                      << kernelMismatches << " evaluations differ between the kernels" << std::endl;
+            return 2;
+        }
+        return 0;
+    }
+}
+
+//Usage: tetris_bench <heuristic|expectimax|mcts> [games] [max pieces]
+//Plays fixed seeds with the chosen bot and prints its strength and time per move.
+//Exits with 2 when the bot picked a placement the board doesn't have, or when the tree
+//search ran no rollouts for a move or never reused a subtree.
+//
+//tetris_bench weights <output file> [seed] writes a network of random weights,
+//tetris_bench neural <weights file> [games] checks and times the neural evaluator on it.
+int main(int argv, char* argc[])
+{
+    if (argv < 2)
+    {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+    if (std::strcmp(argc[1], "weights") == 0 || std::strcmp(argc[1], "neural") == 0)
+    {
+        if (argv < 3)
+        {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        if (argc[1][0] == 'w')
+        {
+            return writeWeights(argc[2], argv > 3 ? static_cast<unsigned>(std::atoi(argc[3])) : 1u);
+        }
+        return benchNeural(argc[2], argv > 3 ? std::max(1, std::atoi(argc[3])) : 4);
+    }
+    const int gamesCount = argv > 2 ? std::max(1, std::atoi(argc[2])) : 4;
+    const int maxPieces = argv > 3 ? std::max(1, std::atoi(argc[3])) : 200;
+
+    BenchStats stats;
+    if (std::strcmp(argc[1], "heuristic") == 0)
+    {
+        const game::CHeuristicBot bot;
+        stats = play([&bot](const game::CTetris& state) { return bot.findPlacement(state); }, gamesCount, maxPieces);
+    }
+    else if (std::strcmp(argc[1], "expectimax") == 0)
+    {
+        const game::CExpectimaxBot bot;
+        int depths = 0;
+        stats = play([&bot, &depths](const game::CTetris& state) {
+            const game::Placement placement = bot.findPlacement(state);
+            depths += bot.getLastDepth();
+            return placement;
+        }, gamesCount, maxPieces);
+        std::cout << "Mean search depth: " << static_cast<double>(depths) / std::max(1, stats.pieces) << std::endl;
+    }
+    else if (std::strcmp(argc[1], "mcts") == 0)
+    {
+        //Fewer rollouts than the default keep a run short, all cores search the shared tree
+        game::MctsConfig config;
+        config.iterations = mctsIterations;
+        config.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        game::CMctsBot bot(config, game::CHeuristicBot::getDefaultWeights());
+        int iterations = 0;
+        int emptySearches = 0;
+        int reusedMoves = 0;
+        stats = play([&bot, &iterations, &emptySearches, &reusedMoves](const game::CTetris& state) {
+            const game::Placement placement = bot.findPlacement(state);
+            iterations += bot.getLastIterations();
+            emptySearches += bot.getLastIterations() == 0 ? 1 : 0;
+            reusedMoves += bot.getReusedNodes() > 0 ? 1 : 0;
+            return placement;
+        }, gamesCount, maxPieces);
+        std::cout << "Mean rollouts: " << static_cast<double>(iterations) / std::max(1, stats.pieces)
+                  << ", moves with a reused subtree: " << reusedMoves << std::endl;
+        if (emptySearches > 0 || reusedMoves == 0)
+        {
+            std::cerr << emptySearches << " moves without rollouts, " << reusedMoves << " with a reused subtree" << std::endl;
+            return 2;
+        }
+    }
+    else
+    {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    std::cout << argc[1] << ": " << stats.games << " games, " << static_cast<double>(stats.lines) / stats.games
+              << " lines and " << static_cast<double>(stats.pieces) / stats.games << " pieces per game, "
+              << stats.seconds * 1000.0 / std::max(1, stats.pieces) << " ms per move" << std::endl;
+    if (stats.illegalMoves > 0)
+    {
+        std::cerr << stats.illegalMoves << " illegal moves" << std::endl;
+        return 2;
+    }
+    return 0;
+}
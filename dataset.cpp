@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+
+#include "CBatchSimulator.h"
+#include "CDatasetReader.h"
+#include "CDatasetWriter.h"
+#include "CHeuristicBot.h"
+
+//Usage: tetris_dataset <output file> [games] [max pieces] [threads] [compress 0|1]
+int main(int argv, char* argc[])
+{
+    if (argv < 2)
+    {
+        std::cerr << "Usage: tetris_dataset <output file> [games] [max pieces] [threads] [compress 0|1]" << std::endl;
+        return 1;
+    }
+    game::DatasetConfig config;
+    config.path = argc[1];
+    const int gamesCount = argv > 2 ? std::max(1, std::atoi(argc[2])) : 1000;
+    const int maxPieces = argv > 3 ? std::max(1, std::atoi(argc[3])) : 1000;
+    const unsigned threadsCount = argv > 4 ? static_cast<unsigned>(std::max(0, std::atoi(argc[4]))) : 0;
+    config.compress = argv > 5 && std::atoi(argc[5]) != 0;
+    if (config.compress && !game::CDatasetWriter::isCompressionAvailable())
+    {
+        std::cerr << "Built without zlib, writing uncompressed chunks" << std::endl;
+    }
+
+    game::CDatasetWriter writer(config);
+    if (!writer.open())
+    {
+        std::cerr << "Can't create " << config.path << std::endl;
+        return 1;
+    }
+    game::CBatchSimulator simulator(threadsCount);
+    simulator.setDatasetWriter(&writer);
+
+    std::vector<unsigned> seeds(gamesCount);
+    std::iota(seeds.begin(), seeds.end(), 1u);
+    const game::CHeuristicBot bot;
+    const auto start = std::chrono::steady_clock::now();
+    simulator.play(seeds, [&bot](const game::CTetris& state) { return bot.findPlacement(state); }, maxPieces);
+    writer.close();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const game::DatasetStats stats = writer.getStats();
+    std::cout << "Games: " << gamesCount << " on " << simulator.getThreadsCount() << " threads" << std::endl;
+    std::cout << "Samples: " << stats.samples << " in " << stats.chunks << " chunks, "
+              << static_cast<uint64_t>(stats.samples / seconds) << " samples/s" << std::endl;
+    std::cout << "Bytes: " << stats.bytesWritten << ", "
+              << (stats.samples ? static_cast<double>(stats.bytesWritten) / stats.samples : 0.0) << " per sample" << std::endl;
+    if (stats.droppedChunks > 0)
+    {
+        std::cout << "Dropped: " << stats.droppedSamples << " samples in " << stats.droppedChunks << " chunks" << std::endl;
+    }
+
+    //Read the file back to check it
+    game::CDatasetReader reader;
+    if (!reader.open(config.path))
+    {
+        std::cerr << "Can't read " << config.path << std::endl;
+        return 1;
+    }
+    game::DatasetChunkView chunk;
+    for (size_t i = 0; i < reader.getChunksCount(); ++i)
+    {
+        if (!reader.loadChunk(i, chunk))
+        {
+            std::cerr << "Chunk " << i << " is broken" << std::endl;
+            return 1;
+        }
+    }
+    if (reader.getSamplesCount() != stats.samples)
+    {
+        std::cerr << "Read " << reader.getSamplesCount() << " samples back" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <SFML/Graphics/Image.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "CReplay.h"
+#include "CSoftwareRenderer.h"
+#include "CVideoExporter.h"
+
+//Same picture geometry as the game window
+const int blockSize = 40;
+const float scaleFactor = 1.5f;
+const sf::Vector2f backGroundScale(0.42f, 1.0f);
+
+//Usage: tetris_export <replay file> <output .y4m file or - for stdout> [frames per second] [threads]
+//With stdout the frames can go straight to an encoder: tetris_export replay.trp - | ffmpeg -i - clip.mp4
+int main(int argv, char* argc[])
+{
+    if (argv < 3)
+    {
+        std::cerr << "Usage: tetris_export <replay file> <output.y4m|-> [frames per second] [threads]" << std::endl;
+        return 1;
+    }
+
+    game::CReplay replay;
+    if (!replay.loadFromFile(argc[1]))
+    {
+        std::cerr << "Can't load the replay " << argc[1] << std::endl;
+        return 1;
+    }
+
+    sf::Image blocks;
+    sf::Image back;
+    if (!blocks.loadFromFile("images/blocks.png") || !back.loadFromFile("images/back.jpg"))
+    {
+        std::cerr << "Can't load the images" << std::endl;
+        return 1;
+    }
+
+    const game::CTetris game = replay.createGame();
+    const sf::Vector2u size(static_cast<unsigned>((game.getFieldWidth() * blockSize + 150) * scaleFactor),
+                            static_cast<unsigned>(game.getFieldHeight() * blockSize * scaleFactor));
+    const CSoftwareRenderer renderer(blocks, back, backGroundScale, size, blockSize, scaleFactor);
+
+    VideoExportConfig config;
+    if (argv > 3)
+    {
+        config.framesPerSecond = std::atoi(argc[3]);
+    }
+    if (argv > 4)
+    {
+        config.threadsCount = static_cast<unsigned>(std::max(0, std::atoi(argc[4])));
+    }
+
+    const bool toStdout = std::strcmp(argc[2], "-") == 0;
+    #ifdef _WIN32
+    if (toStdout)
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+    #endif
+    std::FILE* output = toStdout ? stdout : std::fopen(argc[2], "wb");
+    if (!output)
+    {
+        std::cerr << "Can't open " << argc[2] << std::endl;
+        return 1;
+    }
+
+    CVideoExporter exporter(renderer, config);
+    const int frames = exporter.exportY4m(replay, output);
+    if (!toStdout)
+    {
+        std::fclose(output);
+    }
+    if (frames < 0)
+    {
+        std::cerr << "Writing the video failed" << std::endl;
+        return 1;
+    }
+    std::cerr << "Exported " << frames << " frames" << std::endl;
+    return 0;
+}
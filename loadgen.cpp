@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "CLoadGenerator.h"
+
+namespace
+{
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    void raiseFilesLimit()
+    {
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    void printLatency(const char* name, const game::CLatencyHistogram& histogram)
+    {
+        std::cout << name << ": count " << histogram.getCount()
+                  << ", mean " << static_cast<uint64_t>(histogram.getMean())
+                  << " us, p50 " << histogram.getPercentile(50.0)
+                  << ", p90 " << histogram.getPercentile(90.0)
+                  << ", p99 " << histogram.getPercentile(99.0)
+                  << ", p99.9 " << histogram.getPercentile(99.9)
+                  << ", max " << histogram.getMax() << " us" << std::endl;
+    }
+}
+
+//Usage: tetris_loadgen [connections] [seconds] [inputs per second] [bot|random|replay file] [threads] [port] [address]
+//                      [spectators per game]
+int main(int argv, char* argc[])
+{
+    game::LoadConfig config;
+    int seconds = 30;
+    if (argv > 1)
+    {
+        config.connectionsCount = std::max(1, std::atoi(argc[1]));
+    }
+    if (argv > 2)
+    {
+        seconds = std::max(1, std::atoi(argc[2]));
+    }
+    if (argv > 3)
+    {
+        config.inputRate = static_cast<float>(std::max(0.0, std::atof(argc[3])));
+    }
+    game::CReplay replay;
+    if (argv > 4)
+    {
+        if (std::strcmp(argc[4], "random") == 0)
+        {
+            config.mode = game::ELoadBotMode::BOT_RANDOM;
+        }
+        else if (std::strcmp(argc[4], "bot") != 0)
+        {
+            if (!replay.loadFromFile(argc[4]))
+            {
+                std::cerr << "Can't load the replay " << argc[4] << std::endl;
+                return 1;
+            }
+            config.mode = game::ELoadBotMode::BOT_REPLAY;
+            config.replay = &replay;
+        }
+    }
+    if (argv > 5)
+    {
+        config.threadsCount = static_cast<unsigned>(std::max(0, std::atoi(argc[5])));
+    }
+    if (argv > 6)
+    {
+        config.port = std::atoi(argc[6]);
+    }
+    if (argv > 7)
+    {
+        config.address = argc[7];
+    }
+    if (argv > 8)
+    {
+        config.spectatorsPerGame = std::max(0, std::atoi(argc[8]));
+    }
+
+    raiseFilesLimit();
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+
+    game::CLoadGenerator generator(config);
+    generator.start();
+    std::cout << config.connectionsCount << " clients to " << config.address << ':' << config.port << " from "
+              << generator.getThreadsCount() << " threads for " << seconds << " s" << std::endl;
+
+    const int reportSeconds = 5;
+    game::LoadStats last = generator.getStats();
+    for (int elapsed = 0; elapsed < seconds && !stopRequested; elapsed += reportSeconds)
+    {
+        const int interval = std::min(reportSeconds, seconds - elapsed);
+        for (int i = 0; i < interval * 10 && !stopRequested; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        const game::LoadStats stats = generator.getStats();
+        std::cout << "connections " << stats.connections << ", spectators " << stats.spectators
+                  << ", inputs/s " << (stats.inputs - last.inputs) / interval
+                  << ", states/s " << (stats.states - last.states) / interval
+                  << ", KB/s " << (stats.bytesReceived - last.bytesReceived) / 1024 / interval
+                  << ", ack p50 " << stats.ackLatency.getPercentile(50.0)
+                  << " us, p99 " << stats.ackLatency.getPercentile(99.0) << " us" << std::endl;
+        last = stats;
+    }
+    generator.stop();
+
+    const game::LoadStats stats = generator.getStats();
+    printLatency("input to ack", stats.ackLatency);
+    printLatency("tick delay", stats.tickDelay);
+    const uint64_t errors = stats.connectErrors + stats.disconnects + stats.protocolErrors + stats.resyncs + stats.spectatorMismatches;
+    std::cout << "inputs " << stats.inputs << ", states " << stats.states << ", received " << stats.bytesReceived / 1024
+              << " KB, connect errors " << stats.connectErrors << ", disconnects " << stats.disconnects
+              << ", protocol errors " << stats.protocolErrors << ", resyncs " << stats.resyncs << std::endl;
+    if (config.spectatorsPerGame > 0)
+    {
+        std::cout << "spectator states " << stats.spectatorStates << ", boards checked against the player "
+                  << stats.spectatorChecks << ", mismatches " << stats.spectatorMismatches << std::endl;
+    }
+    return errors == 0 ? 0 : 2;
+}
@@ -1,7 +1,12 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <array>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
-#include <unordered_map>
 #include <thread>
 
 #ifdef __linux__
@@ -9,9 +14,51 @@
 #endif
 
 #include "CTetris.h"
+#include "CAllocationTracker.h"
+#include "CBlocksRenderer.h"
+#include "CTerminalInput.h"
+#include "CTerminalRenderer.h"
+#include "CSimulationThread.h"
+#include "CFrameScheduler.h"
+#include "CFrameProfiler.h"
+#include "CReplay.h"
+#include "CSharedState.h"
+#include "CTracer.h"
 
 const int blockSize = 40;
 const float scaleFactor = 1.5f;
+const int simulationTickRate = 120;
+const int defaultFrameRate = 60;
+const sf::Time idleDelay = sf::seconds(0.5f);
+const sf::Time timingsOverlayPeriod = sf::seconds(0.5f);
+const sf::Time timingsCsvPeriod = sf::seconds(5.0f);
+const char* traceFilePath = "trace.json";
+const int allocationsWarmUpFrames = 120;
+const size_t replayReservedEvents = 1 << 16;
+
+//Formats into a caller buffer, the overlay refresh doesn't build temporary strings
+void formatTimings(const game::CFrameProfiler& profiler, char* buffer, size_t size)
+{
+    int length = std::snprintf(buffer, size, "phase       p50     p95     p99     max (us)");
+    for (int i = 0; i < game::CFrameProfiler::mPhasesCount && length >= 0 && static_cast<size_t>(length) < size; ++i)
+    {
+        const game::EFramePhase phase = static_cast<game::EFramePhase>(i);
+        const game::PhaseSummary summary = profiler.getSummary(phase);
+        length += std::snprintf(buffer + length, size - length, "\n%-7s %7.2f %7.2f %7.2f %7.2f",
+                                game::CFrameProfiler::getPhaseName(phase), summary.p50, summary.p95, summary.p99, summary.max);
+    }
+}
+
+//Refills a kept sf::String in place. Passing a char array to setString builds a temporary sf::String,
+//appending one code point at a time reuses the storage the target already has.
+void assignString(sf::String& target, const char* text)
+{
+    target.clear();
+    for (; *text != '\0'; ++text)
+    {
+        target += sf::String(static_cast<sf::Uint32>(static_cast<unsigned char>(*text)));
+    }
+}
 
 enum class ELabelType
 {
@@ -20,61 +67,44 @@ enum class ELabelType
     NEXT_FIGURE_LABEL,
     NEW_GAME_LABEL,
     PAUSE_LABEL,
-    GAME_OVER_LABEL
+    GAME_OVER_LABEL,
+    TIMINGS_LABEL,
+    LABELS_COUNT
 };
 
-using TLabelsMap = std::unordered_map<ELabelType, std::unique_ptr<sf::Text>>; 
-
-void renderFunc(sf::RenderWindow* window,
-                      const sf::Sprite* backGround,
-                      sf::Sprite* figureSprite,
-                      const TLabelsMap& labelsMap,
-                      const game::CTetris* theGame)
+//Labels indexed directly by their type, so a lookup in the frame loop is a plain array access
+class CLabelsMap
 {
-    auto fieldWidth = theGame->getFieldWidth();
-
-    auto drawField = [&window, &figureSprite, &theGame]() {
-        const auto& field = theGame->getField();
-        for (int i = 0; i < field.size(); ++i)
-        {
-            for (int j = 0; j < field[0].size(); ++j)
-            {
-                if (field[i][j] == 0)
-                {
-                    continue;
-                }
-                figureSprite->setTextureRect(sf::IntRect(field[i][j] * blockSize, 0, blockSize, blockSize));
-                figureSprite->setPosition(static_cast<float>(j * blockSize), static_cast<float>(i * blockSize));
-                window->draw(*figureSprite);
-            }
-        }
-    };
-
-    window->clear(sf::Color(0, 0, 30));
-    window->draw(*backGround);
-    drawField();
+public:
+    void emplace(ELabelType type, std::unique_ptr<sf::Text> label)
+    {
+        mLabels[static_cast<size_t>(type)] = std::move(label);
+    }
 
-    const game::Point *figure = theGame->getCurrentFigure();
-    const game::Point *nextFigure = theGame->getNextFigure();
-    const int color = theGame->getFigureColor();
+    std::unique_ptr<sf::Text>& operator[](ELabelType type)
+    {
+        return mLabels[static_cast<size_t>(type)];
+    }
 
-    if (theGame->getGameState() == game::EGameState::STATE_INGAME ||
-        theGame->getGameState() == game::EGameState::STATE_PAUSE)
+    const std::unique_ptr<sf::Text>& at(ELabelType type) const
     {
-        for (int i = 0; i < 4; ++i)
-        {
-            figureSprite->setTextureRect(sf::IntRect(color * blockSize, 0, blockSize, blockSize));
-            figureSprite->setPosition(static_cast<float>(figure[i].x * blockSize), static_cast<float>(figure[i].y * blockSize));
+        return mLabels[static_cast<size_t>(type)];
+    }
 
-            window->draw(*figureSprite);
+private:
+    std::array<std::unique_ptr<sf::Text>, static_cast<size_t>(ELabelType::LABELS_COUNT)> mLabels;
+};
 
-            figureSprite->setTextureRect(sf::IntRect(1, 0, blockSize, blockSize));
-            figureSprite->setPosition(
-                    static_cast<float>(nextFigure[i].x * blockSize) + static_cast<float>(fieldWidth * blockSize + 40),
-                    static_cast<float>(nextFigure[i].y * blockSize) + 100);
-            window->draw(*figureSprite);
-        }
-    }
+void renderFunc(sf::RenderWindow* window,
+                      CBlocksRenderer* blocks,
+                      const CLabelsMap& labelsMap,
+                      const game::CTetris* theGame)
+{
+    TETRIS_TRACE_SCOPE("renderFunc");
+    blocks->update(*theGame);
+
+    //The blocks renderer covers the whole window with the cached background and field
+    window->draw(*blocks);
 
     switch(theGame->getGameState())
     {
@@ -97,17 +127,93 @@ void renderFunc(sf::RenderWindow* window,
     window->draw(*labelsMap.at(ELabelType::SCORE_LABEL));
     window->draw(*labelsMap.at(ELabelType::SCORES));
     window->draw(*labelsMap.at(ELabelType::NEXT_FIGURE_LABEL));
+}
+
+volatile std::sig_atomic_t terminalInterrupted = 0;
+
+//Frontend without a display: the same simulation thread and commands, drawn with ANSI escapes
+int runTerminal(int frameRate, const std::string& sharedStateName)
+{
+    std::signal(SIGINT, [](int) { terminalInterrupted = 1; });
+
+    game::CTetris tetris;
+    game::CSimulationThread simulation(tetris, simulationTickRate);
+    game::CSharedStateWriter stateWriter;
+    if (!sharedStateName.empty())
+    {
+        if (!stateWriter.open(sharedStateName))
+        {
+            std::cerr << "Can't create the shared state " << sharedStateName
+                      << ", another game publishes it or left it behind (remove /dev/shm/" << sharedStateName << ")" << std::endl;
+            return 1;
+        }
+        simulation.setStateWriter(&stateWriter);
+    }
+    simulation.start();
+    game::CFrameScheduler scheduler(frameRate);
+    {
+        CTerminalInput input;
+        CTerminalRenderer renderer(stdout);
+        bool running = true;
+        while (running && !terminalInterrupted)
+        {
+            for (ETerminalKey key = input.poll(); key != ETerminalKey::KEY_NONE; key = input.poll())
+            {
+                switch (key)
+                {
+                    case ETerminalKey::KEY_UP:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_ROTATE);
+                        break;
+
+                    case ETerminalKey::KEY_LEFT:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_MOVE_LEFT);
+                        break;
+
+                    case ETerminalKey::KEY_RIGHT:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_MOVE_RIGHT);
+                        break;
 
-    window->display();
+                    case ETerminalKey::KEY_DOWN:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_DROP);
+                        break;
+
+                    case ETerminalKey::KEY_NEW_GAME:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_NEW_GAME);
+                        break;
+
+                    case ETerminalKey::KEY_PAUSE:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_PAUSE);
+                        break;
+
+                    case ETerminalKey::KEY_RESET:
+                        simulation.pushCommand(game::EGameCommand::COMMAND_RESET);
+                        break;
+
+                    default:
+                        running = false;
+                        break;
+                }
+            }
+            renderer.update(simulation.getSnapshot());
+            scheduler.waitForNextFrame();
+        }
+    }
+    simulation.stop();
+    return 0;
 }
 
 int main(int argv, char* argc[])
 {
+    //Usage: tetris --terminal [frame rate] [shared state name]
+    if (argv > 1 && std::strcmp(argc[1], "--terminal") == 0)
+    {
+        return runTerminal(argv > 2 ? std::max(1, std::atoi(argc[2])) : defaultFrameRate, argv > 3 ? argc[3] : "");
+    }
+
     #ifdef __linux__
     XInitThreads();
     #endif
 
-    srand(0);
     using namespace sf;
 
     game::CTetris tetris;
@@ -123,16 +229,15 @@ int main(int argv, char* argc[])
 
     Texture back;
     back.loadFromFile("images/back.jpg");
-    Sprite s(t);
-    s.scale(sf::Vector2f(scaleFactor, scaleFactor));
     Sprite b(back);
     b.scale(sf::Vector2f(0.42f, 1.0f));
+    CBlocksRenderer blocks(t, b, window.getSize(), blockSize, scaleFactor);
 
     sf::Font font;
     font.loadFromFile("images/font.ttf");
 
     int fieldWidth = tetris.getFieldWidth();
-    TLabelsMap labelsMap;
+    CLabelsMap labelsMap;
     labelsMap.emplace(ELabelType::SCORE_LABEL, std::make_unique<sf::Text>());
     labelsMap[ELabelType::SCORE_LABEL]->setFont(font);
     labelsMap[ELabelType::SCORE_LABEL]->setString("Score:");
@@ -174,63 +279,224 @@ int main(int argv, char* argc[])
     labelsMap[ELabelType::PAUSE_LABEL]->setCharacterSize(40);
     labelsMap[ELabelType::PAUSE_LABEL]->setStyle(sf::Text::Bold);
 
-    Clock clock;
+    labelsMap.emplace(ELabelType::TIMINGS_LABEL, std::make_unique<sf::Text>());
+    labelsMap[ELabelType::TIMINGS_LABEL]->setFont(font);
+    labelsMap[ELabelType::TIMINGS_LABEL]->setPosition(sf::Vector2f(5.0f, 5.0f));
+    labelsMap[ELabelType::TIMINGS_LABEL]->setFillColor(sf::Color::White);
+    labelsMap[ELabelType::TIMINGS_LABEL]->setCharacterSize(14);
+
+    //Size the strings of the refilled labels and load their glyphs before the first frame,
+    //so a new score or timings refresh later reuses them instead of allocating
+    sf::String scoresString;
+    assignString(scoresString, "0123456789");
+    labelsMap[ELabelType::SCORES]->setString(scoresString);
+    labelsMap[ELabelType::SCORES]->getLocalBounds();
+
+    //Usage: tetris [frame rate] [timings csv file] [replay file] [shared state name]
+    //The F3 key shows frame timings, with a csv file they are also recorded from the start.
+    //The F4 key starts a trace, pressing it again writes the trace to trace.json
+    game::CFrameProfiler profiler;
+    const std::string timingsCsvPath = argv > 2 ? argc[2] : "";
+    profiler.setEnabled(!timingsCsvPath.empty());
+    if (!timingsCsvPath.empty() && !profiler.openCsv(timingsCsvPath))
+    {
+        std::cerr << "Can't open the timings file " << timingsCsvPath << std::endl;
+        return 1;
+    }
+    bool timingsOverlay = false;
+    char timingsText[512] = "";
+    sf::String timingsString;
+    formatTimings(profiler, timingsText, sizeof(timingsText));
+    assignString(timingsString, timingsText);
+    labelsMap[ELabelType::TIMINGS_LABEL]->setString(timingsString);
+    labelsMap[ELabelType::TIMINGS_LABEL]->getLocalBounds();
+    Clock timingsOverlayClock;
+    Clock timingsCsvClock;
+    Clock runClock;
+
+    game::CSimulationThread simulation(tetris, simulationTickRate);
+    simulation.setProfiler(&profiler);
+
+    //With a replay file the whole session is recorded and written on exit
+    const std::string replayPath = argv > 3 ? argc[3] : "";
+    game::CReplay replay(tetris, simulationTickRate);
+    if (!replayPath.empty())
+    {
+        replay.reserve(replayReservedEvents);
+        simulation.setReplay(&replay);
+    }
 
-    while (window.isOpen())
+    //With a shared state name every tick is also published to shared memory for overlays and tools
+    game::CSharedStateWriter stateWriter;
+    if (argv > 4)
     {
-        float time = clock.getElapsedTime().asSeconds();
-        clock.restart();
+        if (!stateWriter.open(argc[4]))
+        {
+            std::cerr << "Can't create the shared state " << argc[4]
+                      << ", another game publishes it or left it behind (remove /dev/shm/" << argc[4] << ")" << std::endl;
+            return 1;
+        }
+        simulation.setStateWriter(&stateWriter);
+    }
+    simulation.start();
+
+    game::CFrameScheduler scheduler(argv > 1 ? std::max(1, std::atoi(argc[1])) : defaultFrameRate);
+    Clock inputClock;
+    game::EGameState renderedState = tetris.getGameState();
+    int shownScores = -1;
+    uint64_t steadyAllocations = 0;
+    int allocatingFrames = 0;
+
+    auto handleEvent = [&window, &simulation, &inputClock, &profiler, &timingsOverlay, &timingsCsvPath](const Event& e) {
+        inputClock.restart();
+        if (e.type == Event::Closed)
+        {
+            window.close();
+        }
+
+        if (e.type == Event::KeyPressed)
+        {
+            switch (e.key.code)
+            {
+            case Keyboard::Up:
+                simulation.pushCommand(game::EGameCommand::COMMAND_ROTATE);
+                break;
+
+            case Keyboard::Left:
+                simulation.pushCommand(game::EGameCommand::COMMAND_MOVE_LEFT);
+                break;
+
+            case Keyboard::Right:
+                simulation.pushCommand(game::EGameCommand::COMMAND_MOVE_RIGHT);
+                break;
+
+            case Keyboard::Down:
+                simulation.pushCommand(game::EGameCommand::COMMAND_DROP);
+                break;
+
+            case Keyboard::N:
+                simulation.pushCommand(game::EGameCommand::COMMAND_NEW_GAME);
+                break;
+
+            case Keyboard::P:
+                simulation.pushCommand(game::EGameCommand::COMMAND_PAUSE);
+                break;
+                
+            case Keyboard::R:
+                simulation.pushCommand(game::EGameCommand::COMMAND_RESET);
+                break;
+
+            case Keyboard::F4:
+                if (game::CTracer::getInstance().isEnabled())
+                {
+                    game::CTracer::getInstance().setEnabled(false);
+                    game::CTracer::getInstance().writeJson(traceFilePath);
+                }
+                else
+                {
+                    game::CTracer::getInstance().setEnabled(true);
+                }
+                break;
+
+            case Keyboard::F3:
+                timingsOverlay = !timingsOverlay;
+                profiler.setEnabled(timingsOverlay || !timingsCsvPath.empty());
+                break;
+            
+            default:
+                break;
+            }
+        }
+    };
 
+    while (window.isOpen())
+    {
+        game::CAllocationScope frameAllocations;
+        //Outside of the game nothing moves on its own, so the loop sleeps until the next event.
+        //It stays active for a moment after input to show the command taking effect, and
+        //draws the frame of a state change (like game over) before going idle.
+        const game::EGameState gameState = simulation.getSnapshot().getGameState();
+        const bool active = gameState == game::EGameState::STATE_INGAME ||
+                            gameState != renderedState ||
+                            inputClock.getElapsedTime() < idleDelay;
         Event e;
-        std::string scString;
-        while (window.pollEvent(e))
+        if (!active)
+        {
+            if (!window.waitEvent(e))
+            {
+                break;
+            }
+            handleEvent(e);
+            scheduler.reset();
+        }
         {
-            if (e.type == Event::Closed)
+            game::CProfileScope scope(&profiler, game::EFramePhase::PHASE_INPUT);
+            TETRIS_TRACE_SCOPE("input");
+            while (window.pollEvent(e))
             {
-                window.close();
+                handleEvent(e);
             }
+        }
 
-            if (e.type == Event::KeyPressed)
+        const game::CTetris& state = simulation.getSnapshot();
+        {
+            game::CProfileScope scope(&profiler, game::EFramePhase::PHASE_RENDER);
+            //The score text geometry is rebuilt only when the score changes
+            if (state.getScores() != shownScores)
+            {
+                shownScores = state.getScores();
+                char scString[16];
+                std::snprintf(scString, sizeof(scString), "%d", shownScores);
+                assignString(scoresString, scString);
+                labelsMap[ELabelType::SCORES]->setString(scoresString);
+            }
+            renderFunc(&window, &blocks, labelsMap, &state);
+            if (timingsOverlay)
             {
-                switch (e.key.code)
+                if (timingsOverlayClock.getElapsedTime() > timingsOverlayPeriod)
                 {
-                case Keyboard::Up:
-                    tetris.rotate();
-                    break;
-
-                case Keyboard::Left:
-                    tetris.move(-1);
-                    break;
-
-                case Keyboard::Right:
-                    tetris.move(1);
-                    break;
-
-                case Keyboard::Down:
-                    tetris.drop();
-                    break;
-
-                case Keyboard::N:
-                    tetris.setGameState(game::EGameState::STATE_INGAME);
-                    break;
-
-                case Keyboard::P:
-                    tetris.setGamePause();
-                    break;
-                    
-                case Keyboard::R:
-                    tetris.resetGame();
-                    break;
-                
-                default:
-                    break;
+                    formatTimings(profiler, timingsText, sizeof(timingsText));
+                    assignString(timingsString, timingsText);
+                    labelsMap[ELabelType::TIMINGS_LABEL]->setString(timingsString);
+                    timingsOverlayClock.restart();
                 }
+                window.draw(*labelsMap[ELabelType::TIMINGS_LABEL]);
             }
         }
-        renderFunc(&window, &b, &s, labelsMap, &tetris);
-        tetris.update(time);
-        scString = std::to_string(tetris.getScores());
-        labelsMap[ELabelType::SCORES]->setString(scString);
+        {
+            game::CProfileScope scope(&profiler, game::EFramePhase::PHASE_DISPLAY);
+            TETRIS_TRACE_SCOPE("display");
+            window.display();
+        }
+        renderedState = state.getGameState();
+
+        //A running game doesn't touch the heap once the first frames have set everything up
+        if (renderedState == game::EGameState::STATE_INGAME && scheduler.getFramesCount() >= allocationsWarmUpFrames &&
+            frameAllocations.getCount() > 0)
+        {
+            steadyAllocations += frameAllocations.getCount();
+            ++allocatingFrames;
+        }
+
+        if (!timingsCsvPath.empty() && timingsCsvClock.getElapsedTime() > timingsCsvPeriod)
+        {
+            profiler.appendCsv(runClock.getElapsedTime().asSeconds());
+            timingsCsvClock.restart();
+        }
+        scheduler.waitForNextFrame();
+    }
+    simulation.stop();
+
+    std::cout << "Frames: " << scheduler.getFramesCount()
+              << ", missed deadlines: " << scheduler.getMissedFramesCount() << std::endl;
+    if (game::CAllocationTracker::isEnabled())
+    {
+        std::cout << "Steady state allocations: " << steadyAllocations << " in " << allocatingFrames
+                  << " frames, simulation: " << simulation.getSteadyAllocationsCount() << std::endl;
+    }
+    if (!replayPath.empty() && !replay.saveToFile(replayPath))
+    {
+        std::cerr << "Can't write the replay " << replayPath << std::endl;
     }
     return 0;
 }
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    using TClock = std::chrono::steady_clock;
+
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    struct DelayedPacket
+    {
+        TClock::time_point sendTime;
+        uint64_t order;
+        int target;
+        std::vector<uint8_t> data;
+
+        bool operator>(const DelayedPacket& other) const
+        {
+            return sendTime != other.sendTime ? sendTime > other.sendTime : order > other.order;
+        }
+    };
+
+    bool isSameAddress(const sockaddr_in& a, const sockaddr_in& b)
+    {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+}
+
+//Usage: tetris_relay <port> [delay ms] [jitter ms] [loss percent]
+//Forwards UDP packets between the first two addresses that send to it, with artificial
+//latency, jitter and loss. Jitter may reorder packets like a real network does.
+int main(int argv, char* argc[])
+{
+    if (argv < 2)
+    {
+        std::cerr << "Usage: tetris_relay <port> [delay ms] [jitter ms] [loss percent]" << std::endl;
+        return 1;
+    }
+    const int delay = argv > 2 ? std::max(0, std::atoi(argc[2])) : 50;
+    const int jitter = argv > 3 ? std::max(0, std::atoi(argc[3])) : 0;
+    const int loss = argv > 4 ? std::max(0, std::atoi(argc[4])) : 0;
+
+    const int udp = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(std::atoi(argc[1])));
+    if (udp < 0 || bind(udp, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        std::cerr << "Can't bind port " << argc[1] << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+
+    sockaddr_in peers[2];
+    int peersCount = 0;
+    std::priority_queue<DelayedPacket, std::vector<DelayedPacket>, std::greater<DelayedPacket>> queue;
+    std::minstd_rand random(1);
+    std::uniform_int_distribution<int> jitterDistribution(0, jitter);
+    std::uniform_int_distribution<int> lossDistribution(0, 99);
+    uint64_t order = 0;
+    uint64_t forwarded = 0;
+    uint64_t dropped = 0;
+
+    while (!stopRequested)
+    {
+        int timeout = 100;
+        if (!queue.empty())
+        {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(queue.top().sendTime - TClock::now()).count();
+            timeout = wait < 0 ? 0 : static_cast<int>(wait);
+        }
+        pollfd descriptor{udp, POLLIN, 0};
+        if (poll(&descriptor, 1, timeout) > 0)
+        {
+            uint8_t buffer[2048];
+            sockaddr_in source{};
+            socklen_t sourceSize = sizeof(source);
+            const ssize_t size = recvfrom(udp, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&source), &sourceSize);
+            int from = -1;
+            for (int i = 0; i < peersCount; ++i)
+            {
+                from = isSameAddress(peers[i], source) ? i : from;
+            }
+            if (from < 0 && peersCount < 2)
+            {
+                from = peersCount;
+                peers[peersCount++] = source;
+                std::cout << "peer " << from << ": " << inet_ntoa(source.sin_addr) << ":" << ntohs(source.sin_port) << std::endl;
+            }
+            if (size > 0 && from >= 0 && peersCount == 2)
+            {
+                if (lossDistribution(random) < loss)
+                {
+                    ++dropped;
+                }
+                else
+                {
+                    const auto sendTime = TClock::now() + std::chrono::milliseconds(delay + jitterDistribution(random));
+                    queue.push(DelayedPacket{sendTime, order++, 1 - from, std::vector<uint8_t>(buffer, buffer + size)});
+                }
+            }
+        }
+
+        const auto now = TClock::now();
+        while (!queue.empty() && queue.top().sendTime <= now)
+        {
+            const DelayedPacket& packet = queue.top();
+            sendto(udp, packet.data.data(), packet.data.size(), 0, reinterpret_cast<const sockaddr*>(&peers[packet.target]), sizeof(sockaddr_in));
+            ++forwarded;
+            queue.pop();
+        }
+    }
+    close(udp);
+    std::cout << "forwarded " << forwarded << ", dropped " << dropped << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "CGameServer.h"
+
+namespace
+{
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    //Every session is a socket, allow as many as the hard limit does
+    void raiseFilesLimit()
+    {
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+}
+
+//Usage: tetris_server [port] [threads] [tick rate] [bind address] [leaderboard log]
+int main(int argv, char* argc[])
+{
+    game::ServerConfig config;
+    if (argv > 1)
+    {
+        config.port = std::atoi(argc[1]);
+        config.spectatorPort = config.port + 1;
+    }
+    if (argv > 2)
+    {
+        config.threadsCount = static_cast<unsigned>(std::max(0, std::atoi(argc[2])));
+    }
+    if (argv > 3)
+    {
+        config.tickRate = std::max(1, std::atoi(argc[3]));
+    }
+    if (argv > 4)
+    {
+        config.address = argc[4];
+    }
+    if (argv > 5)
+    {
+        config.leaderboardPath = argc[5];
+    }
+
+    raiseFilesLimit();
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+    std::signal(SIGTERM, [](int) { stopRequested = 1; });
+
+    game::CGameServer server(config);
+    if (!server.start())
+    {
+        std::cerr << "Can't listen on " << config.address << ':' << config.port;
+        if (!config.leaderboardPath.empty())
+        {
+            std::cerr << " or read the leaderboard " << config.leaderboardPath;
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    const uint64_t corruptRecords = server.getLeaderboard().getCorruptRecords();
+    if (corruptRecords > 0)
+    {
+        std::cerr << "The leaderboard " << config.leaderboardPath << " has " << corruptRecords
+                  << " corrupt records before its end, they were skipped" << std::endl;
+    }
+    std::cout << "Listening on " << config.address << ':' << config.port << ", spectators on port "
+              << config.spectatorPort << ", with " << server.getThreadsCount() << " threads" << std::endl;
+
+    game::ShardStats last = server.getStats();
+    const int reportSeconds = 5;
+    while (!stopRequested)
+    {
+        for (int i = 0; i < reportSeconds * 10 && !stopRequested; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            server.flushLeaderboard();
+        }
+        const game::ShardStats stats = server.getStats();
+        const std::vector<game::ScoreEntry> top = server.getLeaderboard().getTop(1);
+        std::cout << "sessions " << stats.sessions
+                  << ", ticks/s " << (stats.ticks - last.ticks) / reportSeconds
+                  << ", late ticks " << stats.lateTicks - last.lateTicks
+                  << ", max tick " << stats.maxTickMicros << " us"
+                  << ", session updates/s " << (stats.sessionUpdates - last.sessionUpdates) / reportSeconds
+                  << ", inputs/s " << (stats.inputs - last.inputs) / reportSeconds
+                  << ", states/s " << (stats.states - last.states) / reportSeconds
+                  << ", KB/s " << (stats.bytesSent - last.bytesSent) / 1024 / reportSeconds
+                  << ", spectators " << stats.spectators
+                  << ", broadcasts/s " << (stats.broadcasts - last.broadcasts) / reportSeconds
+                  << ", skipped frames " << stats.skippedFrames - last.skippedFrames
+                  << ", errors " << stats.errors
+                  << ", high score " << (top.empty() ? 0 : top[0].scores) << std::endl;
+        last = stats;
+    }
+    server.stop();
+    return 0;
+}
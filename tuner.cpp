@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "CBatchSimulator.h"
+#include "CWeightTuner.h"
+
+//Usage: tetris_tuner [checkpoint file] [generations] [population size]
+int main(int argv, char* argc[])
+{
+    game::TunerConfig config;
+    config.checkpointPath = argv > 1 ? argc[1] : "tuner.checkpoint";
+    if (argv > 2)
+    {
+        config.generations = std::atoi(argc[2]);
+    }
+    if (argv > 3)
+    {
+        config.populationSize = std::atoi(argc[3]);
+    }
+    if (config.generations < 1 || config.populationSize < 1)
+    {
+        std::cerr << "Usage: tetris_tuner [checkpoint file] [generations] [population size]" << std::endl;
+        std::cerr << "The generations and the population size must be positive numbers" << std::endl;
+        return 1;
+    }
+
+    game::CBatchSimulator simulator;
+    game::CWeightTuner tuner(config, simulator);
+    switch (tuner.loadCheckpoint())
+    {
+        case game::ECheckpointStatus::CHECKPOINT_LOADED:
+            std::cout << "Resumed from generation " << tuner.getGeneration() << std::endl;
+            break;
+
+        case game::ECheckpointStatus::CHECKPOINT_INVALID:
+            std::cerr << "The checkpoint " << config.checkpointPath << " is broken or has another population size, "
+                      << "resume with the same arguments or choose another file" << std::endl;
+            return 1;
+
+        case game::ECheckpointStatus::CHECKPOINT_MISSING:
+            break;
+    }
+
+    std::cout << "Tuning on " << simulator.getThreadsCount() << " threads" << std::endl;
+    const bool saved = tuner.run([](int generation, const game::Candidate& best) {
+        std::cout << "Generation " << generation << ": best lines " << best.fitness << ", weights";
+        for (float weight : best.weights)
+        {
+            std::cout << ' ' << weight;
+        }
+        std::cout << std::endl;
+    });
+    if (!saved)
+    {
+        std::cerr << "Can't write the checkpoint " << config.checkpointPath << ", stopped after generation "
+                  << tuner.getGeneration() << std::endl;
+        return 1;
+    }
+    return 0;
+}
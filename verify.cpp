@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CReplayVerifier.h"
+
+namespace
+{
+    struct Claim
+    {
+        std::string path;
+        int scores;
+        int lines;
+    };
+
+    const char* getVerdictName(game::EVerdict verdict)
+    {
+        switch (verdict)
+        {
+            case game::EVerdict::VERDICT_VALID:
+                return "valid";
+
+            case game::EVerdict::VERDICT_MISMATCH:
+                return "mismatch";
+
+            case game::EVerdict::VERDICT_REJECTED:
+                return "rejected";
+        }
+        return "unknown";
+    }
+}
+
+//Usage: tetris_verify <submissions file> [threads] [verdicts file]
+//Every line of the submissions file is "<replay file> <claimed scores> <claimed lines>",
+//every verdict line is "<line number> <verdict> <scores> <lines> <replay file>".
+int main(int argv, char* argc[])
+{
+    if (argv < 2)
+    {
+        std::cerr << "Usage: tetris_verify <submissions file> [threads] [verdicts file]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(argc[1]);
+    if (!input)
+    {
+        std::cerr << "Can't open " << argc[1] << std::endl;
+        return 1;
+    }
+    std::vector<Claim> claims;
+    std::string line;
+    while (std::getline(input, line))
+    {
+        std::istringstream fields(line);
+        Claim claim;
+        if (fields >> claim.path >> claim.scores >> claim.lines)
+        {
+            claims.push_back(claim);
+        }
+    }
+
+    game::VerifierConfig config;
+    if (argv > 2)
+    {
+        config.threadsCount = static_cast<unsigned>(std::max(0, std::atoi(argc[2])));
+    }
+    std::ofstream verdictsFile;
+    if (argv > 3)
+    {
+        verdictsFile.open(argc[3], std::ios::app);
+        if (!verdictsFile)
+        {
+            std::cerr << "Can't open " << argc[3] << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& verdicts = argv > 3 ? verdictsFile : std::cout;
+
+    std::mutex outputMutex;
+    std::vector<int> tickRates(claims.size(), 0);
+    double simulatedSeconds = 0.0;
+    auto onVerdict = [&](const game::Verdict& verdict) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        simulatedSeconds += static_cast<double>(verdict.simulatedTicks) / tickRates[verdict.id];
+        verdicts << verdict.id + 1 << ' ' << getVerdictName(verdict.verdict) << ' ' << verdict.scores << ' '
+                 << verdict.lines << ' ' << claims[verdict.id].path << '\n';
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t unreadable = 0;
+    {
+        game::CReplayVerifier verifier(config, onVerdict);
+        std::cout << "Verifying " << claims.size() << " replays on " << verifier.getThreadsCount() << " threads" << std::endl;
+        for (size_t i = 0; i < claims.size(); ++i)
+        {
+            game::ReplaySubmission submission{i, game::CReplay(), claims[i].scores, claims[i].lines};
+            if (!submission.replay.loadFromFile(claims[i].path))
+            {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                verdicts << i + 1 << " unreadable 0 0 " << claims[i].path << '\n';
+                ++unreadable;
+                continue;
+            }
+            tickRates[i] = submission.replay.getTickRate();
+            verifier.submit(std::move(submission));
+        }
+        verifier.wait();
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const game::VerifierStats stats = verifier.getStats();
+        verdicts.flush();
+        std::cout << "valid " << stats.valid << ", mismatches " << stats.mismatches << ", rejected " << stats.rejected
+                  << ", unreadable " << unreadable << " in " << seconds << " s, " << stats.simulatedTicks
+                  << " ticks, " << static_cast<uint64_t>(simulatedSeconds / std::max(seconds, 1e-6))
+                  << " times real time" << std::endl;
+        if (stats.mismatches + stats.rejected + unreadable != 0)
+        {
+            return 2;
+        }
+    }
+    return 0;
+}
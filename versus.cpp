@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "CRollbackSession.h"
+#include "CHeuristicBot.h"
+#include "CFrameScheduler.h"
+#include "CTerminalInput.h"
+#include "CTerminalRenderer.h"
+
+namespace
+{
+    const int tickRate = 60;
+    const unsigned defaultSeed = 12345;
+    //Unacknowledged inputs are repeated in every packet, so a lost packet costs nothing
+    const uint32_t maxSentInputs = 24;
+    const size_t headerSize = 17;
+    //Frames the bot waits between its inputs, faster than a person but not every frame
+    const uint32_t botInputInterval = 4;
+    const auto lingerTime = std::chrono::milliseconds(500);
+
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    void writeU32(uint8_t* data, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            data[i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    uint32_t readU32(const uint8_t* data)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(data[i]) << (i * 8);
+        }
+        return value;
+    }
+
+    bool resolve(const std::string& endpoint, sockaddr_in& address)
+    {
+        const size_t colon = endpoint.rfind(':');
+        if (colon == std::string::npos)
+        {
+            return false;
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(endpoint.substr(0, colon).c_str(), endpoint.substr(colon + 1).c_str(), &hints, &result) != 0)
+        {
+            return false;
+        }
+        std::memcpy(&address, result->ai_addr, sizeof(address));
+        freeaddrinfo(result);
+        return true;
+    }
+
+    //Plays through the same inputs a person has: turns the figure to the placement of the heuristic
+    //bot, walks it to the column and drops it. The placement is chosen again for every new figure.
+    class CInputBot
+    {
+    public:
+        CInputBot()
+        : mFieldVersion(~0u)
+        , mTarget{0, 0}
+        {
+        }
+
+        uint8_t getInput(const game::CTetris& game)
+        {
+            if (game.getFieldVersion() != mFieldVersion)
+            {
+                mFieldVersion = game.getFieldVersion();
+                mTarget = mBot.findPlacement(game);
+            }
+
+            const int figure = game.getCurrentFigureId();
+            const game::Point* cells = game.getCurrentFigure();
+            if (getRotation(figure, cells) != mTarget.rotation)
+            {
+                return game::INPUT_ROTATE;
+            }
+            if (cells[1].x != mTarget.column)
+            {
+                return cells[1].x < mTarget.column ? game::INPUT_RIGHT : game::INPUT_LEFT;
+            }
+            return game::INPUT_DROP;
+        }
+
+    private:
+        static int getRotation(int figure, const game::Point* cells)
+        {
+            for (int r = 0; r < game::CBitBoard::getRotationsCount(figure); ++r)
+            {
+                const game::FigureShape& shape = game::CBitBoard::getShape(figure, r);
+                bool same = true;
+                for (int i = 0; i < 4 && same; ++i)
+                {
+                    same = cells[i].x - cells[1].x == shape.cells[i].x && cells[i].y - cells[1].y == shape.cells[i].y;
+                }
+                if (same)
+                {
+                    return r;
+                }
+            }
+            return 0;
+        }
+
+    private:
+        game::CHeuristicBot mBot;
+        unsigned mFieldVersion;
+        game::Placement mTarget;
+    };
+
+    uint8_t readKeys(CTerminalInput& input)
+    {
+        uint8_t keys = 0;
+        for (ETerminalKey key = input.poll(); key != ETerminalKey::KEY_NONE; key = input.poll())
+        {
+            switch (key)
+            {
+                case ETerminalKey::KEY_UP:
+                    keys |= game::INPUT_ROTATE;
+                    break;
+
+                case ETerminalKey::KEY_LEFT:
+                    keys |= game::INPUT_LEFT;
+                    break;
+
+                case ETerminalKey::KEY_RIGHT:
+                    keys |= game::INPUT_RIGHT;
+                    break;
+
+                case ETerminalKey::KEY_DOWN:
+                    keys |= game::INPUT_DROP;
+                    break;
+
+                case ETerminalKey::KEY_QUIT:
+                    stopRequested = 1;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        return keys;
+    }
+
+    //Packet: first frame, inputs count, acknowledged frame, checksum frame, checksum, inputs
+    class CPeer
+    {
+    public:
+        CPeer(int socket, const sockaddr_in& address)
+        : mSocket(socket)
+        , mAddress(address)
+        , mAckedFrame(0)
+        , mDesyncs(0)
+        , mChecked(0)
+        {
+        }
+
+        void send(const game::CRollbackSession& session)
+        {
+            uint8_t packet[headerSize + maxSentInputs];
+            const uint32_t frame = session.getFrame();
+            const uint32_t first = frame - mAckedFrame > maxSentInputs ? frame - maxSentInputs : mAckedFrame;
+            const uint32_t checksumFrame = session.getConfirmedFrame() > 0 ? std::min(session.getConfirmedFrame(), frame) - 1 : 0;
+            writeU32(packet, first);
+            packet[4] = static_cast<uint8_t>(frame - first);
+            writeU32(packet + 5, session.getConfirmedFrame());
+            writeU32(packet + 9, checksumFrame);
+            writeU32(packet + 13, frame > 0 ? session.getChecksum(checksumFrame) : 0);
+            for (uint32_t i = first; i < frame; ++i)
+            {
+                packet[headerSize + i - first] = session.getLocalInput(i);
+            }
+            sendto(mSocket, packet, headerSize + frame - first, 0, reinterpret_cast<const sockaddr*>(&mAddress), sizeof(mAddress));
+        }
+
+        void receive(game::CRollbackSession& session)
+        {
+            uint8_t packet[512];
+            for (;;)
+            {
+                const ssize_t size = recv(mSocket, packet, sizeof(packet), 0);
+                if (size < static_cast<ssize_t>(headerSize))
+                {
+                    break;
+                }
+                const uint32_t first = readU32(packet);
+                const uint32_t count = packet[4];
+                if (headerSize + count > static_cast<size_t>(size))
+                {
+                    continue;
+                }
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    session.addRemoteInput(first + i, packet[headerSize + i]);
+                }
+                const uint32_t acked = readU32(packet + 5);
+                mAckedFrame = acked > mAckedFrame ? acked : mAckedFrame;
+
+                //Both clients simulate both games, so their confirmed frames must be identical
+                const uint32_t remoteChecksum = readU32(packet + 13);
+                const uint32_t localChecksum = session.getChecksum(readU32(packet + 9));
+                if (remoteChecksum != 0 && localChecksum != 0)
+                {
+                    ++mChecked;
+                    mDesyncs += remoteChecksum != localChecksum ? 1 : 0;
+                }
+            }
+        }
+
+        uint64_t getDesyncsCount() const
+        {
+            return mDesyncs;
+        }
+
+        uint64_t getCheckedCount() const
+        {
+            return mChecked;
+        }
+
+    private:
+        int mSocket;
+        sockaddr_in mAddress;
+        uint32_t mAckedFrame;
+        uint64_t mDesyncs;
+        uint64_t mChecked;
+    };
+}
+
+//Usage: tetris_versus <player 0|1> <local port> <peer host:port> [seconds] [bot|play] [seed]
+//Two clients play the same figures against each other. Start them in any order,
+//through tetris_relay to add latency and loss.
+int main(int argv, char* argc[])
+{
+    if (argv < 4)
+    {
+        std::cerr << "Usage: tetris_versus <player 0|1> <local port> <peer host:port> [seconds] [bot|play] [seed]" << std::endl;
+        return 1;
+    }
+    const int player = std::atoi(argc[1]) == 0 ? 0 : 1;
+    const int seconds = argv > 4 ? std::max(1, std::atoi(argc[4])) : 60;
+    const bool interactive = argv > 5 && std::strcmp(argc[5], "play") == 0;
+    const unsigned seed = argv > 6 ? static_cast<unsigned>(std::strtoul(argc[6], nullptr, 10)) : defaultSeed;
+
+    sockaddr_in peerAddress{};
+    if (!resolve(argc[3], peerAddress))
+    {
+        std::cerr << "Can't resolve " << argc[3] << std::endl;
+        return 1;
+    }
+    const int udp = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in localAddress{};
+    localAddress.sin_family = AF_INET;
+    localAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    localAddress.sin_port = htons(static_cast<uint16_t>(std::atoi(argc[2])));
+    if (udp < 0 || bind(udp, reinterpret_cast<const sockaddr*>(&localAddress), sizeof(localAddress)) != 0)
+    {
+        std::cerr << "Can't bind port " << argc[2] << std::endl;
+        return 1;
+    }
+    fcntl(udp, F_SETFL, fcntl(udp, F_GETFL, 0) | O_NONBLOCK);
+    std::signal(SIGINT, [](int) { stopRequested = 1; });
+
+    game::CRollbackSession session(seed, player, tickRate);
+    CPeer peer(udp, peerAddress);
+    CInputBot bot;
+    game::CFrameScheduler scheduler(tickRate);
+    uint64_t stalls = 0;
+    double rollbackSeconds = 0.0;
+    {
+        std::unique_ptr<CTerminalInput> input;
+        std::unique_ptr<CTerminalRenderer> renderer;
+        if (interactive)
+        {
+            input = std::make_unique<CTerminalInput>();
+            renderer = std::make_unique<CTerminalRenderer>(stdout);
+        }
+
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (!stopRequested && std::chrono::steady_clock::now() < end)
+        {
+            peer.receive(session);
+            session.synchronize();
+            if (session.isFinished())
+            {
+                break;
+            }
+
+            const uint8_t keys = interactive ? readKeys(*input) : 0;
+            if (session.canAdvance())
+            {
+                const uint32_t frame = session.getFrame();
+                const game::CTetris& local = session.getGame(player);
+                const uint8_t localInput = interactive ? keys : (frame % botInputInterval == 0 ? bot.getInput(local) : 0);
+
+                const auto started = std::chrono::steady_clock::now();
+                session.advance(localInput);
+                rollbackSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            }
+            else
+            {
+                ++stalls;
+            }
+            peer.send(session);
+
+            if (renderer)
+            {
+                renderer->update(session.getGame(player));
+            }
+            scheduler.waitForNextFrame();
+        }
+    }
+
+    //Keeps sending for a moment, so the peer gets the last inputs too
+    const auto lingerEnd = std::chrono::steady_clock::now() + lingerTime;
+    while (std::chrono::steady_clock::now() < lingerEnd)
+    {
+        peer.receive(session);
+        peer.send(session);
+        scheduler.waitForNextFrame();
+    }
+    close(udp);
+
+    const game::RollbackStats& stats = session.getStats();
+    const uint32_t frames = session.getFrame();
+    std::cout << "player " << player << ": frames " << frames << ", confirmed " << session.getConfirmedFrame()
+              << ", stalls " << stalls << std::endl;
+    std::cout << "rollbacks " << stats.rollbacks << ", resimulated frames " << stats.resimulatedFrames
+              << ", max rollback " << stats.maxRollbackFrames << " frames, "
+              << (frames > 0 ? rollbackSeconds * 1e6 / frames : 0.0) << " us per frame with rollbacks" << std::endl;
+    std::cout << "checksums compared " << peer.getCheckedCount() << ", desyncs " << peer.getDesyncsCount() << std::endl;
+    for (int i = 0; i < game::CRollbackSession::mPlayersCount; ++i)
+    {
+        const game::CTetris& game = session.getGame(i);
+        std::cout << "player " << i << (i == player ? " (local)" : "") << ": score " << game.getScores()
+                  << ", lines " << game.getLines()
+                  << (game.getGameState() == game::EGameState::STATE_GAMEOVER ? ", lost" : "") << std::endl;
+    }
+    return peer.getDesyncsCount() == 0 ? 0 : 2;
+}
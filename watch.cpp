@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "CSharedState.h"
+
+namespace
+{
+    const char* getStateName(int32_t state)
+    {
+        switch (static_cast<game::EGameState>(state))
+        {
+            case game::EGameState::STATE_MAIN_MENU:
+                return "menu";
+
+            case game::EGameState::STATE_PAUSE:
+                return "pause";
+
+            case game::EGameState::STATE_INGAME:
+                return "game";
+
+            case game::EGameState::STATE_GAMEOVER:
+                return "game over";
+        }
+        return "unknown";
+    }
+}
+
+//Usage: tetris_watch <shared state name> [polls per second] [seconds]
+//Polls the state published by a game started with a shared state name
+//and prints it with the cost of the reads once a second.
+int main(int argv, char* argc[])
+{
+    if (argv < 2)
+    {
+        std::cerr << "Usage: tetris_watch <shared state name> [polls per second] [seconds]" << std::endl;
+        return 1;
+    }
+    const int pollRate = argv > 2 ? std::max(1, std::atoi(argc[2])) : 1000;
+    const int seconds = argv > 3 ? std::max(1, std::atoi(argc[3])) : 0;
+
+    game::CSharedStateReader reader;
+    if (!reader.open(argc[1]))
+    {
+        std::cerr << "Can't open the shared state " << argc[1] << ", is the game running?" << std::endl;
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto pollTime = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / pollRate));
+    game::LiveGameState state{};
+    uint32_t sequence = 0;
+    uint64_t polls = 0;
+    uint64_t reads = 0;
+    uint64_t failedReads = 0;
+    uint64_t readNanos = 0;
+    uint64_t maxReadNanos = 0;
+    auto nextPoll = Clock::now();
+    auto nextReport = nextPoll + std::chrono::seconds(1);
+    for (int elapsed = 0; seconds == 0 || elapsed < seconds;)
+    {
+        //Checking the counter is a single load, the state is copied only when it changed
+        ++polls;
+        if (reader.getSequence() != sequence)
+        {
+            const auto start = Clock::now();
+            const bool read = reader.read(state, sequence);
+            const uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            readNanos += nanos;
+            maxReadNanos = std::max(maxReadNanos, nanos);
+            if (read)
+            {
+                ++reads;
+            }
+            else
+            {
+                ++failedReads;
+            }
+        }
+
+        nextPoll += pollTime;
+        std::this_thread::sleep_until(nextPoll);
+        if (Clock::now() >= nextReport)
+        {
+            std::cout << "tick " << state.tick << ", " << getStateName(state.state) << ", scores " << state.scores
+                      << ", lines " << state.lines << ", figure " << state.figure
+                      << " | polls/s " << polls << ", new states/s " << reads << ", failed reads " << failedReads
+                      << ", read " << (reads + failedReads ? readNanos / (reads + failedReads) : 0)
+                      << " ns mean, " << maxReadNanos << " ns max" << std::endl;
+            polls = 0;
+            reads = 0;
+            failedReads = 0;
+            readNanos = 0;
+            maxReadNanos = 0;
+            nextReport += std::chrono::seconds(1);
+            ++elapsed;
+        }
+    }
+    return 0;
+}